@@ -0,0 +1,316 @@
+/**
+ * @file bench.cpp
+ * @brief Benchmark runner behind the `bench` target
+ *
+ * Runs every `*.scm` workload of a directory through the interpreter, on
+ * the tree-walker and on the VM, plus a generated parse-heavy file. Each
+ * workload starts with a `;; bench: ops=N` line giving the operations it
+ * performs. A run is a fresh `code --stats` process: wall time is taken
+ * around it, peak RSS from its rusage and the allocation count from the
+ * stats line it prints on stderr.
+ *
+ * Results are tab-separated, one workload and mode per line in a fixed
+ * order, so the files of two commits can be diffed directly or passed
+ * back through `--compare`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const int PARSE_FORMS = 20000;  ///< Toplevel defines in the generated parse workload
+
+struct Workload {
+    std::string name;
+    std::string path;
+    long long ops;
+};
+
+struct Result {
+    std::string name;
+    std::string mode;
+    long long ops;
+    double ns_per_op;
+    long long allocations;
+    long peak_rss_kb;
+};
+
+struct Run {
+    double ns;
+    long long allocations;
+    long peak_rss_kb;
+};
+
+[[noreturn]] void fail(const std::string &message) {
+    std::cerr << "bench-runner: " << message << '\n';
+    std::exit(1);
+}
+
+// ops declared on the first line of a workload, or 0 without a header
+long long declaredOps(const std::string &path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    const std::string tag = ";; bench: ops=";
+    if (line.compare(0, tag.size(), tag) != 0) {
+        return 0;
+    }
+    return std::atoll(line.c_str() + tag.size());
+}
+
+std::vector<Workload> findWorkloads(const std::string &dir) {
+    std::vector<Workload> workloads;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        fail("cannot open " + dir);
+    }
+    while (dirent *entry = readdir(d)) {
+        std::string file = entry->d_name;
+        if (file.size() <= 4 || file.compare(file.size() - 4, 4, ".scm") != 0) {
+            continue;
+        }
+        std::string path = dir + "/" + file;
+        long long ops = declaredOps(path);
+        if (ops <= 0) {
+            fail(path + ": missing ';; bench: ops=N' header");
+        }
+        workloads.push_back({file.substr(0, file.size() - 4), path, ops});
+    }
+    closedir(d);
+    std::sort(workloads.begin(), workloads.end(),
+              [](const Workload &a, const Workload &b) { return a.name < b.name; });
+    return workloads;
+}
+
+// many small toplevel definitions, so that reading and parsing dominate
+Workload generateParseWorkload(const std::string &path) {
+    std::ofstream out(path);
+    out << ";; bench: ops=" << PARSE_FORMS << '\n';
+    for (int i = 0; i < PARSE_FORMS; ++i) {
+        out << "(define (p" << i << " x) (if (< x " << i << ") (cons x '(p" << i
+            << " \"leaf\")) (let ((y (* x 2))) (cond ((= y 0) #t) (else (- y 1))))))\n";
+    }
+    out << "(p" << PARSE_FORMS - 1 << " 1)\n";
+    if (!out) {
+        fail("cannot write " + path);
+    }
+    return {"parse", path, PARSE_FORMS};
+}
+
+long long parseAllocations(const std::string &err) {
+    const std::string key = "allocated-objects=";
+    size_t at = err.rfind(key);
+    return at == std::string::npos ? -1 : std::atoll(err.c_str() + at + key.size());
+}
+
+Run runOnce(const std::string &code, const Workload &w, bool vm) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0) {
+        fail("pipe failed");
+    }
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fail("fork failed");
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(pipefd[1], 2);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        std::vector<const char*> argv = {code.c_str(), "--stats"};
+        if (vm) {
+            argv.push_back("--vm");
+        }
+        argv.push_back(w.path.c_str());
+        argv.push_back(nullptr);
+        execv(code.c_str(), const_cast<char* const*>(argv.data()));
+        _exit(127);
+    }
+    close(pipefd[1]);
+    std::string err;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(pipefd[0], buf, sizeof(buf))) > 0) {
+        err.append(buf, n);
+    }
+    close(pipefd[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        fail("wait failed");
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fail(w.name + (vm ? " (vm)" : "") + " failed:\n" + err);
+    }
+    Run run;
+    run.ns = std::chrono::duration<double, std::nano>(end - start).count();
+    run.allocations = parseAllocations(err);
+    run.peak_rss_kb = usage.ru_maxrss;
+    return run;
+}
+
+Result measure(const std::string &code, const Workload &w, bool vm, int reps) {
+    std::vector<double> times;
+    Result r = {w.name, vm ? "vm" : "tree", w.ops, 0, 0, 0};
+    for (int i = 0; i < reps; ++i) {
+        Run run = runOnce(code, w, vm);
+        times.push_back(run.ns);
+        r.allocations = run.allocations;
+        r.peak_rss_kb = std::max(r.peak_rss_kb, run.peak_rss_kb);
+    }
+    // the median is steadier than the mean against a stray slow run
+    std::sort(times.begin(), times.end());
+    r.ns_per_op = times[times.size() / 2] / w.ops;
+    return r;
+}
+
+const char *HEADER = "name\tmode\tops\tns_per_op\tallocs_per_op\tallocations\tpeak_rss_kb";
+
+std::string format(const Result &r) {
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(1);
+    os << r.name << '\t' << r.mode << '\t' << r.ops << '\t' << r.ns_per_op << '\t';
+    os.precision(2);
+    os << (double)r.allocations / r.ops << '\t' << r.allocations << '\t' << r.peak_rss_kb;
+    return os.str();
+}
+
+// ns/op of an earlier results file, keyed by "name mode"
+std::map<std::string, double> readBaseline(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+        fail("cannot read " + path);
+    }
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name, mode, ops, ns;
+        if (!std::getline(fields, name, '\t') || name == "name" ||
+            !std::getline(fields, mode, '\t') || !std::getline(fields, ops, '\t') ||
+            !std::getline(fields, ns, '\t')) {
+            continue;
+        }
+        baseline[name + " " + mode] = std::atof(ns.c_str());
+    }
+    return baseline;
+}
+
+// prints the change of every workload, returns whether any slowed down
+// by more than threshold percent
+bool compare(const std::vector<Result> &results, const std::map<std::string, double> &baseline,
+             double threshold) {
+    bool regressed = false;
+    std::fprintf(stderr, "%-12s %-5s %12s %12s %8s\n", "name", "mode", "old ns/op", "new ns/op", "change");
+    for (const Result &r : results) {
+        auto it = baseline.find(r.name + " " + r.mode);
+        if (it == baseline.end() || it->second <= 0) {
+            std::fprintf(stderr, "%-12s %-5s %12s %12.1f %8s\n", r.name.c_str(), r.mode.c_str(),
+                         "-", r.ns_per_op, "new");
+            continue;
+        }
+        double change = (r.ns_per_op / it->second - 1) * 100;
+        bool slower = change > threshold;
+        regressed = regressed || slower;
+        std::fprintf(stderr, "%-12s %-5s %12.1f %12.1f %+7.1f%%%s\n", r.name.c_str(), r.mode.c_str(),
+                     it->second, r.ns_per_op, change, slower ? "  REGRESSION" : "");
+    }
+    return regressed;
+}
+
+void usage() {
+    std::cerr << "usage: bench-runner [--reps N] [--mode tree|vm] [--out FILE]\n"
+                 "                    [--compare FILE] [--threshold PCT] INTERPRETER BENCH_DIR\n";
+    std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    int reps = 5;
+    std::string mode;
+    std::string out_path;
+    std::string baseline_path;
+    double threshold = 10;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--reps" && has_value) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--mode" && has_value) {
+            mode = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            out_path = argv[++i];
+        } else if (arg == "--compare" && has_value) {
+            baseline_path = argv[++i];
+        } else if (arg == "--threshold" && has_value) {
+            threshold = std::atof(argv[++i]);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2 || (!mode.empty() && mode != "tree" && mode != "vm")) {
+        usage();
+    }
+    const std::string &code = positional[0];
+
+    std::vector<Workload> workloads = findWorkloads(positional[1]);
+    char parse_path[] = "/tmp/bench-parse-XXXXXX";
+    int fd = mkstemp(parse_path);
+    if (fd < 0) {
+        fail("cannot create a temporary file");
+    }
+    close(fd);
+    workloads.push_back(generateParseWorkload(parse_path));
+
+    std::vector<Result> results;
+    for (const Workload &w : workloads) {
+        for (bool vm : {false, true}) {
+            if (mode.empty() || mode == (vm ? "vm" : "tree")) {
+                results.push_back(measure(code, w, vm, reps));
+                std::cerr << "  " << w.name << (vm ? " (vm)" : "") << " done\n";
+            }
+        }
+    }
+    unlink(parse_path);
+
+    std::ostringstream table;
+    table << HEADER << '\n';
+    for (const Result &r : results) {
+        table << format(r) << '\n';
+    }
+    std::cout << table.str();
+    if (!out_path.empty()) {
+        std::ofstream out(out_path);
+        out << table.str();
+        if (!out) {
+            fail("cannot write " + out_path);
+        }
+    }
+    if (!baseline_path.empty() && compare(results, readBaseline(baseline_path), threshold)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+;; bench: ops=150000
+;; Closure-heavy higher-order code: fifty rounds of map, filter and fold
+;; over 1000 elements with fresh lambdas, one op per closure call.
+
+(define (iota n acc)
+  (if (= n 0)
+      acc
+      (iota (- n 1) (cons n acc))))
+
+(define (my-map f lst)
+  (if (null? lst)
+      '()
+      (cons (f (car lst)) (my-map f (cdr lst)))))
+
+(define (my-filter keep? lst)
+  (cond ((null? lst) '())
+        ((keep? (car lst)) (cons (car lst) (my-filter keep? (cdr lst))))
+        (else (my-filter keep? (cdr lst)))))
+
+(define (fold f acc lst)
+  (if (null? lst)
+      acc
+      (fold f (f acc (car lst)) (cdr lst))))
+
+(define (make-adder n) (lambda (x) (+ x n)))
+
+(define (compose f g) (lambda (x) (f (g x))))
+
+(define numbers (iota 1000 '()))
+
+(define (round k)
+  (if (> k 0)
+      (let ((step (compose (make-adder k) (lambda (x) (* x 2)))))
+        (fold (lambda (acc x) (+ acc x))
+              0
+              (my-filter (lambda (x) (= (modulo x 3) 0))
+                         (my-map step numbers)))
+        (round (- k 1)))
+      (void)))
+
+(round 50)
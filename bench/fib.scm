@@ -0,0 +1,14 @@
+;; bench: ops=728355
+;; Deep non-tail recursion: three runs of (fib 25), one op per call.
+
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+
+(define (repeat k)
+  (if (> k 0)
+      (begin (fib 25) (repeat (- k 1)))
+      (void)))
+
+(repeat 3)
@@ -0,0 +1,28 @@
+;; bench: ops=300000
+;; List building and traversal with cons/car/cdr: ten rounds that each
+;; build, sum and reverse a 10000-element list, one op per cell touched.
+
+(define (iota n acc)
+  (if (= n 0)
+      acc
+      (iota (- n 1) (cons n acc))))
+
+(define (sum lst acc)
+  (if (null? lst)
+      acc
+      (sum (cdr lst) (+ acc (car lst)))))
+
+(define (rev lst acc)
+  (if (null? lst)
+      acc
+      (rev (cdr lst) (cons (car lst) acc))))
+
+(define (round k)
+  (if (> k 0)
+      (let ((lst (iota 10000 '())))
+        (sum lst 0)
+        (rev lst '())
+        (round (- k 1)))
+      (void)))
+
+(round 10)
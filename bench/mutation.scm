@@ -0,0 +1,24 @@
+;; bench: ops=200000
+;; set-car! mutation loops: two hundred passes that increment every
+;; element of a 1000-element list in place, one op per set-car!.
+
+(define (iota n acc)
+  (if (= n 0)
+      acc
+      (iota (- n 1) (cons n acc))))
+
+(define cells (iota 1000 '()))
+
+(define (bump! lst)
+  (if (pair? lst)
+      (begin
+        (set-car! lst (+ (car lst) 1))
+        (bump! (cdr lst)))
+      (void)))
+
+(define (passes k)
+  (if (> k 0)
+      (begin (bump! cells) (passes (- k 1)))
+      (void)))
+
+(passes 200)
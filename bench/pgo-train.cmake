@@ -0,0 +1,32 @@
+# PGO 训练： 由 pgo-train 目标以 cmake -P 运行
+# 需要 -DCODE=<解释器> -DBENCH_RUNNER=<bench-runner> -DSOURCE_DIR=<仓库根目录> -DPROFILE_DIR=<剖析数据目录>
+# 先清掉旧的剖析数据， 再让插桩后的解释器在树遍历与虚拟机两种模式下跑完
+# score/data 的全部输入， 最后跑一遍基准测试
+
+file(REMOVE_RECURSE ${PROFILE_DIR})
+file(MAKE_DIRECTORY ${PROFILE_DIR})
+
+file(GLOB inputs ${SOURCE_DIR}/score/data/*.in)
+list(LENGTH inputs count)
+message(STATUS "pgo-train: ${count} programs from score/data")
+set(program ${PROFILE_DIR}/input.scm)
+foreach(input ${inputs})
+    # 与 score.sh 一样在末尾补上 (exit)
+    file(READ ${input} text)
+    file(WRITE ${program} "${text}\n(exit)\n")
+    foreach(mode "" "--vm")
+        # 部分数据本来就以报错结束， 只关心它们走过的路径
+        execute_process(COMMAND ${CODE} ${mode}
+            INPUT_FILE ${program}
+            OUTPUT_QUIET ERROR_QUIET
+            TIMEOUT 60)
+    endforeach()
+endforeach()
+file(REMOVE ${program})
+
+message(STATUS "pgo-train: benchmark suite")
+execute_process(COMMAND ${BENCH_RUNNER} --out ${PROFILE_DIR}/train.tsv ${CODE} ${SOURCE_DIR}/bench
+    RESULT_VARIABLE bench_result)
+if(NOT bench_result EQUAL 0)
+    message(FATAL_ERROR "pgo-train: bench-runner failed (${bench_result})")
+endif()
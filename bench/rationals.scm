@@ -0,0 +1,16 @@
+;; bench: ops=10200
+;; Exact rational arithmetic: the harmonic number H(200), whose terms
+;; grow into bignums, then 10000 small-fraction products, one op each.
+
+(define (harmonic k n acc)
+  (if (> k n)
+      acc
+      (harmonic (+ k 1) n (+ acc (/ 1 k)))))
+
+(define (products k acc)
+  (if (= k 0)
+      acc
+      (products (- k 1) (* (/ (+ k 1) k) (/ k (+ k 1)) acc))))
+
+(harmonic 1 200 0)
+(products 10000 1)
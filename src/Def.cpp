@@ -8,6 +8,9 @@
  */
 
 #include "Def.hpp"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 
 /**
  * @brief Mapping of primitive function names to expression types
@@ -19,13 +22,19 @@
  * Categories:
  * - Arithmetic: +, -, *, /, modulo, expt
  * - Comparison: <, <=, =, >=, >
- * - List operations: cons, car, cdr, list, set-car!, set-cdr!
+ * - List operations: cons, car, cdr, list, set-car!, set-cdr!, length, reverse, append
+ * - Higher-order list operations: apply, map, for-each, fold-left
+ * - Vectors: make-vector, vector, vector-ref, vector-set!, vector-length
+ * - Hash tables: make-hash-table, hash-ref, hash-set!, hash-count
+ * - Promises and streams: force, stream-car, stream-cdr
  * - Logic: not, and, or (and/or support short-circuit evaluation)
- * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
+ * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?,
+ *   vector?, hash-table?, promise?
  * - I/O: display
  * - Control: void, exit
+ * - Runtime: gc-stats, runtime-stats
  */
-std::map<std::string, ExprType> primitives = {
+extern const std::map<std::string, ExprType> primitives = {
     // Arithmetic operations
     {"+",        E_PLUS},
     {"-",        E_MINUS},
@@ -48,6 +57,35 @@ std::map<std::string, ExprType> primitives = {
     {"list",      E_LIST},
     {"set-car!",  E_SETCAR},
     {"set-cdr!",  E_SETCDR},
+    {"length",    E_LENGTH},
+    {"reverse",   E_REVERSE},
+    {"append",    E_APPEND},
+
+    // Higher-order list operations
+    {"apply",     E_APPLYFUNC},
+    {"map",       E_MAP},
+    {"for-each",  E_FOREACH},
+    {"fold-left", E_FOLDLEFT},
+
+    // Vector and hash table operations
+    {"make-vector",     E_MAKEVECTOR},
+    {"vector",          E_VECTOR},
+    {"vector-ref",      E_VECTORREF},
+    {"vector-set!",     E_VECTORSET},
+    {"vector-length",   E_VECTORLENGTH},
+    {"make-hash-table", E_MAKEHASHTABLE},
+    {"hash-ref",        E_HASHREF},
+    {"hash-set!",       E_HASHSET},
+    {"hash-count",      E_HASHCOUNT},
+
+    // Memoization
+    {"memoize",         E_MEMOIZE},
+    {"memo-stats",      E_MEMOSTATS},
+
+    // Promises and streams
+    {"force",           E_FORCE},
+    {"stream-car",      E_STREAMCAR},
+    {"stream-cdr",      E_STREAMCDR},
 
     // Logic operations
     {"not",       E_NOT},
@@ -64,13 +102,20 @@ std::map<std::string, ExprType> primitives = {
     {"symbol?",    E_SYMBOLQ},
     {"list?",      E_LISTQ},
     {"string?",    E_STRINGQ},
+    {"vector?",    E_VECTORQ},
+    {"hash-table?", E_HASHTABLEQ},
+    {"promise?",   E_PROMISEQ},
     
     // I/O operations
     {"display",   E_DISPLAY},
     
     // Special values and control
     {"void",      E_VOID},
-    {"exit",      E_EXIT}
+    {"exit",      E_EXIT},
+
+    // Runtime introspection
+    {"gc-stats",  E_GCSTATS},
+    {"runtime-stats", E_RUNTIMESTATS}
 };
 
 /**
@@ -84,14 +129,15 @@ std::map<std::string, ExprType> primitives = {
  * - Control flow constructs: begin, quote
  * - Conditional : if, cond
  * - Function definition: lambda
- * - Variable and function definition: define
+ * - Variable and function definition: define, define-memo
  * - Binding constructs: let, letrec
  * - Assignment: set!
+ * - Lazy evaluation: delay, cons-stream
  * 
  * Note: and/or have been moved to primitives to support function-style usage
  * while maintaining their short-circuit evaluation behavior.
  */
-std::map<std::string, ExprType> reserved_words = {
+extern const std::map<std::string, ExprType> reserved_words = {
     // Control flow constructs
     {"begin",   E_BEGIN},    
     {"quote",   E_QUOTE},    
@@ -105,11 +151,99 @@ std::map<std::string, ExprType> reserved_words = {
 
     // Variable and function definition
     {"define",  E_DEFINE},   
+    {"define-memo", E_DEFINEMEMO},
 
     // Binding constructs
     {"let",     E_LET},      
     {"letrec",  E_LETREC},   
     
     // Assignment
-    {"set!",    E_SET}      
+    {"set!",    E_SET},
+
+    // Lazy evaluation
+    {"delay",       E_DELAY},
+    {"cons-stream", E_CONSSTREAM},
+
+    // Profiling
+    {"profile", E_PROFILE}
 };
+
+/**
+ * @brief Identifier interning table
+ *
+ * Names are stored in a deque so the references handed out by symbolName
+ * stay valid as the table grows, and the index is keyed by views of those
+ * same strings, so a lookup never builds a string. Both containers are
+ * leaked on purpose so that they outlive any static that still refers to
+ * a name at exit. The table is the one structure every interpreter thread
+ * shares, so all access goes through symbolLock.
+ */
+static std::mutex &symbolLock() {
+    static auto *lock = new std::mutex();
+    return *lock;
+}
+
+static std::unordered_map<std::string_view, SymbolId> &symbolIds() {
+    static auto *ids = new std::unordered_map<std::string_view, SymbolId>();
+    return *ids;
+}
+
+static std::deque<std::string> &symbolNames() {
+    static auto *names = new std::deque<std::string>();
+    return *names;
+}
+
+SymbolId intern(std::string_view name) {
+    std::lock_guard<std::mutex> guard(symbolLock());
+    auto &ids = symbolIds();
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    SymbolId id = (SymbolId)symbolNames().size();
+    symbolNames().emplace_back(name);
+    ids.emplace(symbolNames().back(), id);
+    return id;
+}
+
+const std::string &symbolName(SymbolId id) {
+    std::lock_guard<std::mutex> guard(symbolLock());
+    return symbolNames()[id];
+}
+
+/**
+ * @brief Dense SymbolId-indexed copy of a keyword map
+ *
+ * Entry x holds the ExprType of name x plus one, or 0 for an ordinary
+ * name. Every keyword is interned when the table is built, so the table
+ * covers the ids of all of them and any later id is ordinary.
+ */
+static std::vector<unsigned char> keywordTable(const std::map<std::string, ExprType> &words) {
+    std::vector<unsigned char> table;
+    for (const auto &entry : words) {
+        SymbolId x = intern(entry.first);
+        if ((size_t)x >= table.size()) {
+            table.resize(x + 1, 0);
+        }
+        table[x] = (unsigned char)(entry.second + 1);
+    }
+    return table;
+}
+
+static bool keywordType(const std::vector<unsigned char> &table, SymbolId x, ExprType &type) {
+    if ((size_t)x >= table.size() || table[x] == 0) {
+        return false;
+    }
+    type = (ExprType)(table[x] - 1);
+    return true;
+}
+
+bool primitiveType(SymbolId x, ExprType &type) {
+    static const std::vector<unsigned char> table = keywordTable(primitives);
+    return keywordType(table, x, type);
+}
+
+bool reservedType(SymbolId x, ExprType &type) {
+    static const std::vector<unsigned char> table = keywordTable(reserved_words);
+    return keywordType(table, x, type);
+}
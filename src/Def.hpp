@@ -11,19 +11,52 @@
  */
 
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include <iostream>
 #include <map>
+#include <memory>
 
 using NumericType = int;
 
+/**
+ * @brief Interned identifier
+ *
+ * Every distinct identifier is mapped to a unique small integer the first
+ * time the reader sees it, so names compare with a single integer compare.
+ */
+using SymbolId = int;
+
+SymbolId intern(std::string_view);
+const std::string &symbolName(SymbolId);
+
 // Forward declarations
 struct Syntax;
-struct Expr;
+struct ExprBase;
 struct Value;
-struct AssocList;
-struct Assoc;
+struct GlobalTable;
+struct Globals;
+struct Frame;
+struct Env;
+struct Scope;
+struct Chunk;
+
+/**
+ * @brief Shared handle to an expression node
+ *
+ * Kept here rather than in expr.hpp so that values can hold expressions
+ * (procedure bodies) and expressions can hold values (literal data)
+ * without value.hpp and expr.hpp including each other.
+ */
+class Expr {
+    std::shared_ptr<ExprBase> ptr;
+public:
+    Expr(ExprBase *);
+    ExprBase* operator->() const;
+    ExprBase& operator*();
+    ExprBase* get() const;
+};
 
 /**
  * @brief Expression types enumeration
@@ -63,6 +96,35 @@ enum ExprType {
     E_LIST,             
     E_SETCAR,          
     E_SETCDR,          
+    E_LENGTH,
+    E_REVERSE,
+    E_APPEND,
+
+    // Higher-order list operations
+    E_APPLYFUNC,
+    E_MAP,
+    E_FOREACH,
+    E_FOLDLEFT,
+
+    // Vector and hash table operations
+    E_MAKEVECTOR,
+    E_VECTOR,
+    E_VECTORREF,
+    E_VECTORSET,
+    E_VECTORLENGTH,
+    E_MAKEHASHTABLE,
+    E_HASHREF,
+    E_HASHSET,
+    E_HASHCOUNT,
+
+    // Memoization
+    E_MEMOIZE,
+    E_MEMOSTATS,
+
+    // Promises and streams
+    E_FORCE,
+    E_STREAMCAR,
+    E_STREAMCDR,
 
     // Logic operations
     E_NOT,              
@@ -79,6 +141,9 @@ enum ExprType {
     E_SYMBOLQ,         
     E_LISTQ,                
     E_STRINGQ,          
+    E_VECTORQ,
+    E_HASHTABLEQ,
+    E_PROMISEQ,
 
     // Control flow constructs
     E_BEGIN,          
@@ -93,6 +158,7 @@ enum ExprType {
     E_APPLY,           
     E_LAMBDA,         
     E_DEFINE,          
+    E_DEFINEMEMO,
 
     // Binding constructs
     E_LET,            
@@ -101,8 +167,17 @@ enum ExprType {
     // Assignment
     E_SET,             
 
+    // Lazy evaluation
+    E_DELAY,
+    E_CONSSTREAM,
+
     // I/O operations
     E_DISPLAY,         
+
+    // Runtime introspection
+    E_GCSTATS,
+    E_PROFILE,
+    E_RUNTIMESTATS,
 };
 
 /**
@@ -113,15 +188,30 @@ enum ExprType {
  */
 enum ValueType {
     V_INT,              
+    V_BIGINT,
     V_RATIONAL,         
     V_BOOL,             
     V_SYM,              
     V_NULL,             
     V_STRING,           
     V_PAIR,             
+    V_VECTOR,
+    V_HASHTABLE,
+    V_PROMISE,
     V_PROC,             
+    V_PRIMITIVE,
     V_VOID,            
     V_TERMINATE        
 };
 
+/**
+ * @brief Classify an identifier as a builtin or a special form
+ *
+ * Both return false for an ordinary name. The tables behind them are
+ * indexed by SymbolId, so the parser pays a bounds check and a load per
+ * form instead of string map searches.
+ */
+bool primitiveType(SymbolId, ExprType &);
+bool reservedType(SymbolId, ExprType &);
+
 #endif // DEF_HPP
@@ -0,0 +1,415 @@
+/**
+ * @file bigint.cpp
+ * @brief Arbitrary-precision integer arithmetic
+ *
+ * Schoolbook algorithms throughout, except that products of two operands
+ * of at least KARATSUBA_THRESHOLD limbs switch to Karatsuba's three
+ * half-size multiplications, which keeps `expt` on large bases tractable.
+ * Division is Knuth's algorithm D.
+ */
+
+#include "bigint.hpp"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+namespace {
+
+const size_t KARATSUBA_THRESHOLD = 32;  ///< Limbs below which schoolbook is faster
+const uint32_t DECIMAL_CHUNK = 1000000000;  ///< 10^9, the largest power of ten in a limb
+const int DECIMAL_CHUNK_DIGITS = 9;
+
+} // namespace
+
+// ============================================================================
+// Construction and conversion
+// ============================================================================
+
+BigInt::BigInt() : negative(false) {}
+
+BigInt::BigInt(long long n) : negative(n < 0) {
+    // negate in unsigned arithmetic so that LLONG_MIN is representable
+    unsigned long long m = negative ? 0ULL - (unsigned long long)n : (unsigned long long)n;
+    while (m != 0) {
+        mag.push_back((uint32_t)m);
+        m >>= 32;
+    }
+}
+
+BigInt BigInt::parse(const std::string &s) {
+    BigInt result;
+    size_t i = 0;
+    bool neg = false;
+    if (i < s.size() && (s[i] == '+' || s[i] == '-')) {
+        neg = s[i] == '-';
+        ++i;
+    }
+    // consume the digits nine at a time: result = result * 10^k + chunk
+    while (i < s.size()) {
+        size_t len = std::min((size_t)DECIMAL_CHUNK_DIGITS, s.size() - i);
+        uint32_t chunk = 0, scale = 1;
+        for (size_t j = 0; j < len; ++j) {
+            chunk = chunk * 10 + (uint32_t)(s[i + j] - '0');
+            scale *= 10;
+        }
+        uint64_t carry = chunk;
+        for (uint32_t &limb : result.mag) {
+            uint64_t t = (uint64_t)limb * scale + carry;
+            limb = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry != 0) {
+            result.mag.push_back((uint32_t)carry);
+        }
+        i += len;
+    }
+    result.negative = neg;
+    result.trim();
+    return result;
+}
+
+bool BigInt::fitsInt() const {
+    if (mag.size() > 1) {
+        return false;
+    }
+    uint64_t m = mag.empty() ? 0 : mag[0];
+    return negative ? m <= (uint64_t)INT_MAX + 1 : m <= (uint64_t)INT_MAX;
+}
+
+int BigInt::toInt() const {
+    int64_t m = mag.empty() ? 0 : mag[0];
+    return (int)(negative ? -m : m);
+}
+
+std::string BigInt::toString() const {
+    if (mag.empty()) {
+        return "0";
+    }
+    Limbs rest = mag;
+    std::vector<uint32_t> chunks;
+    while (!rest.empty()) {
+        chunks.push_back(divmodSmall(rest, DECIMAL_CHUNK));
+    }
+    std::string s = negative ? "-" : "";
+    s += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string part = std::to_string(chunks[i]);
+        s.append(DECIMAL_CHUNK_DIGITS - part.size(), '0');
+        s += part;
+    }
+    return s;
+}
+
+void BigInt::trim() {
+    while (!mag.empty() && mag.back() == 0) {
+        mag.pop_back();
+    }
+    if (mag.empty()) {
+        negative = false;
+    }
+}
+
+// ============================================================================
+// Comparison and signed arithmetic
+// ============================================================================
+
+int BigInt::compare(const BigInt &other) const {
+    if (negative != other.negative) {
+        return negative ? -1 : 1;
+    }
+    int c = compareMag(mag, other.mag);
+    return negative ? -c : c;
+}
+
+BigInt BigInt::operator-() const {
+    BigInt r = *this;
+    if (!r.mag.empty()) {
+        r.negative = !r.negative;
+    }
+    return r;
+}
+
+BigInt BigInt::abs() const {
+    BigInt r = *this;
+    r.negative = false;
+    return r;
+}
+
+BigInt operator+(const BigInt &a, const BigInt &b) {
+    BigInt r;
+    if (a.negative == b.negative) {
+        r.mag = BigInt::addMag(a.mag, b.mag);
+        r.negative = a.negative;
+    } else if (BigInt::compareMag(a.mag, b.mag) >= 0) {
+        r.mag = BigInt::subMag(a.mag, b.mag);
+        r.negative = a.negative;
+    } else {
+        r.mag = BigInt::subMag(b.mag, a.mag);
+        r.negative = b.negative;
+    }
+    r.trim();
+    return r;
+}
+
+BigInt operator-(const BigInt &a, const BigInt &b) {
+    return a + (-b);
+}
+
+BigInt operator*(const BigInt &a, const BigInt &b) {
+    BigInt r;
+    r.mag = BigInt::mulMag(a.mag, b.mag);
+    r.negative = a.negative != b.negative;
+    r.trim();
+    return r;
+}
+
+void BigInt::divmod(const BigInt &a, const BigInt &b, BigInt &q, BigInt &r) {
+    if (b.mag.empty()) {
+        throw std::runtime_error("Division by zero");
+    }
+    Limbs qm, rm;
+    divmodMag(a.mag, b.mag, qm, rm);
+    q.mag = qm;
+    q.negative = a.negative != b.negative;
+    q.trim();
+    r.mag = rm;
+    r.negative = a.negative;
+    r.trim();
+}
+
+BigInt BigInt::gcd(const BigInt &a, const BigInt &b) {
+    BigInt x = a.abs(), y = b.abs();
+    BigInt q, r;
+    while (!y.isZero()) {
+        divmod(x, y, q, r);
+        x = y;
+        y = r;
+    }
+    return x;
+}
+
+BigInt BigInt::pow(const BigInt &base, unsigned exponent) {
+    BigInt result(1), b = base;
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result = result * b;
+        }
+        exponent >>= 1;
+        if (exponent != 0) {
+            b = b * b;
+        }
+    }
+    return result;
+}
+
+// ============================================================================
+// Magnitude arithmetic
+// ============================================================================
+
+int BigInt::compareMag(const Limbs &a, const Limbs &b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+BigInt::Limbs BigInt::addMag(const Limbs &a, const Limbs &b) {
+    const Limbs &longer = a.size() >= b.size() ? a : b;
+    const Limbs &shorter = a.size() >= b.size() ? b : a;
+    Limbs r(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        uint64_t t = (uint64_t)longer[i] + (i < shorter.size() ? shorter[i] : 0) + carry;
+        r[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    r[longer.size()] = (uint32_t)carry;
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+    return r;
+}
+
+// requires |a| >= |b|
+BigInt::Limbs BigInt::subMag(const Limbs &a, const Limbs &b) {
+    Limbs r(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int64_t t = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = t < 0;
+        r[i] = (uint32_t)t;
+    }
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+    return r;
+}
+
+BigInt::Limbs BigInt::mulMag(const Limbs &a, const Limbs &b) {
+    if (a.empty() || b.empty()) {
+        return Limbs();
+    }
+    if (std::min(a.size(), b.size()) >= KARATSUBA_THRESHOLD) {
+        return karatsuba(a, b);
+    }
+    Limbs r(a.size() + b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); ++j) {
+            uint64_t t = (uint64_t)a[i] * b[j] + r[i + j] + carry;
+            r[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        r[i + b.size()] = (uint32_t)carry;
+    }
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+    return r;
+}
+
+// a = a1 B^m + a0, b = b1 B^m + b0:
+// a b = z2 B^2m + (z1 - z2 - z0) B^m + z0 with z1 = (a0 + a1)(b0 + b1)
+BigInt::Limbs BigInt::karatsuba(const Limbs &a, const Limbs &b) {
+    size_t m = std::max(a.size(), b.size()) / 2;
+    auto low = [m](const Limbs &x) {
+        Limbs part(x.begin(), x.begin() + std::min(m, x.size()));
+        while (!part.empty() && part.back() == 0) {
+            part.pop_back();
+        }
+        return part;
+    };
+    auto high = [m](const Limbs &x) {
+        return x.size() > m ? Limbs(x.begin() + m, x.end()) : Limbs();
+    };
+    Limbs a0 = low(a), a1 = high(a), b0 = low(b), b1 = high(b);
+    Limbs z0 = mulMag(a0, b0);
+    Limbs z2 = mulMag(a1, b1);
+    Limbs z1 = subMag(subMag(mulMag(addMag(a0, a1), addMag(b0, b1)), z0), z2);
+
+    Limbs r(a.size() + b.size() + 1);
+    auto addShifted = [&r](const Limbs &x, size_t shift) {
+        uint64_t carry = 0;
+        size_t i = 0;
+        for (; i < x.size(); ++i) {
+            uint64_t t = (uint64_t)r[i + shift] + x[i] + carry;
+            r[i + shift] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        for (; carry != 0; ++i) {
+            uint64_t t = (uint64_t)r[i + shift] + carry;
+            r[i + shift] = (uint32_t)t;
+            carry = t >> 32;
+        }
+    };
+    addShifted(z0, 0);
+    addShifted(z1, m);
+    addShifted(z2, 2 * m);
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+    return r;
+}
+
+// divides x in place by a single limb and returns the remainder
+uint32_t BigInt::divmodSmall(Limbs &x, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = x.size(); i-- > 0;) {
+        uint64_t cur = (rem << 32) | x[i];
+        x[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    while (!x.empty() && x.back() == 0) {
+        x.pop_back();
+    }
+    return (uint32_t)rem;
+}
+
+void BigInt::divmodMag(const Limbs &u, const Limbs &v, Limbs &q, Limbs &r) {
+    if (compareMag(u, v) < 0) {
+        q.clear();
+        r = u;
+        return;
+    }
+    if (v.size() == 1) {
+        q = u;
+        uint32_t rem = divmodSmall(q, v[0]);
+        r.clear();
+        if (rem != 0) {
+            r.push_back(rem);
+        }
+        return;
+    }
+
+    // normalize so that the divisor's top limb has its high bit set
+    const size_t n = v.size(), m = u.size() - n;
+    const int s = __builtin_clz(v.back());
+    Limbs vn(n), un(u.size() + 1);
+    for (size_t i = n - 1; i > 0; --i) {
+        vn[i] = (v[i] << s) | (s ? (uint32_t)((uint64_t)v[i - 1] >> (32 - s)) : 0);
+    }
+    vn[0] = v[0] << s;
+    un[u.size()] = s ? (uint32_t)((uint64_t)u.back() >> (32 - s)) : 0;
+    for (size_t i = u.size() - 1; i > 0; --i) {
+        un[i] = (u[i] << s) | (s ? (uint32_t)((uint64_t)u[i - 1] >> (32 - s)) : 0);
+    }
+    un[0] = u[0] << s;
+
+    const uint64_t base = 1ULL << 32;
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        // estimate the quotient digit from the top two limbs, then correct
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num % vn[n - 1];
+        while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            --qhat;
+            rhat += vn[n - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        // un[j..j+n] -= qhat * vn
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t p = qhat * vn[i] + carry;
+            carry = p >> 32;
+            int64_t t = (int64_t)un[i + j] - (int64_t)(p & 0xffffffffULL) - borrow;
+            borrow = t < 0;
+            un[i + j] = (uint32_t)t;
+        }
+        int64_t t = (int64_t)un[j + n] - (int64_t)carry - borrow;
+        un[j + n] = (uint32_t)t;
+
+        if (t < 0) {
+            // qhat was one too large: add the divisor back
+            --qhat;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t sum = (uint64_t)un[i + j] + vn[i] + c;
+                un[i + j] = (uint32_t)sum;
+                c = sum >> 32;
+            }
+            un[j + n] += (uint32_t)c;
+        }
+        q[j] = (uint32_t)qhat;
+    }
+    while (!q.empty() && q.back() == 0) {
+        q.pop_back();
+    }
+
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i + 1] << (32 - s)) : 0);
+    }
+    while (!r.empty() && r.back() == 0) {
+        r.pop_back();
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef BIGINT_HPP
+#define BIGINT_HPP
+
+/**
+ * @file bigint.hpp
+ * @brief Arbitrary-precision signed integers
+ *
+ * Backs the exact numeric tower: integers outside the fixnum range and
+ * both parts of every rational. Values are stored in sign-magnitude form
+ * with little-endian 32-bit limbs and no leading zero limbs, so zero is
+ * the empty magnitude.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BigInt {
+public:
+    BigInt();
+    explicit BigInt(long long);
+
+    /// Parse an optionally signed decimal literal
+    static BigInt parse(const std::string &);
+
+    bool isZero() const { return mag.empty(); }
+    bool isNegative() const { return negative; }
+    bool isOne() const { return !negative && mag.size() == 1 && mag[0] == 1; }
+    bool fitsInt() const;
+    int toInt() const;
+    std::string toString() const;
+
+    /// -1, 0 or 1 as this is less than, equal to or greater than other
+    int compare(const BigInt &) const;
+
+    BigInt operator-() const;
+    BigInt abs() const;
+    friend BigInt operator+(const BigInt &, const BigInt &);
+    friend BigInt operator-(const BigInt &, const BigInt &);
+    friend BigInt operator*(const BigInt &, const BigInt &);
+
+    /// Truncating division: the quotient rounds toward zero and the
+    /// remainder takes the sign of the dividend, as with C++ `/` and `%`
+    static void divmod(const BigInt &, const BigInt &, BigInt &, BigInt &);
+    static BigInt gcd(const BigInt &, const BigInt &);
+    static BigInt pow(const BigInt &, unsigned);
+
+private:
+    typedef std::vector<uint32_t> Limbs;
+    bool negative;
+    Limbs mag;
+
+    void trim();
+    static int compareMag(const Limbs &, const Limbs &);
+    static Limbs addMag(const Limbs &, const Limbs &);
+    static Limbs subMag(const Limbs &, const Limbs &);
+    static Limbs mulMag(const Limbs &, const Limbs &);
+    static Limbs karatsuba(const Limbs &, const Limbs &);
+    static void divmodMag(const Limbs &, const Limbs &, Limbs &, Limbs &);
+    static uint32_t divmodSmall(Limbs &, uint32_t);
+};
+
+#endif // BIGINT_HPP
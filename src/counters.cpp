@@ -0,0 +1,48 @@
+/**
+ * @file counters.cpp
+ * @brief Storage and reporting of the runtime counters
+ */
+
+#include "counters.hpp"
+
+thread_local RuntimeCounters runtime_counters;
+
+std::vector<std::pair<std::string, uint64_t>> runtimeCounterFields() {
+    std::vector<std::pair<std::string, uint64_t>> fields;
+#ifdef RUNTIME_COUNTERS
+    // fixnums, booleans, () and void are absent: they live in the handle,
+    // and their only objects are the static headers behind the immediates
+    static const std::pair<ValueType, const char *> types[] = {
+        {V_BIGINT, "alloc-bigint"},       {V_RATIONAL, "alloc-rational"},
+        {V_SYM, "alloc-symbol"},          {V_STRING, "alloc-string"},
+        {V_PAIR, "alloc-pair"},           {V_VECTOR, "alloc-vector"},
+        {V_HASHTABLE, "alloc-hash-table"}, {V_PROMISE, "alloc-promise"},
+        {V_PROC, "alloc-procedure"},      {V_PRIMITIVE, "alloc-primitive"},
+        {V_TERMINATE, "alloc-terminate"}
+    };
+    const RuntimeCounters &c = runtime_counters;
+    for (const auto &type : types) {
+        fields.push_back({type.second, c.allocations[type.first]});
+    }
+    fields.push_back({"frames", c.frames});
+    fields.push_back({"local-frames", c.local_frames});
+    fields.push_back({"frame-lookups", c.frame_lookups});
+    fields.push_back({"frame-hops", c.frame_hops});
+    fields.push_back({"global-lookups", c.global_lookups});
+    fields.push_back({"closures", c.closures});
+    fields.push_back({"max-depth", c.max_depth});
+#endif
+    return fields;
+}
+
+void reportRuntimeCounters(std::ostream &os) {
+    std::vector<std::pair<std::string, uint64_t>> fields = runtimeCounterFields();
+    if (fields.empty()) {
+        return;
+    }
+    os << "runtime";
+    for (const auto &field : fields) {
+        os << ' ' << field.first << '=' << field.second;
+    }
+    os << '\n';
+}
@@ -0,0 +1,71 @@
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+/**
+ * @file counters.hpp
+ * @brief Interpreter-internal event counters
+ *
+ * Counts values allocated per type, frames made or lent out, variable
+ * lookups and the frame links they walk, closures created and the deepest
+ * nesting of non-tail procedure calls. The counting sites are macros that
+ * compile to nothing unless the build defines RUNTIME_COUNTERS (the CMake
+ * option of the same name), so a normal build pays nothing for them.
+ *
+ * Counters are per thread. `(runtime-stats)` returns them as an
+ * association list, and `(exit)` prints them on stderr.
+ */
+
+#include "Def.hpp"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct RuntimeCounters {
+    uint64_t allocations[V_TERMINATE + 1]; ///< Heap values created, by ValueType
+    uint64_t frames;                       ///< Frames made for calls, let and letrec
+    uint64_t local_frames;                 ///< Frames lent by LocalFrame instead
+    uint64_t frame_lookups;                ///< Variable accesses that walked the frame chain
+    uint64_t frame_hops;                   ///< Parent links followed by those walks
+    uint64_t global_lookups;               ///< Reads of toplevel bindings
+    uint64_t closures;                     ///< Procedures created by lambda
+    uint64_t depth;                        ///< Non-tail procedure calls in progress
+    uint64_t max_depth;                    ///< Deepest depth reached
+};
+
+extern thread_local RuntimeCounters runtime_counters;
+
+#ifdef RUNTIME_COUNTERS
+#define COUNT(field) (++runtime_counters.field)
+#define COUNT_N(field, n) (runtime_counters.field += (n))
+#define COUNT_ENTER()                                                   \
+    (void)(++runtime_counters.depth > runtime_counters.max_depth        \
+               ? runtime_counters.max_depth = runtime_counters.depth : 0)
+#define COUNT_LEAVE() (--runtime_counters.depth)
+/// Counts one call level for the rest of the enclosing C++ scope
+#define COUNT_CALL() CountedCall counted_call_
+
+struct CountedCall {
+    CountedCall() { COUNT_ENTER(); }
+    ~CountedCall() { COUNT_LEAVE(); }
+};
+#else
+#define COUNT(field) ((void)0)
+#define COUNT_N(field, n) ((void)0)
+#define COUNT_ENTER() ((void)0)
+#define COUNT_LEAVE() ((void)0)
+#define COUNT_CALL() ((void)0)
+#endif
+
+/**
+ * @brief The counters by name, in a fixed order; empty when compiled out
+ */
+std::vector<std::pair<std::string, uint64_t>> runtimeCounterFields();
+
+/**
+ * @brief Print the counters as one `name=value` list; nothing when compiled out
+ */
+void reportRuntimeCounters(std::ostream &);
+
+#endif // COUNTERS_HPP
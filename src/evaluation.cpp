@@ -13,51 +13,56 @@
 #include "RE.hpp"
 #include "syntax.hpp"
 #include "utils.hpp"
+#include "profile.hpp"
+#include "counters.hpp"
+#include "printer.hpp"
+#include <algorithm>
 #include <cstring>
 #include <vector>
 #include <map>
 #include <climits>
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
 
-Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
-    return IntegerV(n);
+Value Fixnum::eval(Env &e) { // evaluation of a fixnum
+    return datum;
 }
 
-Value RationalNum::eval(Assoc &e) { // evaluation of a rational number
-    return RationalV(numerator, denominator);
+Value RationalNum::eval(Env &e) { // evaluation of a rational number
+    return datum;
 }
 
-Value StringExpr::eval(Assoc &e) { // evaluation of a string
-    return StringV(s);
+Value StringExpr::eval(Env &e) { // evaluation of a string
+    return datum;
 }
 
-Value True::eval(Assoc &e) { // evaluation of #t
-    return BooleanV(true);
+Value True::eval(Env &e) { // evaluation of #t
+    return datum;
 }
 
-Value False::eval(Assoc &e) { // evaluation of #f
-    return BooleanV(false);
+Value False::eval(Env &e) { // evaluation of #f
+    return datum;
 }
 
-Value MakeVoid::eval(Assoc &e) { // (void)
+Value MakeVoid::eval(Env &e) { // (void)
     return VoidV();
 }
 
-Value Exit::eval(Assoc &e) { // (exit)
+Value Exit::eval(Env &e) { // (exit)
+    reportRuntimeCounters(std::cerr);
     return TerminateV();
 }
 
-Value Unary::eval(Assoc &e) { // evaluation of single-operator primitive
+Value Unary::eval(Env &e) { // evaluation of single-operator primitive
     return evalRator(rand->eval(e));
 }
 
-Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
+Value Binary::eval(Env &e) { // evaluation of two-operators primitive
     return evalRator(rand1->eval(e), rand2->eval(e));
 }
 
-Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
+Value Variadic::eval(Env &e) { // evaluation of multi-operator primitive
     std::vector<Value> eval_list;
     for (auto rand : rands) {
         eval_list.push_back(rand->eval(e));
@@ -65,315 +70,339 @@ Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
     return evalRator(eval_list);
 }
 
-Value Var::eval(Assoc &e) { // evaluation of variable
-    Value matched_value = find(x, e);
+Value Var::eval(Env &e) { // evaluation of variable
+    Frame *f = nthFrame(e, depth);
+    Value matched_value = index >= 0 ? f->slots[index] : find(x, f->globals);
     if (matched_value.get() == nullptr) {
-        if (primitives.count(x)) {
-                static std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
-                    {E_VOID,     {new MakeVoid(), {}}},
-                    {E_EXIT,     {new Exit(), {}}},
-                    {E_BOOLQ,    {new IsBoolean(new Var("parm")), {"parm"}}},
-                    {E_INTQ,     {new IsFixnum(new Var("parm")), {"parm"}}},
-                    {E_NULLQ,    {new IsNull(new Var("parm")), {"parm"}}},
-                    {E_PAIRQ,    {new IsPair(new Var("parm")), {"parm"}}},
-                    {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
-                    {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
-                    {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
-                    {E_LISTQ,    {new IsList(new Var("parm")), {"parm"}}},
-                    {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
-                    {E_PLUS,     {new PlusVar({}),  {}}},
-                    {E_MINUS,    {new MinusVar({}), {}}},
-                    {E_MUL,      {new MultVar({}),  {}}},
-                    {E_DIV,      {new DivVar({}),   {}}},
-                    {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_LT,       {new LessVar({}),      {}}},
-                    {E_LE,       {new LessEqVar({}),    {}}},
-                    {E_EQ,       {new EqualVar({}),     {}}},
-                    {E_GE,       {new GreaterEqVar({}), {}}},
-                    {E_GT,       {new GreaterVar({}),   {}}},
-                    {E_EQQ,      {new EqualVar({}), {}}},
-                    {E_CONS,     {new Cons(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_CAR,      {new Car(new Var("parm")), {"parm"}}},
-                    {E_CDR,      {new Cdr(new Var("parm")), {"parm"}}},
-                    {E_LIST,     {new ListFunc({}), {}}},
-                    {E_SETCAR,   {new SetCar(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_SETCDR,   {new SetCdr(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_NOT,      {new Not(new Var("parm")), {"parm"}}},
-                    {E_AND,      {new AndVar({}), {}}},
-                    {E_OR,       {new OrVar({}), {}}}
-                };
-
-            auto it = primitive_map.find(primitives[x]);
-            if (it != primitive_map.end()) {
-                return ProcedureV(it->second.second, it->second.first, e);
-            }
-      }
-      throw RuntimeError("undefined variable: " + x);
+        // an unassigned binding of a builtin's name still yields the builtin
+        Value builtin = lookupPrimitive(x);
+        if (builtin.get() != nullptr) {
+            return builtin;
+        }
+        throw RuntimeError("undefined variable: " + symbolName(x));
     }
     return matched_value;
 }
 
+// ============================================================================
+// Exact arithmetic
+// ============================================================================
+
+// Fixnum operands take the inline path and only fall back to bignums when
+// the checked builtin reports an overflow. Mixed operands go through
+// BigInt fractions, and results are demoted again by IntegerV/exactV.
+
+static bool isExactInteger(const Value &v) {
+    return v->v_type == V_INT || v->v_type == V_BIGINT;
+}
+
+static BigInt toBigInt(const Value &v) {
+    if (v.isFixnum()) {
+        return BigInt(v.fixnum());
+    }
+    return static_cast<BigInteger*>(v.get())->n;
+}
+
 // helper function
-auto toRational(const Value& v) -> std::pair<NumericType, NumericType> {
-    if (v->v_type == V_INT) {
-        NumericType n = dynamic_cast<Integer*>(v.get())->n;
-        return {n, 1};
+static std::pair<BigInt, BigInt> toRational(const Value& v) {
+    if (isExactInteger(v)) {
+        return {toBigInt(v), BigInt(1)};
     } else if (v->v_type == V_RATIONAL) {
-        Rational* r = dynamic_cast<Rational*>(v.get());
+        Rational* r = static_cast<Rational*>(v.get());
         return {r->numerator, r->denominator};
     }
     throw RuntimeError("+ is only defined for numbers");
 }
 
-Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
-    auto [num1, den1] = toRational(rand1);
-    auto [num2, den2] = toRational(rand2);
-
-    NumericType res_num = (num1 * den2 + num2 * den1) / util::gcd(den1, den2);
-    NumericType res_den = util::lcm(den1, den2);
+// num/den in lowest terms, as an integer when the denominator divides out
+static Value exactV(const BigInt &num, const BigInt &den) {
+    if (den.isOne()) {
+        return IntegerV(num);
+    }
+    Value r = RationalV(num, den);
+    Rational *q = static_cast<Rational*>(r.get());
+    if (q->denominator.isOne()) {
+        return IntegerV(q->numerator);
+    }
+    return r;
+}
 
-    if (res_den == 1) {
-        return IntegerV(res_num);
+static Value addNumbers(const Value &rand1, const Value &rand2) {
+    NumericType res;
+    if (rand1.isFixnum() && rand2.isFixnum() &&
+        !__builtin_add_overflow(rand1.fixnum(), rand2.fixnum(), &res)) {
+        return IntegerV(res);
+    }
+    if (isExactInteger(rand1) && isExactInteger(rand2)) {
+        return IntegerV(toBigInt(rand1) + toBigInt(rand2));
     }
-    return RationalV(res_num, res_den);
+    auto x = toRational(rand1);
+    auto y = toRational(rand2);
+    return exactV(x.first * y.second + y.first * x.second, x.second * y.second);
 }
 
-Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
-    auto [num1, den1] = toRational(rand1);
-    auto [num2, den2] = toRational(rand2);
+static Value subNumbers(const Value &rand1, const Value &rand2) {
+    NumericType res;
+    if (rand1.isFixnum() && rand2.isFixnum() &&
+        !__builtin_sub_overflow(rand1.fixnum(), rand2.fixnum(), &res)) {
+        return IntegerV(res);
+    }
+    if (isExactInteger(rand1) && isExactInteger(rand2)) {
+        return IntegerV(toBigInt(rand1) - toBigInt(rand2));
+    }
+    auto x = toRational(rand1);
+    auto y = toRational(rand2);
+    return exactV(x.first * y.second - y.first * x.second, x.second * y.second);
+}
 
-    NumericType res_num = (num1 * den2 - num2 * den1) / util::gcd(den1, den2);
-    NumericType res_den = util::lcm(den1, den2);
+static Value mulNumbers(const Value &rand1, const Value &rand2) {
+    NumericType res;
+    if (rand1.isFixnum() && rand2.isFixnum() &&
+        !__builtin_mul_overflow(rand1.fixnum(), rand2.fixnum(), &res)) {
+        return IntegerV(res);
+    }
+    if (isExactInteger(rand1) && isExactInteger(rand2)) {
+        return IntegerV(toBigInt(rand1) * toBigInt(rand2));
+    }
+    auto x = toRational(rand1);
+    auto y = toRational(rand2);
+    return exactV(x.first * y.first, x.second * y.second);
+}
 
-    if (res_den == 1) {
-        return IntegerV(res_num);
+static Value divNumbers(const Value &rand1, const Value &rand2) {
+    auto x = toRational(rand1);
+    auto y = toRational(rand2);
+    if (y.first.isZero()) {
+        throw RuntimeError("Division by zero");
     }
-    return RationalV(res_num, res_den);
+    return exactV(x.first * y.second, x.second * y.first);
 }
 
-Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
-    auto [num1, den1] = toRational(rand1);
-    auto [num2, den2] = toRational(rand2);
+Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
+    return addNumbers(rand1, rand2);
+}
 
-    NumericType res_num = num1 * num2;
-    NumericType res_den = den1 * den2;
-    util::normalize_rational(res_num, res_den);
+Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
+    return subNumbers(rand1, rand2);
+}
 
-    if (res_den == 1) {
-        return IntegerV(res_num);
-    }
-    return RationalV(res_num, res_den);
+Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
+    return mulNumbers(rand1, rand2);
 }
 
 Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
-    auto [num1, den1] = toRational(rand1);
-    auto [num2, den2] = toRational(rand2);
+    return divNumbers(rand1, rand2);
+}
 
-    if (num2 == 0) {
-        throw RuntimeError("Division by zero");
+Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
+    if (rand1.isFixnum() && rand2.isFixnum()) {
+        int dividend = rand1.fixnum();
+        int divisor = rand2.fixnum();
+        if (divisor == 0) {
+            throw(RuntimeError("Division by zero"));
+        }
+        // INT_MIN % -1 traps on most targets
+        return IntegerV(divisor == -1 ? 0 : dividend % divisor);
+    }
+    if (isExactInteger(rand1) && isExactInteger(rand2)) {
+        BigInt divisor = toBigInt(rand2);
+        if (divisor.isZero()) {
+            throw(RuntimeError("Division by zero"));
+        }
+        BigInt quotient, remainder;
+        BigInt::divmod(toBigInt(rand1), divisor, quotient, remainder);
+        return IntegerV(remainder);
     }
+    throw(RuntimeError("modulo is only defined for integers"));
+}
+
+// ============================================================================
+// Fixnum reductions
+// ============================================================================
 
-    NumericType res_num = num1 * den2;
-    NumericType res_den = den1 * num2;
-    util::normalize_rational(res_num, res_den);
+// the handles of the values being folded, gathered into one contiguous run
+static thread_local std::vector<uintptr_t> fixnum_words;
 
-    if (res_den == 1) {
-        return IntegerV(res_num);
+static Value integerOf(int64_t n) {
+    if (n >= INT_MIN && n <= INT_MAX) {
+        return IntegerV((NumericType)n);
     }
-    return RationalV(res_num, res_den);
+    return IntegerV(BigInt((long long)n));
 }
 
-Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int dividend = dynamic_cast<Integer*>(rand1.get())->n;
-        int divisor = dynamic_cast<Integer*>(rand2.get())->n;
-        if (divisor == 0) {
-            throw(RuntimeError("Division by zero"));
+/**
+ * Sum of the gathered words if every one is a fixnum. Tags and payloads
+ * are accumulated in a single branch-free pass, which the compiler
+ * vectorizes; fixnum payloads cannot overflow the 64-bit total, and the
+ * payloads of other values are only added up to be thrown away, so the
+ * total wraps as unsigned.
+ */
+static bool sumFixnums(const std::vector<uintptr_t> &words, Value &result) {
+    uintptr_t tags = Value::FIXNUM_TAG;
+    uint64_t total = 0;
+    for (uintptr_t w : words) {
+        tags &= w;
+        total += static_cast<uint64_t>(static_cast<intptr_t>(w) >> 1);
+    }
+    if ((tags & Value::FIXNUM_TAG) == 0) {
+        return false;
+    }
+    result = integerOf(static_cast<int64_t>(total));
+    return true;
+}
+
+// product of the gathered words if every one is a fixnum and it stays
+// within 64 bits; anything else is left to mulNumbers
+static bool productFixnums(const std::vector<uintptr_t> &words, Value &result) {
+    int64_t product = 1;
+    for (uintptr_t w : words) {
+        if ((w & Value::FIXNUM_TAG) == 0 ||
+            __builtin_mul_overflow(product, static_cast<int64_t>(static_cast<intptr_t>(w) >> 1), &product)) {
+            return false;
         }
-        return IntegerV(dividend % divisor);
     }
-    throw(RuntimeError("modulo is only defined for integers"));
+    result = integerOf(product);
+    return true;
+}
+
+static std::vector<uintptr_t> &gatherWords(const std::vector<Value> &args) {
+    std::vector<uintptr_t> &words = fixnum_words;
+    words.clear();
+    for (const Value &arg : args) {
+        words.push_back(arg.bits);
+    }
+    return words;
+}
+
+// appends the elements of a proper list; false for anything else
+static bool gatherList(const Value &list, std::vector<uintptr_t> &words) {
+    const Value *cur = &list;
+    while ((*cur)->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(cur->get());
+        words.push_back(p->car.bits);
+        cur = &p->cdr;
+    }
+    return (*cur)->v_type == V_NULL;
 }
 
 Value PlusVar::evalRator(const std::vector<Value> &args) { // + with multiple args
-    if (args.empty()) {
-        return IntegerV(0);
+    Value res = IntegerV(0);
+    if (sumFixnums(gatherWords(args), res)) {
+        return res;
     }
-    NumericType res_num = 0;
-    NumericType res_den = 1;
     for (const auto& arg : args) {
-        auto [cur_num, cur_den] = toRational(arg);
-        NumericType com_lcm = util::lcm(res_den, static_cast<NumericType>(cur_den));
-        res_num = res_num * (com_lcm / res_den) + cur_num * (com_lcm / cur_den);
-        res_den = com_lcm;
-        util::normalize_rational(res_num, res_den);
-    }
-    if (res_den == 1) {
-        return IntegerV(res_num);
+        res = addNumbers(res, arg);
     }
-    return RationalV(res_num, res_den);
+    return res;
 }
 
 Value MinusVar::evalRator(const std::vector<Value> &args) { // - with multiple args
     if (args.empty()) {
         throw RuntimeError("Minus expression expects at least one argument.");
     }
-    NumericType res_num;
-    NumericType res_den;
     if (args.size() == 1) {
         // (- x) => -x
-        auto [num, den] = toRational(args[0]);
-        res_num = -num;
-        res_den = den;
-    } else {
-        // x - y - z ...
-        auto [num0, den0] = toRational(args[0]);
-        res_num = num0;
-        res_den = den0;
-        for (size_t i = 1; i < args.size(); ++i) {
-            auto [cur_num, cur_den] = toRational(args[i]);
-            NumericType com_lcm = util::lcm(res_den, cur_den);
-            res_num = res_num * (com_lcm / res_den) - cur_num * (com_lcm / cur_den);
-            res_den = com_lcm;
-            util::normalize_rational(res_num, res_den);
-        }
+        return subNumbers(IntegerV(0), args[0]);
     }
-    util::normalize_rational(res_num, res_den);
-    if (res_den == 1) {
-        return IntegerV(res_num);
+    // x - y - z ...
+    Value res = args[0];
+    for (size_t i = 1; i < args.size(); ++i) {
+        res = subNumbers(res, args[i]);
     }
-    return RationalV(res_num, res_den);
+    return res;
 }
 
 Value MultVar::evalRator(const std::vector<Value> &args) { // * with multiple args
-    if (args.empty()) {
-        return IntegerV(1);
+    Value res = IntegerV(1);
+    if (productFixnums(gatherWords(args), res)) {
+        return res;
     }
-    NumericType res_num = 1;
-    NumericType res_den = 1;
     for (const auto& arg : args) {
-        auto [cur_num, cur_den] = toRational(arg);
-        res_num *= cur_num;
-        res_den *= cur_den;
-        util::normalize_rational(res_num, res_den);
-    }
-    if (res_den == 1) {
-        return IntegerV(res_num);
+        res = mulNumbers(res, arg);
     }
-    return RationalV(res_num, res_den);
+    return res;
 }
 
 Value DivVar::evalRator(const std::vector<Value> &args) { // / with multiple args
     if (args.empty()) {
         throw RuntimeError("Division expression expects at least one argument.");
     }
-    NumericType res_num;
-    NumericType res_den;
     if (args.size() == 1) {
         // (/ x) => 1 / x
-        auto [num, den] = toRational(args[0]);
-        if (num == 0) {
-            throw RuntimeError("Division by zero");
-        }
-        res_num = den;
-        res_den = num;
-    } else {
-        // x / y / z ...
-        auto [num0, den0] = toRational(args[0]);
-        res_num = num0;
-        res_den = den0;
-        for (size_t i = 1; i < args.size(); ++i) {
-            auto [cur_num, cur_den] = toRational(args[i]);
-            if (cur_num == 0) {
-                throw RuntimeError("Division by zero");
-            }
-            res_num *= cur_den;
-            res_den *= cur_num;
-            util::normalize_rational(res_num, res_den);
-        }
+        return divNumbers(IntegerV(1), args[0]);
     }
-    util::normalize_rational(res_num, res_den);
-    if (res_den == 1) {
-        return IntegerV(res_num);
+    // x / y / z ...
+    Value res = args[0];
+    for (size_t i = 1; i < args.size(); ++i) {
+        res = divNumbers(res, args[i]);
     }
-    return RationalV(res_num, res_den);
+    return res;
 }
 
 Value Expt::evalRator(const Value &rand1, const Value &rand2) { // expt
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int base = dynamic_cast<Integer*>(rand1.get())->n;
-        int exponent = dynamic_cast<Integer*>(rand2.get())->n;
-        
-        if (exponent < 0) {
+    if (isExactInteger(rand1) && isExactInteger(rand2)) {
+        BigInt exponent = toBigInt(rand2);
+        if (exponent.isNegative()) {
             throw(RuntimeError("Negative exponent not supported for integers"));
         }
-        if (base == 0 && exponent == 0) {
+        BigInt base = toBigInt(rand1);
+        if (base.isZero() && exponent.isZero()) {
             throw(RuntimeError("0^0 is undefined"));
         }
-        
-        long long result = 1;
-        long long b = base;
-        int exp = exponent;
-        
-        while (exp > 0) {
-            if (exp % 2 == 1) {
-                result *= b;
-                if (result > INT_MAX || result < INT_MIN) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
+        // only 0, 1 and -1 can be raised to a power beyond the fixnum range
+        if (!exponent.fitsInt()) {
+            if (base.isZero() || base.isOne()) {
+                return IntegerV(base);
             }
-            b *= b;
-            if (b > INT_MAX || b < INT_MIN) {
-                if (exp > 1) {
-                    throw(RuntimeError("Integer overflow in expt"));
+            if (base.abs().isOne()) {
+                BigInt q, r;
+                BigInt::divmod(exponent, BigInt(2), q, r);
+                return IntegerV(r.isZero() ? 1 : -1);
+            }
+            throw(RuntimeError("Integer overflow in expt"));
+        }
+        unsigned exp = (unsigned)exponent.toInt();
+
+        // fast path: square-and-multiply while everything stays a fixnum
+        if (rand1.isFixnum()) {
+            NumericType result = 1, b = rand1.fixnum();
+            unsigned e = exp;
+            bool overflow = false;
+            while (e > 0 && !overflow) {
+                if (e & 1) {
+                    overflow = __builtin_mul_overflow(result, b, &result);
+                }
+                e >>= 1;
+                if (e > 0 && !overflow) {
+                    overflow = __builtin_mul_overflow(b, b, &b);
                 }
             }
-            exp /= 2;
+            if (!overflow) {
+                return IntegerV(result);
+            }
         }
-        
-        return IntegerV((int)result);
+        return IntegerV(BigInt::pow(base, exp));
     }
     throw(RuntimeError("Wrong typename"));
 }
 
 //A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
 int compareNumericValues(const Value &v1, const Value &v2) {
-    #define NumericType long long
-    NumericType num1, den1;
-    NumericType num2, den2;
-    if (v1->v_type == V_INT) {
-        num1 = dynamic_cast<Integer*>(v1.get())->n;
-        den1 = 1;
-    } else if (v1->v_type == V_RATIONAL) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        num1 = r1->numerator;
-        den1 = r1->denominator;
-    } else {
-        throw RuntimeError("Numeric comparison expects a number");
+    if (v1.isFixnum() && v2.isFixnum()) {
+        NumericType x = v1.fixnum(), y = v2.fixnum();
+        return x < y ? -1 : (x > y ? 1 : 0);
     }
-    if (v2->v_type == V_INT) {
-        num2 = dynamic_cast<Integer*>(v2.get())->n;
-        den2 = 1;
-    } else if (v2->v_type == V_RATIONAL) {
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        num2 = r2->numerator;
-        den2 = r2->denominator;
-    } else {
-        throw RuntimeError("Numeric comparison expects a number");
+    if (isExactInteger(v1) && isExactInteger(v2)) {
+        return toBigInt(v1).compare(toBigInt(v2));
     }
-    #undef NumericType
-    #define NumericType long long
-    NumericType left_product = num1 * den2;
-    NumericType right_product = num2 * den1;
-    #undef NumericType
-    if (left_product < right_product) {
-        return -1; // v1 < v2
-    } else if (left_product > right_product) {
-        return 1; // v1 > v2
-    } else {
-        return 0; // v1 == v2
+    if ((!isExactInteger(v1) && v1->v_type != V_RATIONAL) ||
+        (!isExactInteger(v2) && v2->v_type != V_RATIONAL)) {
+        throw RuntimeError("Numeric comparison expects a number");
     }
+    // denominators are positive, so cross-multiplying keeps the order
+    auto x = toRational(v1);
+    auto y = toRational(v2);
+    return (x.first * y.second).compare(y.first * x.second);
 }
 
 Value Less::evalRator(const Value &rand1, const Value &rand2) { // <
@@ -461,6 +490,202 @@ Value GreaterVar::evalRator(const std::vector<Value> &args) { // > with multiple
     return BooleanV(true);
 }
 
+// ============================================================================
+// Fused fixnum paths
+// ============================================================================
+// Two-operand arithmetic and comparisons are parsed into FusedBinary nodes:
+// when both operands are fixnums the node's own eval computes the result
+// with a checked builtin, skipping the evalRator call and every BigInt
+// temporary. A fixnum literal operand is stored as a raw NumericType, so
+// (- n 1) and (< n 2) evaluate a single subexpression. The variadic forms
+// fold their operands as they are evaluated instead of collecting them.
+
+namespace {
+
+struct AddOp {
+    static bool apply(NumericType x, NumericType y, Value &res) {
+        NumericType r;
+        if (__builtin_add_overflow(x, y, &r)) return false;
+        res = IntegerV(r);
+        return true;
+    }
+};
+
+struct SubOp {
+    static bool apply(NumericType x, NumericType y, Value &res) {
+        NumericType r;
+        if (__builtin_sub_overflow(x, y, &r)) return false;
+        res = IntegerV(r);
+        return true;
+    }
+};
+
+struct MulOp {
+    static bool apply(NumericType x, NumericType y, Value &res) {
+        NumericType r;
+        if (__builtin_mul_overflow(x, y, &r)) return false;
+        res = IntegerV(r);
+        return true;
+    }
+};
+
+struct LtOp {
+    static bool apply(NumericType x, NumericType y, Value &res) { res = BooleanV(x < y); return true; }
+    static bool holds(int cmp) { return cmp < 0; }
+};
+
+struct LeOp {
+    static bool apply(NumericType x, NumericType y, Value &res) { res = BooleanV(x <= y); return true; }
+    static bool holds(int cmp) { return cmp <= 0; }
+};
+
+struct EqOp {
+    static bool apply(NumericType x, NumericType y, Value &res) { res = BooleanV(x == y); return true; }
+    static bool holds(int cmp) { return cmp == 0; }
+};
+
+struct GeOp {
+    static bool apply(NumericType x, NumericType y, Value &res) { res = BooleanV(x >= y); return true; }
+    static bool holds(int cmp) { return cmp >= 0; }
+};
+
+struct GtOp {
+    static bool apply(NumericType x, NumericType y, Value &res) { res = BooleanV(x > y); return true; }
+    static bool holds(int cmp) { return cmp > 0; }
+};
+
+enum Literal { NO_LITERAL, LEFT_LITERAL, RIGHT_LITERAL };
+
+/**
+ * @brief Node with a fixnum x fixnum fast path in front of Node::evalRator
+ *
+ * With a LEFT_LITERAL or RIGHT_LITERAL operand, k holds its value and that
+ * operand's expression is only kept for the VM and images.
+ */
+template <class Node, class Op, Literal literal>
+struct FusedBinary : Node {
+    NumericType k;
+
+    FusedBinary(const Expr &rand1, const Expr &rand2, NumericType k) : Node(rand1, rand2), k(k) {}
+
+    virtual Value eval(Env &e) override {
+        Value res(nullptr);
+        if (literal == RIGHT_LITERAL) {
+            Value x = this->rand1->eval(e);
+            if (x.isFixnum() && Op::apply(x.fixnum(), k, res)) {
+                return res;
+            }
+            return Node::evalRator(x, IntegerV(k));
+        }
+        if (literal == LEFT_LITERAL) {
+            Value y = this->rand2->eval(e);
+            if (y.isFixnum() && Op::apply(k, y.fixnum(), res)) {
+                return res;
+            }
+            return Node::evalRator(IntegerV(k), y);
+        }
+        Value x = this->rand1->eval(e);
+        Value y = this->rand2->eval(e);
+        if (x.isFixnum() && y.isFixnum() && Op::apply(x.fixnum(), y.fixnum(), res)) {
+            return res;
+        }
+        return Node::evalRator(x, y);
+    }
+};
+
+// a fixnum literal's value, or false for any other operand
+bool fixnumLiteral(const Expr &e, NumericType &k) {
+    Fixnum *lit = exprAs<Fixnum>(e);
+    if (lit == nullptr || !lit->datum.isFixnum()) {
+        return false;
+    }
+    k = lit->datum.fixnum();
+    return true;
+}
+
+template <class Node, class Op>
+Expr fused(const Expr &rand1, const Expr &rand2) {
+    NumericType k;
+    if (fixnumLiteral(rand2, k)) {
+        return Expr(new FusedBinary<Node, Op, RIGHT_LITERAL>(rand1, rand2, k));
+    }
+    if (fixnumLiteral(rand1, k)) {
+        return Expr(new FusedBinary<Node, Op, LEFT_LITERAL>(rand1, rand2, k));
+    }
+    return Expr(new FusedBinary<Node, Op, NO_LITERAL>(rand1, rand2, 0));
+}
+
+// evaluates every operand, as a call would, but stops comparing at the
+// first pair that fails
+template <class Op>
+Value compareChain(const std::vector<Expr> &rands, Env &e, const char *arity_error) {
+    if (rands.size() < 2) {
+        throw RuntimeError(arity_error);
+    }
+    Value prev = rands[0]->eval(e);
+    bool holds = true;
+    for (size_t i = 1; i < rands.size(); ++i) {
+        Value next = rands[i]->eval(e);
+        if (holds) {
+            holds = Op::holds(compareNumericValues(prev, next));
+        }
+        prev = next;
+    }
+    return BooleanV(holds);
+}
+
+} // namespace
+
+Expr makeArithmetic(ExprType type, const Expr &rand1, const Expr &rand2) {
+    switch (type) {
+        case E_PLUS:  return fused<Plus, AddOp>(rand1, rand2);
+        case E_MINUS: return fused<Minus, SubOp>(rand1, rand2);
+        case E_MUL:   return fused<Mult, MulOp>(rand1, rand2);
+        case E_LT:    return fused<Less, LtOp>(rand1, rand2);
+        case E_LE:    return fused<LessEq, LeOp>(rand1, rand2);
+        case E_EQ:    return fused<Equal, EqOp>(rand1, rand2);
+        case E_GE:    return fused<GreaterEq, GeOp>(rand1, rand2);
+        case E_GT:    return fused<Greater, GtOp>(rand1, rand2);
+        default:      throw RuntimeError("makeArithmetic: not an arithmetic operator");
+    }
+}
+
+Value PlusVar::eval(Env &e) {
+    Value res = IntegerV(0);
+    for (const Expr &rand : rands) {
+        res = addNumbers(res, rand->eval(e));
+    }
+    return res;
+}
+
+Value MinusVar::eval(Env &e) {
+    if (rands.empty()) {
+        throw RuntimeError("Minus expression expects at least one argument.");
+    }
+    if (rands.size() == 1) {
+        return subNumbers(IntegerV(0), rands[0]->eval(e));
+    }
+    Value res = rands[0]->eval(e);
+    for (size_t i = 1; i < rands.size(); ++i) {
+        res = subNumbers(res, rands[i]->eval(e));
+    }
+    return res;
+}
+
+Value MultVar::eval(Env &e) {
+    Value res = IntegerV(1);
+    for (const Expr &rand : rands) {
+        res = mulNumbers(res, rand->eval(e));
+    }
+    return res;
+}
+
+Value LessVar::eval(Env &e) { return compareChain<LtOp>(rands, e, "'< ' expects at least two arguments"); }
+Value LessEqVar::eval(Env &e) { return compareChain<LeOp>(rands, e, "'<=' expects at least two arguments"); }
+Value EqualVar::eval(Env &e) { return compareChain<EqOp>(rands, e, "'= ' expects at least two arguments"); }
+Value GreaterEqVar::eval(Env &e) { return compareChain<GeOp>(rands, e, "'>=' expects at least two arguments"); }
+Value GreaterVar::eval(Env &e) { return compareChain<GtOp>(rands, e, "'> ' expects at least two arguments"); }
+
 Value Cons::evalRator(const Value &rand1, const Value &rand2) { // cons
     return PairV(rand1, rand2);
 }
@@ -479,7 +704,7 @@ Value IsList::evalRator(const Value &rand) { // list?
         if (cur->v_type == V_NULL) {
             return BooleanV(true);
         } else if (cur->v_type == V_PAIR) {
-            auto p = dynamic_cast<Pair*>(cur.get());
+            auto p = static_cast<Pair*>(cur.get());
             cur = p->cdr;
         } else {
             return BooleanV(false);
@@ -492,7 +717,7 @@ Value Car::evalRator(const Value &rand) { // car
     if (rand->v_type != V_PAIR) {
         throw RuntimeError("expects argument to be a pair");
     }
-    auto p = dynamic_cast<Pair*>(rand.get());
+    auto p = static_cast<Pair*>(rand.get());
     return p->car;
 }
 
@@ -500,7 +725,7 @@ Value Cdr::evalRator(const Value &rand) { // cdr
     if (rand->v_type != V_PAIR) {
         throw RuntimeError("expects argument to be a pair");
     }
-    auto p = dynamic_cast<Pair*>(rand.get());
+    auto p = static_cast<Pair*>(rand.get());
     return p->cdr;
 }
 
@@ -508,8 +733,9 @@ Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
     if (rand1->v_type != V_PAIR) {
         throw RuntimeError("set-car!: expects argument to be a pair");
     }
-    auto p = dynamic_cast<Pair*>(rand1.get());
+    auto p = static_cast<Pair*>(rand1.get());
     p->car = rand2;
+    noteMutation();
     return VoidV();
 }
 
@@ -517,23 +743,270 @@ Value SetCdr::evalRator(const Value &rand1, const Value &rand2) { // set-cdr!
    if (rand1->v_type != V_PAIR) {
         throw RuntimeError("set-cdr!: expects argument to be a pair");
     }
-    auto p = dynamic_cast<Pair*>(rand1.get());
+    auto p = static_cast<Pair*>(rand1.get());
     p->cdr = rand2;
+    noteMutation();
+    return VoidV();
+}
+
+Value Length::evalRator(const Value &rand) { // length
+    NumericType n = 0;
+    const Value *cur = &rand;
+    while ((*cur)->v_type == V_PAIR) {
+        ++n;
+        cur = &static_cast<Pair*>(cur->get())->cdr;
+    }
+    if ((*cur)->v_type != V_NULL) {
+        throw RuntimeError("length: expects argument to be a list");
+    }
+    return IntegerV(n);
+}
+
+Value Reverse::evalRator(const Value &rand) { // reverse
+    Value res = NullV();
+    const Value *cur = &rand;
+    while ((*cur)->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(cur->get());
+        res = PairV(p->car, res);
+        cur = &p->cdr;
+    }
+    if ((*cur)->v_type != V_NULL) {
+        throw RuntimeError("reverse: expects argument to be a list");
+    }
+    return res;
+}
+
+/**
+ * @brief Builds a list front to back
+ *
+ * Each new cell is linked onto the cdr of the previous one, which nothing
+ * else can see yet, so the list comes out in order in one pass.
+ */
+struct ListBuilder {
+    Value head = NullV();
+    Pair *last = nullptr;
+
+    void push(const Value &v) {
+        Value cell = PairV(v, NullV());
+        Pair *p = static_cast<Pair*>(cell.get());
+        if (last == nullptr) {
+            head = std::move(cell);
+        } else {
+            last->cdr = std::move(cell);
+        }
+        last = p;
+    }
+    Value finish(const Value &tail) {
+        if (last == nullptr) {
+            return tail;
+        }
+        last->cdr = tail;
+        return head;
+    }
+};
+
+Value Append::evalRator(const std::vector<Value> &args) { // append
+    if (args.empty()) {
+        return NullV();
+    }
+    ListBuilder out;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        const Value *cur = &args[i];
+        while ((*cur)->v_type == V_PAIR) {
+            Pair *p = static_cast<Pair*>(cur->get());
+            out.push(p->car);
+            cur = &p->cdr;
+        }
+        if ((*cur)->v_type != V_NULL) {
+            throw RuntimeError("append: expects arguments to be lists");
+        }
+    }
+    return out.finish(args.back());
+}
+
+// index operand of vector-ref and vector-set!, checked against the length
+static size_t vectorIndex(Vector *v, const Value &k, const char *who) {
+    if (!k.isFixnum() || k.fixnum() < 0 || (size_t)k.fixnum() >= v->items.size()) {
+        throw RuntimeError(std::string(who) + ": index out of range");
+    }
+    return (size_t)k.fixnum();
+}
+
+Value MakeVector::evalRator(const std::vector<Value> &args) { // make-vector
+    if (!args[0].isFixnum() || args[0].fixnum() < 0) {
+        throw RuntimeError("make-vector: expects a non-negative integer");
+    }
+    return VectorV((size_t)args[0].fixnum(), args.size() > 1 ? args[1] : IntegerV(0));
+}
+
+Value VectorFunc::evalRator(const std::vector<Value> &args) { // vector
+    return VectorV(args.data(), args.size());
+}
+
+Value VectorRef::evalRator(const Value &rand1, const Value &rand2) { // vector-ref
+    Vector *v = valueAs<Vector>(rand1);
+    if (v == nullptr) {
+        throw RuntimeError("vector-ref: expects argument to be a vector");
+    }
+    return v->items[vectorIndex(v, rand2, "vector-ref")];
+}
+
+Value VectorSet::evalRator(const std::vector<Value> &args) { // vector-set!
+    Vector *v = valueAs<Vector>(args[0]);
+    if (v == nullptr) {
+        throw RuntimeError("vector-set!: expects argument to be a vector");
+    }
+    v->items[vectorIndex(v, args[1], "vector-set!")] = args[2];
+    noteMutation();
     return VoidV();
 }
 
+Value VectorLength::evalRator(const Value &rand) { // vector-length
+    Vector *v = valueAs<Vector>(rand);
+    if (v == nullptr) {
+        throw RuntimeError("vector-length: expects argument to be a vector");
+    }
+    return IntegerV((NumericType)v->items.size());
+}
+
+Value MakeHashTable::evalRator(const std::vector<Value> &/*args*/) { // make-hash-table
+    return HashTableV();
+}
+
+Value HashRef::evalRator(const std::vector<Value> &args) { // hash-ref
+    HashTable *table = valueAs<HashTable>(args[0]);
+    if (table == nullptr) {
+        throw RuntimeError("hash-ref: expects argument to be a hash table");
+    }
+    if (Value *v = table->lookup(args[1])) {
+        return *v;
+    }
+    if (args.size() < 3) {
+        throw RuntimeError("hash-ref: no value for key");
+    }
+    return args[2];
+}
+
+Value HashSet::evalRator(const std::vector<Value> &args) { // hash-set!
+    HashTable *table = valueAs<HashTable>(args[0]);
+    if (table == nullptr) {
+        throw RuntimeError("hash-set!: expects argument to be a hash table");
+    }
+    table->store(args[1], args[2]);
+    return VoidV();
+}
+
+Value HashCount::evalRator(const Value &rand) { // hash-count
+    HashTable *table = valueAs<HashTable>(rand);
+    if (table == nullptr) {
+        throw RuntimeError("hash-count: expects argument to be a hash table");
+    }
+    return IntegerV((NumericType)table->count);
+}
+
+// entries a memoized procedure keeps when memoize is given no capacity
+static const size_t DEFAULT_MEMO_CAPACITY = 1 << 16;
+
+Value Memoize::evalRator(const std::vector<Value> &args) { // memoize
+    if (args.empty() || args.size() > 2) {
+        throw RuntimeError("memoize: expects a procedure and an optional capacity");
+    }
+    Procedure *proc = valueAs<Procedure>(args[0]);
+    if (proc == nullptr) {
+        throw RuntimeError("memoize: expects a compound procedure");
+    }
+    size_t capacity = DEFAULT_MEMO_CAPACITY;
+    if (args.size() == 2) {
+        if (!args[1].isFixnum() || args[1].fixnum() <= 0) {
+            throw RuntimeError("memoize: capacity must be a positive integer");
+        }
+        capacity = (size_t)args[1].fixnum();
+    }
+    Value res = ProcedureV(proc->parameters, proc->e, proc->env, proc->frame_size, proc->name);
+    Procedure *memoized = static_cast<Procedure*>(res.get());
+    memoized->code = proc->code;
+    memoized->local_frame = proc->local_frame;
+    memoized->memo.reset(new MemoCache(capacity));
+    return res;
+}
+
+Value MemoStats::evalRator(const Value &rand) { // memo-stats
+    Procedure *proc = valueAs<Procedure>(rand);
+    if (proc == nullptr || !proc->memo) {
+        throw RuntimeError("memo-stats: expects a memoized procedure");
+    }
+    const MemoCache &memo = *proc->memo;
+    std::vector<std::pair<std::string, long long>> fields = {
+        {"hits", (long long)memo.hits},
+        {"misses", (long long)memo.misses},
+        {"entries", (long long)memo.entries.size()},
+        {"capacity", (long long)memo.capacity}
+    };
+    Value res = NullV();
+    for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+        res = PairV(PairV(SymbolV(it->first), IntegerV(BigInt(it->second))), res);
+    }
+    return res;
+}
+
+Value Delay::eval(Env &env) {
+    return PromiseV(e, env);
+}
+
+static Value force(const Value &v) {
+    Promise *promise = valueAs<Promise>(v);
+    if (promise == nullptr) {
+        return v;
+    }
+    if (!promise->forced()) {
+        // held here, since a force from inside the expression finishes first
+        // and drops them from the promise
+        Expr e = promise->e;
+        Env env = promise->env;
+        Value result = e->eval(env);
+        if (!promise->forced()) {
+            promise->value = result;
+            promise->e = Expr(nullptr);
+            promise->env = Env(nullptr);
+        }
+    }
+    return promise->value;
+}
+
+Value Force::evalRator(const Value &rand) { // force
+    return force(rand);
+}
+
+Value StreamCar::evalRator(const Value &rand) { // stream-car
+    if (rand->v_type != V_PAIR) {
+        throw RuntimeError("stream-car: expects argument to be a stream");
+    }
+    return static_cast<Pair*>(rand.get())->car;
+}
+
+Value StreamCdr::evalRator(const Value &rand) { // stream-cdr
+    if (rand->v_type != V_PAIR) {
+        throw RuntimeError("stream-cdr: expects argument to be a stream");
+    }
+    return force(static_cast<Pair*>(rand.get())->cdr);
+}
+
 Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
     // 检查类型是否为 Integer
     if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return BooleanV((dynamic_cast<Integer*>(rand1.get())->n) == (dynamic_cast<Integer*>(rand2.get())->n));
+        return BooleanV((rand1.fixnum()) == (rand2.fixnum()));
+    }
+    // 大整数按数值比较，与定长整数保持一致
+    else if (rand1->v_type == V_BIGINT && rand2->v_type == V_BIGINT) {
+        return BooleanV(toBigInt(rand1).compare(toBigInt(rand2)) == 0);
     }
     // 检查类型是否为 Boolean
     else if (rand1->v_type == V_BOOL && rand2->v_type == V_BOOL) {
-        return BooleanV((dynamic_cast<Boolean*>(rand1.get())->b) == (dynamic_cast<Boolean*>(rand2.get())->b));
+        return BooleanV(rand1.isTrue() == rand2.isTrue());
     }
-    // 检查类型是否为 Symbol
+    // 检查类型是否为 Symbol（符号已驻留，比较编号即可）
     else if (rand1->v_type == V_SYM && rand2->v_type == V_SYM) {
-        return BooleanV((dynamic_cast<Symbol*>(rand1.get())->s) == (dynamic_cast<Symbol*>(rand2.get())->s));
+        return BooleanV(static_cast<Symbol*>(rand1.get())->id == static_cast<Symbol*>(rand2.get())->id);
     }
     // 检查类型是否为 Null 或 Void
     else if ((rand1->v_type == V_NULL && rand2->v_type == V_NULL) ||
@@ -549,7 +1022,7 @@ Value IsBoolean::evalRator(const Value &rand) { // boolean?
 }
 
 Value IsFixnum::evalRator(const Value &rand) { // number?
-    return BooleanV(rand->v_type == V_INT);
+    return BooleanV(rand->v_type == V_INT || rand->v_type == V_BIGINT);
 }
 
 Value IsNull::evalRator(const Value &rand) { // null?
@@ -561,7 +1034,7 @@ Value IsPair::evalRator(const Value &rand) { // pair?
 }
 
 Value IsProcedure::evalRator(const Value &rand) { // procedure?
-    return BooleanV(rand->v_type == V_PROC);
+    return BooleanV(rand->v_type == V_PROC || rand->v_type == V_PRIMITIVE);
 }
 
 Value IsSymbol::evalRator(const Value &rand) { // symbol?
@@ -572,7 +1045,19 @@ Value IsString::evalRator(const Value &rand) { // string?
     return BooleanV(rand->v_type == V_STRING);
 }
 
-Value Begin::eval(Assoc &e) {
+Value IsVector::evalRator(const Value &rand) { // vector?
+    return BooleanV(rand->v_type == V_VECTOR);
+}
+
+Value IsHashTable::evalRator(const Value &rand) { // hash-table?
+    return BooleanV(rand->v_type == V_HASHTABLE);
+}
+
+Value IsPromise::evalRator(const Value &rand) { // promise?
+    return BooleanV(rand->v_type == V_PROMISE);
+}
+
+Value Begin::eval(Env &e) {
     if (es.empty()) {
         return VoidV();
     }
@@ -587,13 +1072,13 @@ Value Begin::eval(Assoc &e) {
 // helper function to convert Syntax to Value for quote
 Value convertSyntaxToValue(const Syntax& syntax) {
     if (auto num = dynamic_cast<Number*>(syntax.get())) {
-        return IntegerV(num->n);
+        return IntegerV(BigInt::parse(num->digits));
     } else if (auto rational = dynamic_cast<RationalSyntax*>(syntax.get())) {
-        return RationalV(rational->numerator, rational->denominator);
+        return RationalV(BigInt::parse(rational->numerator), BigInt::parse(rational->denominator));
     } else if (auto str = dynamic_cast<StringSyntax*>(syntax.get())) {
         return StringV(str->s);
     } else if (auto sym = dynamic_cast<SymbolSyntax*>(syntax.get())) {
-        return SymbolV(sym->s);
+        return SymbolV(sym->id);
     } else if (auto true_syntax = dynamic_cast<TrueSyntax*>(syntax.get())) {
         return BooleanV(true);
     } else if (auto false_syntax = dynamic_cast<FalseSyntax*>(syntax.get())) {
@@ -640,11 +1125,11 @@ Value convertSyntaxToValue(const Syntax& syntax) {
     throw RuntimeError("Unknown syntax type in quote");
 }
 
-Value Quote::eval(Assoc& e) {
-    return convertSyntaxToValue(s);
+Value Quote::eval(Env& e) {
+    return datum;
 }
 
-Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
+Value AndVar::eval(Env &e) { // and with short-circuit evaluation
     if (rands.empty()) {
         return BooleanV(true);
     }
@@ -662,14 +1147,14 @@ Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
     return last;
 }
 
-Value OrVar::eval(Assoc &e) { // or with short-circuit evaluation
+Value OrVar::eval(Env &e) { // or with short-circuit evaluation
     if (rands.empty()) {
         return BooleanV(false);
     }
     Value last = BooleanV(true);
     for (const auto& rand : rands) {
         Value cur = rand->eval(e);
-        if (!(cur->v_type == V_BOOL && dynamic_cast<Boolean*>(cur.get())->b == false)) {
+        if (!cur.isFalse()) {
             return cur;
         }
     }
@@ -686,7 +1171,7 @@ Value Not::evalRator(const Value &rand) { // not
     return BooleanV(false);
 }
 
-Value If::eval(Assoc &e) {
+Value If::eval(Env &e) {
     Value cond_val = cond->eval(e);
     bool is_false = false;
     if (cond_val->v_type == V_BOOL) {
@@ -702,7 +1187,7 @@ Value If::eval(Assoc &e) {
     }
 }
 
-Value Cond::eval(Assoc &env) {
+Value Cond::eval(Env &env) {
     int n = has_else ? clauses.size() - 1 : clauses.size();
     for (int i = 0; i < n; ++i) {
         Value pred_val = clauses[i][0]->eval(env);
@@ -726,77 +1211,641 @@ Value Cond::eval(Assoc &env) {
     return res;
 }
 
-Value Lambda::eval(Assoc &env) { 
-    return ProcedureV(x, e, env);
+Value Lambda::eval(Env &env) { 
+    COUNT(closures);
+    Value proc = ProcedureV(x, e, env, frame_size, name);
+    static_cast<Procedure*>(proc.get())->local_frame = local;
+    return proc;
+}
+
+/**
+ * @brief Call left pending by an application in tail position
+ *
+ * A tail Apply binds the callee's frame, parks it here and returns
+ * `tail_call_marker` instead of evaluating the body. The nearest non-tail
+ * Apply then runs pending calls in a loop, so tail-recursive procedures
+ * execute in constant C++ stack space.
+ */
+struct TailCall {
+    Value proc;
+    Env frame;
+    TailCall() : proc(nullptr), frame(nullptr) {}
+};
+
+// per thread, as the marker's reference count changes on every tail call
+static thread_local TailCall pending_call;
+static thread_local Value tail_call_marker(new Void());
+
+void releaseTailCalls() {
+    pending_call = TailCall();
+    tail_call_marker = Value(nullptr);
+}
+
+// the frame the next pending call runs in; one that took over the frame
+// it was made from gives its reference back, so that frame stays unshared
+// and the call after it can refill it again (and drop what it held)
+static Env &pendingFrame(Env &active, Env &owned) {
+    if (pending_call.frame.get() != active.get()) {
+        owned = std::move(pending_call.frame);
+        pending_call.frame = Env(nullptr);
+        return owned;
+    }
+    pending_call.frame = Env(nullptr);
+    return active;
+}
+
+// runs a call in its bound frame to completion, pending tail calls included
+static Value trampoline(Procedure *proc, Env &frame) {
+    Value result = proc->e->eval(frame);
+    Env owned(nullptr);
+    Env *active = &frame;
+    while (result.get() == tail_call_marker.get()) {
+        Value next = std::move(pending_call.proc);
+        active = &pendingFrame(*active, owned);
+        result = static_cast<Procedure*>(next.get())->e->eval(*active);
+    }
+    return result;
+}
+
+// trampoline with every activation timed; the last entry is closed even
+// when the body throws
+static Value profiledCall(Procedure *proc, Env &frame) {
+    ProfileEntry entry(proc->name);
+    Value result = proc->e->eval(frame);
+    Env owned(nullptr);
+    Env *active = &frame;
+    while (result.get() == tail_call_marker.get()) {
+        Value next = std::move(pending_call.proc);
+        active = &pendingFrame(*active, owned);
+        Procedure *callee = static_cast<Procedure*>(next.get());
+        profileTailCall(callee->name);
+        result = callee->e->eval(*active);
+    }
+    return result;
 }
 
-Value Apply::eval(Assoc &e) {
-    auto rator_val = rator->eval(e);
-    if (rator_val->v_type != V_PROC) {throw RuntimeError("Attempt to apply a non-procedure");}
+Value callMemoized(Procedure *proc, Env &frame) {
+    MemoCache &memo = *proc->memo;
+    const size_t n = proc->parameters.size();
+    size_t hash;
+    if (!MemoCache::hash(frame->slots.data(), n, hash)) {
+        ++memo.misses;
+        return profiling ? profiledCall(proc, frame) : trampoline(proc, frame);
+    }
+    if (Value *hit = memo.lookup(frame->slots.data(), n, hash)) {
+        return *hit;
+    }
+    // the body may assign to its parameters, so the key is copied first
+    std::vector<Value> key(frame->slots.begin(), frame->slots.begin() + n);
+    Value result = profiling ? profiledCall(proc, frame) : trampoline(proc, frame);
+    memo.store(key.data(), n, hash, result);
+    return result;
+}
 
-    Procedure* clos_ptr = dynamic_cast<Procedure*>(rator_val.get());
-    
+static Value applyPrimitive(Primitive *prim, const std::vector<Expr> &rand, Env &e) {
+    // builtins take a handful of arguments; keep those off the heap
+    const size_t n = rand.size();
+    if (n <= 4) {
+        Value args[4] = {Value(nullptr), Value(nullptr), Value(nullptr), Value(nullptr)};
+        for (size_t i = 0; i < n; ++i) {
+            args[i] = rand[i]->eval(e);
+        }
+        return prim->call(args, n);
+    }
     std::vector<Value> args;
-    for (const auto& expr : rand) {
+    args.reserve(n);
+    for (const auto &expr : rand) {
         args.push_back(expr->eval(e));
     }
-    if (auto varNode = dynamic_cast<Variadic*>(clos_ptr->e.get())) {
-        return varNode->evalRator(args);
+    return prim->call(args.data(), n);
+}
+
+/**
+ * @brief Tail call that takes over the caller's frame
+ *
+ * A frame that nothing but the running call refers to (no closure or
+ * pending call captured it) and that has the callee's shape, the same
+ * enclosing frame and size, is refilled in place rather than replaced.
+ * This is always the case for a loop written as direct self-recursion,
+ * which then runs without allocating a frame per iteration. The operands
+ * are evaluated before any slot is written, since they may read them.
+ * A let or letrec frame lent by LocalFrame is never refilled: it is
+ * returned before the pending call runs.
+ */
+static bool reuseFrame(Procedure *proc, const std::vector<Expr> &rand, Env &e) {
+    const size_t n = rand.size();
+    Frame *f = e.get();
+    if (n > 4 || f->slots.size() != proc->frame_size || f->parent.get() != proc->env.get()) {
+        return false;
+    }
+    Value args[4] = {Value(nullptr), Value(nullptr), Value(nullptr), Value(nullptr)};
+    for (size_t i = 0; i < n; ++i) {
+        args[i] = rand[i]->eval(e);
+    }
+    if (f->refs == 1 && !f->scoped) {
+        for (size_t i = 0; i < n; ++i) {
+            f->slots[i] = std::move(args[i]);
+        }
+        for (size_t i = n; i < f->slots.size(); ++i) {
+            f->slots[i] = Value(nullptr);   // internal defines start unassigned
+        }
+        pending_call.frame = e;
+        return true;
+    }
+    Env frame = makeFrame(proc->frame_size, proc->env);
+    for (size_t i = 0; i < n; ++i) {
+        frame->slots[i] = std::move(args[i]);
+    }
+    pending_call.frame = std::move(frame);
+    return true;
+}
+
+// arguments are evaluated straight into the slots of the callee's frame
+static void bindArguments(Procedure *proc, const std::vector<Expr> &rand, Env &e, Env &frame) {
+    const size_t arity = proc->parameters.size();
+    for (size_t i = 0; i < rand.size(); ++i) {
+        Value arg = rand[i]->eval(e);
+        if (i < arity) {
+            frame->slots[i] = arg;
+        }
+    }
+    if (rand.size() != arity) {
+        throw RuntimeError("Wrong number of arguments");
+    }
+}
+
+// a non-tail call, run to completion in its bound frame
+static Value callBody(Procedure *proc, Env &frame) {
+    COUNT_CALL();
+    if (proc->memo) {
+        // the result is stored once the body returns
+        return callMemoized(proc, frame);
+    }
+    if (profiling) {
+        return profiledCall(proc, frame);
+    }
+    return trampoline(proc, frame);
+}
+
+Value Apply::eval(Env &e) {
+    Value rator_val(nullptr);
+    Procedure *clos_ptr;
+    if (cached_epoch == binding_epoch) {
+        // the callee and its arity were checked when the cache was filled
+        clos_ptr = cached_proc;
+        rator_val = Value(clos_ptr);
+    } else {
+        rator_val = rator->eval(e);
+        if (rator_val->v_type == V_PRIMITIVE) {
+            return applyPrimitive(static_cast<Primitive*>(rator_val.get()), rand, e);
+        }
+        if (rator_val->v_type != V_PROC) {throw RuntimeError("Attempt to apply a non-procedure");}
+        clos_ptr = static_cast<Procedure*>(rator_val.get());
+        if (global_rator && clos_ptr->parameters.size() == rand.size()) {
+            cached_epoch = binding_epoch;
+            cached_proc = clos_ptr;
+        }
     }
-    if (args.size() != clos_ptr->parameters.size()) {
+
+    size_t arity = clos_ptr->parameters.size();
+    if (tail && rand.size() == arity && !clos_ptr->memo && reuseFrame(clos_ptr, rand, e)) {
+        pending_call.proc = std::move(rator_val);
+        return tail_call_marker;
+    }
+
+    // a memoized call is never a tail call: its result is stored afterwards
+    if (tail && !clos_ptr->memo) {
+        Env param_env = makeFrame(clos_ptr->frame_size, clos_ptr->env);
+        bindArguments(clos_ptr, rand, e, param_env);
+        pending_call.proc = rator_val;
+        pending_call.frame = param_env;
+        return tail_call_marker;
+    }
+    if (clos_ptr->local_frame) {
+        LocalFrame frame(clos_ptr->frame_size, clos_ptr->env, false);
+        bindArguments(clos_ptr, rand, e, frame.env);
+        return callBody(clos_ptr, frame.env);
+    }
+    Env param_env = makeFrame(clos_ptr->frame_size, clos_ptr->env);
+    bindArguments(clos_ptr, rand, e, param_env);
+    return callBody(clos_ptr, param_env);
+}
+
+// ============================================================================
+// Higher-order List Operations
+// ============================================================================
+
+// calls f with already evaluated arguments, as a call outside a tail
+// position would, from a builtin
+static Value applyProcedure(const Value &f, const Value *args, size_t n) {
+    if (f->v_type == V_PRIMITIVE) {
+        return static_cast<Primitive*>(f.get())->call(args, n);
+    }
+    if (f->v_type != V_PROC) {
+        throw RuntimeError("Attempt to apply a non-procedure");
+    }
+    Procedure *proc = static_cast<Procedure*>(f.get());
+    if (n != proc->parameters.size()) {
         throw RuntimeError("Wrong number of arguments");
     }
+    if (proc->local_frame) {
+        LocalFrame frame(proc->frame_size, proc->env, false);
+        std::copy(args, args + n, frame.env->slots.begin());
+        return callBody(proc, frame.env);
+    }
+    Env frame = makeFrame(proc->frame_size, proc->env);
+    std::copy(args, args + n, frame->slots.begin());
+    return callBody(proc, frame);
+}
+
+/**
+ * Calls step once per position of the lists args[first..], up to the end
+ * of the shortest, with the elements at that position stored from
+ * call_args[offset] on. Every list must be proper up to there.
+ */
+template <class Step>
+static void eachPosition(const std::vector<Value> &args, size_t first, std::vector<Value> &call_args,
+                         size_t offset, const char *who, Step step) {
+    const size_t k = args.size() - first;
+    std::vector<const Value*> cursors;
+    for (size_t i = first; i < args.size(); ++i) {
+        cursors.push_back(&args[i]);
+    }
+    while (true) {
+        for (size_t i = 0; i < k; ++i) {
+            ValueType type = (*cursors[i])->v_type;
+            if (type == V_NULL) {
+                return;
+            }
+            if (type != V_PAIR) {
+                throw RuntimeError(std::string(who) + ": expects arguments to be lists");
+            }
+        }
+        for (size_t i = 0; i < k; ++i) {
+            Pair *p = static_cast<Pair*>(cursors[i]->get());
+            call_args[offset + i] = p->car;
+            cursors[i] = &p->cdr;
+        }
+        step();
+    }
+}
 
-    Assoc param_env = clos_ptr->env;
-    for (size_t i = 0; i < args.size(); ++i) {
-        param_env = extend(clos_ptr->parameters[i], args[i], param_env);
+// the arguments apply passes on: the objs, then the elements of the list
+static std::vector<Value> spreadArguments(const std::vector<Value> &args) {
+    std::vector<Value> call_args(args.begin() + 1, args.end() - 1);
+    const Value *cur = &args.back();
+    while ((*cur)->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(cur->get());
+        call_args.push_back(p->car);
+        cur = &p->cdr;
     }
+    if ((*cur)->v_type != V_NULL) {
+        throw RuntimeError("apply: expects last argument to be a list");
+    }
+    return call_args;
+}
+
+Value ApplyFunc::evalRator(const std::vector<Value> &args) { // apply
+    std::vector<Value> call_args = spreadArguments(args);
+    return applyProcedure(args[0], call_args.data(), call_args.size());
+}
+
+Value ApplyFunc::eval(Env &e) {
+    std::vector<Value> args;
+    args.reserve(rands.size());
+    for (const auto &expr : rands) {
+        args.push_back(expr->eval(e));
+    }
+    Procedure *proc = valueAs<Procedure>(args[0]);
+    // a memoized call is never a tail call, as in Apply::eval
+    if (!tail || proc == nullptr || proc->memo) {
+        return evalRator(args);
+    }
+    std::vector<Value> call_args = spreadArguments(args);
+    if (call_args.size() != proc->parameters.size()) {
+        throw RuntimeError("Wrong number of arguments");
+    }
+    Env frame = makeFrame(proc->frame_size, proc->env);
+    std::move(call_args.begin(), call_args.end(), frame->slots.begin());
+    pending_call.proc = std::move(args[0]);
+    pending_call.frame = std::move(frame);
+    return tail_call_marker;
+}
+
+Value Map::evalRator(const std::vector<Value> &args) { // map
+    const Value &f = args[0];
+    std::vector<Value> call_args(args.size() - 1, Value(nullptr));
+    ListBuilder out;
+    eachPosition(args, 1, call_args, 0, "map", [&]() {
+        out.push(applyProcedure(f, call_args.data(), call_args.size()));
+    });
+    return out.finish(NullV());
+}
 
-    return clos_ptr->e->eval(param_env);
+Value ForEach::evalRator(const std::vector<Value> &args) { // for-each
+    const Value &f = args[0];
+    std::vector<Value> call_args(args.size() - 1, Value(nullptr));
+    eachPosition(args, 1, call_args, 0, "for-each", [&]() {
+        applyProcedure(f, call_args.data(), call_args.size());
+    });
+    return VoidV();
+}
+
+Value FoldLeft::evalRator(const std::vector<Value> &args) { // fold-left
+    const Value &f = args[0];
+    if (args.size() == 3 && f->v_type == V_PRIMITIVE) {
+        // (fold-left + 0 xs) and (fold-left * 1 xs) over fixnums
+        static const SymbolId plus_name = intern("+");
+        static const SymbolId times_name = intern("*");
+        SymbolId name = static_cast<Primitive*>(f.get())->name;
+        if (name == plus_name || name == times_name) {
+            std::vector<Value> init(1, args[1]);
+            std::vector<uintptr_t> &words = gatherWords(init);
+            Value res(nullptr);
+            if (gatherList(args[2], words) &&
+                (name == plus_name ? sumFixnums(words, res) : productFixnums(words, res))) {
+                return res;
+            }
+        }
+    }
+    std::vector<Value> call_args(args.size() - 1, Value(nullptr));
+    call_args[0] = args[1];
+    eachPosition(args, 2, call_args, 1, "fold-left", [&]() {
+        call_args[0] = applyProcedure(f, call_args.data(), call_args.size());
+    });
+    return call_args[0];
 }
 
-Value Define::eval(Assoc &env) {
-    Assoc rec_env = env;
-    insert(var, Value(nullptr), rec_env);
-    modify(var, e->eval(rec_env), rec_env);
-    env = rec_env;
+Value Define::eval(Env &env) {
+    if (index >= 0) {
+        // internal define: the slot was reserved when the body was parsed
+        env->slots[index] = e->eval(env);
+        return VoidV();
+    }
+    insert(var, Value(nullptr), env->globals);
+    modify(var, e->eval(env), env->globals);
     return VoidV();
 }
 
-Value Let::eval(Assoc &env) {
-    Assoc let_env = env;
-    for (const auto& binding : bind) {
-        let_env = extend(binding.first, binding.second->eval(env), let_env);
+Value Let::eval(Env &env) {
+    if (local) {
+        LocalFrame let_env(frame_size, env);
+        for (size_t i = 0; i < bind.size(); ++i) {
+            let_env.env->slots[i] = bind[i].second->eval(env);
+        }
+        return body->eval(let_env.env);
+    }
+    Env let_env = makeFrame(frame_size, env);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        let_env->slots[i] = bind[i].second->eval(env);
     }
     return body->eval(let_env);
 }
 
-Value Letrec::eval(Assoc &env) {
-    Assoc rec_env = env;
-    for (const auto& binding : bind) {
-        rec_env = extend(binding.first, Value(nullptr), rec_env);
+Value Letrec::eval(Env &env) {
+    if (local) {
+        LocalFrame rec_env(frame_size, env);
+        for (size_t i = 0; i < bind.size(); ++i) {
+            rec_env.env->slots[i] = bind[i].second->eval(rec_env.env);
+        }
+        return body->eval(rec_env.env);
     }
-
-    for (const auto& binding : bind) {
-        auto val = binding.second->eval(rec_env);
-        modify(binding.first, val, rec_env);
+    Env rec_env = makeFrame(frame_size, env);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        rec_env->slots[i] = bind[i].second->eval(rec_env);
     }
 
     return body->eval(rec_env);
 }
 
-Value Set::eval(Assoc &env) {
-    modify(var, e->eval(env), env);
+Value Set::eval(Env &env) {
+    Value val = e->eval(env);
+    Frame *f = nthFrame(env, depth);
+    if (index >= 0) {
+        f->slots[index] = val;
+    } else {
+        modify(var, val, f->globals);
+    }
     return VoidV();
 }
 
 Value Display::evalRator(const Value &rand) { // display function
-    if (rand->v_type == V_STRING) {
-        String* str_ptr = dynamic_cast<String*>(rand.get());
-        std::cout << str_ptr->s;
-    } else {
-        rand->show(std::cout);
+    Printer out(outputStream());
+    out.display(rand);
+    out.put('\n');
+    return VoidV();
+}
+
+static Value heapStatsList() {
+    HeapStats stats = gcStats();
+    std::vector<std::pair<std::string, long long>> fields = {
+        {"collections", (long long)stats.collections},
+        {"tracked-objects", (long long)stats.tracked},
+        {"freed-objects", (long long)stats.freed},
+        {"allocated-objects", (long long)stats.allocated},
+        {"arena-cells", (long long)stats.arena_live},
+        {"heap-bytes", (long long)stats.heap_bytes},
+        {"total-gc-us", (long long)(stats.total_ms * 1000)},
+        {"last-gc-us", (long long)(stats.last_ms * 1000)}
+    };
+    Value res = NullV();
+    for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+        res = PairV(PairV(SymbolV(it->first), IntegerV(BigInt(it->second))), res);
+    }
+    return res;
+}
+
+Value GcStats::eval(Env &e) { // (gc-stats)
+    return heapStatsList();
+}
+
+static Value runtimeStatsList() {
+    std::vector<std::pair<std::string, uint64_t>> fields = runtimeCounterFields();
+    Value res = NullV();
+    for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+        res = PairV(PairV(SymbolV(it->first), IntegerV(BigInt((long long)it->second))), res);
     }
-    puts("");
+    return res;
+}
+
+Value RuntimeStats::eval(Env &e) { // (runtime-stats)
+    return runtimeStatsList();
+}
+
+Value Profile::eval(Env &env) { // (profile expr)
+    // the profile is reported even when expr raises an error
+    struct Session {
+        Session() { profileStart(); }
+        ~Session() { profileStop(std::cerr); }
+    } session;
+    return e->eval(env);
+}
+
+// ============================================================================
+// Native Primitives
+// ============================================================================
+
+// Each builtin is implemented by the evalRator of its node class; one
+// operand-less node per class serves every call made through a Primitive.
+template <class Node>
+static Value callUnary(const Value *args, size_t) {
+    static Node node((Expr(nullptr)));
+    return node.evalRator(args[0]);
+}
+
+template <class Node>
+static Value callBinary(const Value *args, size_t) {
+    static Node node((Expr(nullptr)), (Expr(nullptr)));
+    return node.evalRator(args[0], args[1]);
+}
+
+template <class Node>
+static Value callVariadic(const Value *args, size_t n) {
+    static Node node((std::vector<Expr>()));
+    return node.evalRator(std::vector<Value>(args, args + n));
+}
+
+static Value callVoid(const Value *, size_t) {
     return VoidV();
 }
+
+static Value callExit(const Value *, size_t) {
+    reportRuntimeCounters(std::cerr);
+    return TerminateV();
+}
+
+static Value callGcStats(const Value *, size_t) {
+    return heapStatsList();
+}
+
+static Value callRuntimeStats(const Value *, size_t) {
+    return runtimeStatsList();
+}
+
+// and/or called as procedures: the operands are already evaluated
+static Value callAnd(const Value *args, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (args[i].isFalse()) {
+            return BooleanV(false);
+        }
+    }
+    return n == 0 ? BooleanV(true) : args[n - 1];
+}
+
+static Value callOr(const Value *args, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (!args[i].isFalse()) {
+            return args[i];
+        }
+    }
+    return BooleanV(false);
+}
+
+struct PrimitiveSpec {
+    PrimitiveFn fn;
+    int min_args;
+    int max_args;
+};
+
+// one Primitive per builtin and thread, indexed by its interned name
+static thread_local std::vector<Value> *builtin_table = nullptr;
+
+static std::vector<Value> &builtinTable() {
+    std::vector<Value> *&table = builtin_table;
+    if (table != nullptr) {
+        return *table;
+    }
+    static const std::map<ExprType, PrimitiveSpec> specs = {
+        {E_VOID,     {callVoid, 0, 0}},
+        {E_EXIT,     {callExit, 0, 0}},
+        {E_GCSTATS,  {callGcStats, 0, 0}},
+        {E_RUNTIMESTATS, {callRuntimeStats, 0, 0}},
+        {E_BOOLQ,    {callUnary<IsBoolean>, 1, 1}},
+        {E_INTQ,     {callUnary<IsFixnum>, 1, 1}},
+        {E_NULLQ,    {callUnary<IsNull>, 1, 1}},
+        {E_PAIRQ,    {callUnary<IsPair>, 1, 1}},
+        {E_PROCQ,    {callUnary<IsProcedure>, 1, 1}},
+        {E_SYMBOLQ,  {callUnary<IsSymbol>, 1, 1}},
+        {E_STRINGQ,  {callUnary<IsString>, 1, 1}},
+        {E_LISTQ,    {callUnary<IsList>, 1, 1}},
+        {E_VECTORQ,  {callUnary<IsVector>, 1, 1}},
+        {E_HASHTABLEQ, {callUnary<IsHashTable>, 1, 1}},
+        {E_PROMISEQ, {callUnary<IsPromise>, 1, 1}},
+        {E_DISPLAY,  {callUnary<Display>, 1, 1}},
+        {E_PLUS,     {callVariadic<PlusVar>, 0, -1}},
+        {E_MINUS,    {callVariadic<MinusVar>, 0, -1}},
+        {E_MUL,      {callVariadic<MultVar>, 0, -1}},
+        {E_DIV,      {callVariadic<DivVar>, 0, -1}},
+        {E_MODULO,   {callBinary<Modulo>, 2, 2}},
+        {E_EXPT,     {callBinary<Expt>, 2, 2}},
+        {E_LT,       {callVariadic<LessVar>, 0, -1}},
+        {E_LE,       {callVariadic<LessEqVar>, 0, -1}},
+        {E_EQ,       {callVariadic<EqualVar>, 0, -1}},
+        {E_GE,       {callVariadic<GreaterEqVar>, 0, -1}},
+        {E_GT,       {callVariadic<GreaterVar>, 0, -1}},
+        {E_EQQ,      {callVariadic<EqualVar>, 0, -1}},
+        {E_CONS,     {callBinary<Cons>, 2, 2}},
+        {E_CAR,      {callUnary<Car>, 1, 1}},
+        {E_CDR,      {callUnary<Cdr>, 1, 1}},
+        {E_LIST,     {callVariadic<ListFunc>, 0, -1}},
+        {E_SETCAR,   {callBinary<SetCar>, 2, 2}},
+        {E_SETCDR,   {callBinary<SetCdr>, 2, 2}},
+        {E_LENGTH,   {callUnary<Length>, 1, 1}},
+        {E_REVERSE,  {callUnary<Reverse>, 1, 1}},
+        {E_APPEND,   {callVariadic<Append>, 0, -1}},
+        {E_APPLYFUNC, {callVariadic<ApplyFunc>, 2, -1}},
+        {E_MAP,      {callVariadic<Map>, 2, -1}},
+        {E_FOREACH,  {callVariadic<ForEach>, 2, -1}},
+        {E_FOLDLEFT, {callVariadic<FoldLeft>, 3, -1}},
+        {E_MAKEVECTOR, {callVariadic<MakeVector>, 1, 2}},
+        {E_VECTOR,     {callVariadic<VectorFunc>, 0, -1}},
+        {E_VECTORREF,  {callBinary<VectorRef>, 2, 2}},
+        {E_VECTORSET,  {callVariadic<VectorSet>, 3, 3}},
+        {E_VECTORLENGTH, {callUnary<VectorLength>, 1, 1}},
+        {E_MAKEHASHTABLE, {callVariadic<MakeHashTable>, 0, 0}},
+        {E_HASHREF,    {callVariadic<HashRef>, 2, 3}},
+        {E_HASHSET,    {callVariadic<HashSet>, 3, 3}},
+        {E_HASHCOUNT,  {callUnary<HashCount>, 1, 1}},
+        {E_MEMOIZE,    {callVariadic<Memoize>, 1, 2}},
+        {E_MEMOSTATS,  {callUnary<MemoStats>, 1, 1}},
+        {E_FORCE,      {callUnary<Force>, 1, 1}},
+        {E_STREAMCAR,  {callUnary<StreamCar>, 1, 1}},
+        {E_STREAMCDR,  {callUnary<StreamCdr>, 1, 1}},
+        {E_NOT,      {callUnary<Not>, 1, 1}},
+        {E_AND,      {callAnd, 0, -1}},
+        {E_OR,       {callOr, 0, -1}}
+    };
+
+    table = new std::vector<Value>();
+    for (const auto &entry : primitives) {
+        auto it = specs.find(entry.second);
+        if (it == specs.end()) {
+            continue;
+        }
+        SymbolId name = intern(entry.first);
+        if ((size_t)name >= table->size()) {
+            table->resize(name + 1, Value(nullptr));
+        }
+        (*table)[name] = PrimitiveV(name, it->second.fn, it->second.min_args, it->second.max_args);
+    }
+    return *table;
+}
+
+void installPrimitives(Globals &globals) {
+    for (const auto &entry : primitives) {
+        Value prim = lookupPrimitive(intern(entry.first));
+        if (prim.get() != nullptr) {
+            insert(intern(entry.first), prim, globals);
+        }
+    }
+}
+
+Value lookupPrimitive(SymbolId x) {
+    std::vector<Value> &table = builtinTable();
+    return (size_t)x < table.size() ? table[x] : Value(nullptr);
+}
+
+void releasePrimitives() {
+    delete builtin_table;
+    builtin_table = nullptr;
+}
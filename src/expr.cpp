@@ -8,7 +8,7 @@ using std::vector;
 using std::string;
 using std::pair;
 
-ExprBase::ExprBase(ExprType et) : e_type(et) {}
+ExprBase::ExprBase(ExprType et) : e_type(et), shape(S_OTHER) {}
 
 Expr::Expr(ExprBase * eb) : ptr(eb) {}
 ExprBase* Expr::operator->() const { return ptr.get(); }
@@ -17,29 +17,40 @@ ExprBase* Expr::get() const { return ptr.get(); }
 
 //BASIC TYPES AND LITERALS
 
-Fixnum::Fixnum(int x) : ExprBase(E_FIXNUM), n(x) {}
+Fixnum::Fixnum(const std::string &digits) : ExprBase(E_FIXNUM), datum(IntegerV(BigInt::parse(digits))) {}
 
-RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num), denominator(den) {
-    util::normalize_rational(num, den);
-}
+RationalNum::RationalNum(const std::string &num, const std::string &den)
+    : ExprBase(E_RATIONAL), datum(RationalV(BigInt::parse(num), BigInt::parse(den))) {}
 
-StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str) {}
+StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str), datum(StringV(str)) {}
 
-True::True() : ExprBase(E_TRUE) {}
+True::True() : ExprBase(E_TRUE), datum(BooleanV(true)) {}
 
-False::False() : ExprBase(E_FALSE) {}
+False::False() : ExprBase(E_FALSE), datum(BooleanV(false)) {}
 
 MakeVoid::MakeVoid() : ExprBase(E_VOID) {}
 
 Exit::Exit() : ExprBase(E_EXIT) {}
 
+GcStats::GcStats() : ExprBase(E_GCSTATS) {}
+
+RuntimeStats::RuntimeStats() : ExprBase(E_RUNTIMESTATS) {}
+
+Profile::Profile(const Expr &expr) : ExprBase(E_PROFILE), e(expr) {}
+
 //BASIC ABSTRACT TYPES FOR PARAMETERS
 
-Unary::Unary(ExprType et, const Expr &expr) : ExprBase(et), rand(expr) {}
+Unary::Unary(ExprType et, const Expr &expr) : ExprBase(et), rand(expr) {
+    shape = S_UNARY;
+}
 
-Binary::Binary(ExprType et, const Expr &r1, const Expr &r2) : ExprBase(et), rand1(r1), rand2(r2) {}
+Binary::Binary(ExprType et, const Expr &r1, const Expr &r2) : ExprBase(et), rand1(r1), rand2(r2) {
+    shape = S_BINARY;
+}
 
-Variadic::Variadic(ExprType et, const std::vector<Expr> &rands) : ExprBase(et), rands(rands) {}
+Variadic::Variadic(ExprType et, const std::vector<Expr> &rands) : ExprBase(et), rands(rands) {
+    shape = S_VARIADIC;
+}
 
 //ARITHMETIC OPERATIONS
 
@@ -99,6 +110,56 @@ SetCar::SetCar(const Expr &r1, const Expr &r2) : Binary(E_SETCAR, r1, r2) {}
 
 SetCdr::SetCdr(const Expr &r1, const Expr &r2) : Binary(E_SETCDR, r1, r2) {}
 
+Length::Length(const Expr &r1) : Unary(E_LENGTH, r1) {}
+
+Reverse::Reverse(const Expr &r1) : Unary(E_REVERSE, r1) {}
+
+Append::Append(const std::vector<Expr> &rands) : Variadic(E_APPEND, rands) {}
+
+ApplyFunc::ApplyFunc(const std::vector<Expr> &rands) : Variadic(E_APPLYFUNC, rands), tail(false) {}
+
+Map::Map(const std::vector<Expr> &rands) : Variadic(E_MAP, rands) {}
+
+ForEach::ForEach(const std::vector<Expr> &rands) : Variadic(E_FOREACH, rands) {}
+
+FoldLeft::FoldLeft(const std::vector<Expr> &rands) : Variadic(E_FOLDLEFT, rands) {}
+
+//VECTOR AND HASH TABLE OPERATIONS
+
+MakeVector::MakeVector(const std::vector<Expr> &rands) : Variadic(E_MAKEVECTOR, rands) {}
+
+VectorFunc::VectorFunc(const std::vector<Expr> &rands) : Variadic(E_VECTOR, rands) {}
+
+VectorRef::VectorRef(const Expr &r1, const Expr &r2) : Binary(E_VECTORREF, r1, r2) {}
+
+VectorSet::VectorSet(const std::vector<Expr> &rands) : Variadic(E_VECTORSET, rands) {}
+
+VectorLength::VectorLength(const Expr &r1) : Unary(E_VECTORLENGTH, r1) {}
+
+MakeHashTable::MakeHashTable(const std::vector<Expr> &rands) : Variadic(E_MAKEHASHTABLE, rands) {}
+
+HashRef::HashRef(const std::vector<Expr> &rands) : Variadic(E_HASHREF, rands) {}
+
+HashSet::HashSet(const std::vector<Expr> &rands) : Variadic(E_HASHSET, rands) {}
+
+HashCount::HashCount(const Expr &r1) : Unary(E_HASHCOUNT, r1) {}
+
+//MEMOIZATION
+
+Memoize::Memoize(const std::vector<Expr> &rands) : Variadic(E_MEMOIZE, rands) {}
+
+MemoStats::MemoStats(const Expr &r1) : Unary(E_MEMOSTATS, r1) {}
+
+//PROMISES AND STREAMS
+
+Delay::Delay(const Expr &expr) : ExprBase(E_DELAY), e(expr) {}
+
+Force::Force(const Expr &r1) : Unary(E_FORCE, r1) {}
+
+StreamCar::StreamCar(const Expr &r1) : Unary(E_STREAMCAR, r1) {}
+
+StreamCdr::StreamCdr(const Expr &r1) : Unary(E_STREAMCDR, r1) {}
+
 //LOGIC OPERATIONS
 
 Not::Not(const Expr &r1) : Unary(E_NOT, r1) {}
@@ -127,11 +188,19 @@ IsList::IsList(const Expr &r1) : Unary(E_LISTQ, r1) {}
 
 IsString::IsString(const Expr &r1) : Unary(E_STRINGQ, r1) {}
 
+IsVector::IsVector(const Expr &r1) : Unary(E_VECTORQ, r1) {}
+
+IsHashTable::IsHashTable(const Expr &r1) : Unary(E_HASHTABLEQ, r1) {}
+
+IsPromise::IsPromise(const Expr &r1) : Unary(E_PROMISEQ, r1) {}
+
 //CONTROL FLOW CONSTRUCTS
 
 Begin::Begin(const vector<Expr> &vec) : ExprBase(E_BEGIN), es(vec) {}
 
-Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t) {}
+Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t), datum(convertSyntaxToValue(t)) {}
+
+Quote::Quote(const Value &v) : ExprBase(E_QUOTE), datum(v) {}
 
 //CONDITIONAL
 
@@ -141,23 +210,29 @@ Cond::Cond(const bool h_e, const std::vector<std::vector<Expr>> &cls) : ExprBase
 
 //VARIABLE AND FUNCITON DEFINITION
 
-Var::Var(const string &s) : ExprBase(E_VAR), x(s) {}
+Var::Var(SymbolId s, int d, int i) : ExprBase(E_VAR), x(s), depth(d), index(i) {}
 
-Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec) {}
+Var::Var(const string &s, int d, int i) : ExprBase(E_VAR), x(intern(s)), depth(d), index(i) {}
+
+Apply::Apply(const Expr &expr, const vector<Expr> &vec)
+    : ExprBase(E_APPLY), rator(expr), rand(vec), tail(false), cached_epoch(0), cached_proc(nullptr) {
+    Var *var = exprAs<Var>(expr);
+    global_rator = var != nullptr && var->index < 0;
+}
 
-Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
+Lambda::Lambda(const vector<SymbolId> &vec, const Expr &expr, size_t size, SymbolId name) : ExprBase(E_LAMBDA), x(vec), e(expr), frame_size(size), name(name), local(false) {}
 
-Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
+Define::Define(SymbolId variable, const Expr &expr, int i) : ExprBase(E_DEFINE), var(variable), e(expr), index(i) {}
 
 //BINDING CONSTRUCTS
 
-Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
+Let::Let(const vector<pair<SymbolId, Expr>> &vec, const Expr &e, size_t size) : ExprBase(E_LET), bind(vec), body(e), frame_size(size), local(false) {}
 
-Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
+Letrec::Letrec(const vector<pair<SymbolId, Expr>> &vec, const Expr &expr, size_t size) : ExprBase(E_LETREC), bind(vec), body(expr), frame_size(size), local(false) {}
 
 //ASSIGNMENT
 
-Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e) {}
+Set::Set(SymbolId var, const Expr &e, int d, int i) : ExprBase(E_SET), var(var), e(e), depth(d), index(i) {}
 
 //I/O OPERATIONS
 
@@ -7,7 +7,7 @@ public:
     int numerator;
     int denominator;
     RationalNum(int num, int den);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };p
  * @brief Expression structures for the Scheme interpreter
  * @author luke36
@@ -19,38 +19,48 @@ public:
 
 #include "Def.hpp"
 #include "syntax.hpp"
+#include "value.hpp"
 #include <memory>
 #include <cstring>
 #include <vector>
 
+/**
+ * @brief Operand layout of a node, fixed by the base class that built it
+ *
+ * Operators such as `+` have both a Binary and a Variadic node under the
+ * same ExprType, so the layout is recorded separately for static dispatch.
+ */
+enum ExprShape {
+    S_OTHER,
+    S_UNARY,
+    S_BINARY,
+    S_VARIADIC
+};
+
 struct ExprBase{
     ExprType e_type;
+    ExprShape shape;
     ExprBase(ExprType);
-    virtual Value eval(Assoc &) = 0;
+    virtual Value eval(Env &) = 0;
     virtual ~ExprBase() = default;
 };
 
-class Expr {
-    std::shared_ptr<ExprBase> ptr;
-public:
-    Expr(ExprBase *);
-    ExprBase* operator->() const;
-    ExprBase& operator*();
-    ExprBase* get() const;
-};
-
 // ================================================================================
 //                             BASIC TYPES AND LITERALS
 // ================================================================================
 
 /**
  * @brief Integer literal expression
- * Represents fixed-point numbers (integers)
+ * Represents integers, as a fixnum or a bignum depending on magnitude
+ *
+ * Literal nodes build their Value once at parse time and return it from
+ * every evaluation.
  */
 struct Fixnum : ExprBase {
-  int n;
-  Fixnum(int);
-  virtual Value eval(Assoc &) override;
+  static constexpr ExprType tag = E_FIXNUM;
+  Value datum;
+  Fixnum(const std::string &);
+  virtual Value eval(Env &) override;
 };
 
 /**
@@ -58,10 +68,10 @@ struct Fixnum : ExprBase {
  * Represents rational numbers as numerator/denominator
  */
 struct RationalNum : ExprBase {
-  int numerator;
-  int denominator;
-  RationalNum(int num, int den);
-  virtual Value eval(Assoc &) override;
+  static constexpr ExprType tag = E_RATIONAL;
+  Value datum;
+  RationalNum(const std::string &num, const std::string &den);
+  virtual Value eval(Env &) override;
 };
 
 /**
@@ -69,35 +79,73 @@ struct RationalNum : ExprBase {
  * Represents string values
  */
 struct StringExpr : ExprBase {
+  static constexpr ExprType tag = E_STRING;
   std::string s;
+  Value datum;
   StringExpr(const std::string &);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
 };
 
 /**
  * @brief Boolean true literal
  */
 struct True : ExprBase {
+  static constexpr ExprType tag = E_TRUE;
+  Value datum;
   True();
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
 };
 
 /**
  * @brief Boolean false literal  
  */
 struct False : ExprBase {
+  static constexpr ExprType tag = E_FALSE;
+  Value datum;
   False();
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
 };
 
 struct MakeVoid : ExprBase {
+    static constexpr ExprType tag = E_VOID;
     MakeVoid();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct Exit : ExprBase {
+    static constexpr ExprType tag = E_EXIT;
     Exit();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+};
+
+/**
+ * @brief (gc-stats): heap and collector counters as an association list
+ */
+struct GcStats : ExprBase {
+    static constexpr ExprType tag = E_GCSTATS;
+    GcStats();
+    virtual Value eval(Env &) override;
+};
+
+/**
+ * @brief (runtime-stats): interpreter event counters as an association
+ * list, empty unless built with RUNTIME_COUNTERS
+ */
+struct RuntimeStats : ExprBase {
+    static constexpr ExprType tag = E_RUNTIMESTATS;
+    RuntimeStats();
+    virtual Value eval(Env &) override;
+};
+
+/**
+ * @brief (profile expr): evaluate expr with procedure calls timed, then
+ * print the profile to stderr
+ */
+struct Profile : ExprBase {
+    static constexpr ExprType tag = E_PROFILE;
+    Expr e;
+    Profile(const Expr &);
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -108,7 +156,7 @@ struct Unary : ExprBase {
     Expr rand;
     Unary(ExprType, const Expr &);
     virtual Value evalRator(const Value &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct Binary : ExprBase {
@@ -116,14 +164,14 @@ struct Binary : ExprBase {
     Expr rand2;
     Binary(ExprType, const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct Variadic : ExprBase {
     std::vector<Expr> rands;
     Variadic(ExprType, const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -163,16 +211,19 @@ struct Expt : Binary {
 struct PlusVar : Variadic {
     PlusVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct MinusVar : Variadic {
     MinusVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct MultVar : Variadic {
     MultVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct DivVar : Variadic {
@@ -212,28 +263,44 @@ struct Greater : Binary {
 struct LessVar : Variadic {
     LessVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct LessEqVar : Variadic {
     LessEqVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct EqualVar : Variadic {
     EqualVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct GreaterEqVar : Variadic {
     GreaterEqVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct GreaterVar : Variadic {
     GreaterVar(const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
 };
 
+/**
+ * @brief Parsed node for a two-operand + - * < <= = >= >
+ *
+ * The node's eval works on two fixnums with checked machine arithmetic and
+ * returns without touching BigInt; a fixnum literal operand is kept unboxed
+ * in the node and never evaluated. Overflow, bignums and rationals fall
+ * through to the type's evalRator. The node keeps the E_* type and both
+ * operands, so the VM and images see a plain Binary.
+ */
+Expr makeArithmetic(ExprType, const Expr &, const Expr &);
+
 // ================================================================================
 //                             LIST OPERATIONS
 // ================================================================================
@@ -268,6 +335,196 @@ struct SetCdr : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+struct Length : Unary {
+    Length(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Reverse : Unary {
+    Reverse(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/**
+ * @brief (append list ... obj): copies of all but the last argument,
+ * which is shared and may be any value
+ */
+struct Append : Variadic {
+    Append(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+// ================================================================================
+//                             HIGHER-ORDER LIST OPERATIONS
+// ================================================================================
+
+// These walk the pair chains in C++ and call the procedure with the same
+// frames and trampoline as an ordinary call; folding fixnums with + or *
+// makes no calls at all.
+
+/**
+ * @brief (apply f obj ... list): f called with the objs, then the
+ * elements of list, as its arguments
+ *
+ * `tail` is set by the parser as for Apply: in tail position the call to
+ * f is left to the caller's trampoline. Reached as a first-class value,
+ * apply runs f to completion like the other builtins.
+ */
+struct ApplyFunc : Variadic {
+    static constexpr ExprType tag = E_APPLYFUNC;
+    bool tail;
+    ApplyFunc(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value eval(Env &) override;
+};
+
+/**
+ * @brief (map f list1 list2 ...): f applied to the elements at each
+ * position, up to the end of the shortest list
+ */
+struct Map : Variadic {
+    Map(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/// (for-each f list1 list2 ...): as map, for the effects only
+struct ForEach : Variadic {
+    ForEach(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (fold-left f init list1 list2 ...): (f (f init x1 ...) x2 ...)
+ * and so on through the shortest list
+ */
+struct FoldLeft : Variadic {
+    FoldLeft(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+// ================================================================================
+//                             VECTOR AND HASH TABLE OPERATIONS
+// ================================================================================
+
+/**
+ * @brief (make-vector k [fill]): k slots holding fill, 0 by default
+ */
+struct MakeVector : Variadic {
+    MakeVector(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct VectorFunc : Variadic {
+    VectorFunc(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct VectorRef : Binary {
+    VectorRef(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+/**
+ * @brief (vector-set! v k obj)
+ */
+struct VectorSet : Variadic {
+    VectorSet(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct VectorLength : Unary {
+    VectorLength(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct MakeHashTable : Variadic {
+    MakeHashTable(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (hash-ref table key [default]): an error for a missing key
+ * unless a default is given
+ */
+struct HashRef : Variadic {
+    HashRef(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/**
+ * @brief (hash-set! table key obj)
+ */
+struct HashSet : Variadic {
+    HashSet(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+struct HashCount : Unary {
+    HashCount(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             MEMOIZATION
+// ================================================================================
+
+/**
+ * @brief (memoize f [capacity]): a copy of f that caches its results
+ *
+ * The copy shares f's body and environment; f itself stays uncached, so
+ * recursive calls inside f go through the memoized procedure only when
+ * they name it, as (define f (memoize f)) and define-memo arrange.
+ * Arguments match by content, lists and vectors included, so a call after
+ * a vector-set! on an argument is computed afresh; a call passing a hash
+ * table is never cached (see MemoCache).
+ */
+struct Memoize : Variadic {
+    Memoize(const std::vector<Expr> &);
+    virtual Value evalRator(const std::vector<Value> &) override;
+};
+
+/// (memo-stats f): hits, misses, entries and capacity of f's cache
+struct MemoStats : Unary {
+    MemoStats(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             PROMISES AND STREAMS
+// ================================================================================
+
+/**
+ * @brief (delay expr): a promise to evaluate expr in the current frame
+ *
+ * (cons-stream a b) parses to (cons a (delay b)), so a stream is a pair
+ * whose cdr is a promise of the rest.
+ */
+struct Delay : ExprBase {
+    static constexpr ExprType tag = E_DELAY;
+    Expr e;
+    Delay(const Expr &);
+    virtual Value eval(Env &) override;
+};
+
+/// (force p): the value of promise p, computed on the first force only;
+/// anything but a promise is returned as it is
+struct Force : Unary {
+    Force(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/// (stream-car s): the first element of stream s
+struct StreamCar : Unary {
+    StreamCar(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+/// (stream-cdr s): the rest of stream s, forcing it
+struct StreamCdr : Unary {
+    StreamCdr(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 // ================================================================================
 //                             LOGIC OPERATIONS
 // ================================================================================
@@ -278,15 +535,17 @@ struct Not : Unary {
 };
 
 struct AndVar : ExprBase {
+    static constexpr ExprType tag = E_AND;
     std::vector<Expr> rands;
     AndVar(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;  
+    virtual Value eval(Env &) override;  
 };
 
 struct OrVar : ExprBase {
+    static constexpr ExprType tag = E_OR;
     std::vector<Expr> rands;
     OrVar(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -338,70 +597,136 @@ struct IsString : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+struct IsVector : Unary {
+    IsVector(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsHashTable : Unary {
+    IsHashTable(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsPromise : Unary {
+    IsPromise(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 // ================================================================================
 //                             CONTROL FLOW CONSTRUCTS
 // ================================================================================
 
 struct Begin : ExprBase {
+    static constexpr ExprType tag = E_BEGIN;
     std::vector<Expr> es;
     Begin(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
+/**
+ * @brief Quoted datum, converted from its syntax once when parsed
+ *
+ * Every evaluation returns the same shared Value, so quoted lists must be
+ * treated as immutable constants.
+ */
 struct Quote : ExprBase {
+  static constexpr ExprType tag = E_QUOTE;
   Syntax s;
+  Value datum;
   Quote(const Syntax &);
-  virtual Value eval(Assoc &) override;
+  Quote(const Value &);     // a datum restored from an image, without its syntax
+  virtual Value eval(Env &) override;
 };
 
+Value convertSyntaxToValue(const Syntax &);
+
 // ================================================================================
 //                             CONDITIONALS
 // ================================================================================
 
 struct If : ExprBase {
+  static constexpr ExprType tag = E_IF;
   Expr cond;
   Expr conseq;
   Expr alter;
   If(const Expr &, const Expr &, const Expr &);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
 };
 
 struct Cond : ExprBase {
+    static constexpr ExprType tag = E_COND;
     bool has_else;
     std::vector<std::vector<Expr>> clauses;
     Cond(const bool, const std::vector<std::vector<Expr>> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
 //                             VARIABLE AND FUNCITION DEFINITION
 // ================================================================================
 
+/**
+ * @brief Variable reference, resolved at parse time
+ * A local is found `depth` frames up in slot `index`; index -1 means a
+ * toplevel binding looked up by name in the outermost frame.
+ */
 struct Var : ExprBase {
-    std::string x;
-    Var(const std::string &);
-    virtual Value eval(Assoc &) override;
+    static constexpr ExprType tag = E_VAR;
+    SymbolId x;
+    int depth;
+    int index;
+    Var(SymbolId, int, int);
+    Var(const std::string &, int, int);
+    virtual Value eval(Env &) override;
 };
 
+/**
+ * @brief Procedure application
+ * `tail` is set by the parser when the call is in tail position of a
+ * lambda body; such calls hand their frame back to the caller's
+ * trampoline instead of growing the C++ stack.
+ *
+ * A call to a toplevel name keeps a monomorphic inline cache: the
+ * compound procedure it last reached, whose arity matched, together with
+ * the binding_epoch it was found in. While no toplevel binding changes,
+ * the call skips the lookup and the checks. The cache holds no reference;
+ * the binding keeps the procedure alive for as long as the epoch holds.
+ */
 struct Apply : ExprBase {
+    static constexpr ExprType tag = E_APPLY;
     Expr rator;
     std::vector<Expr> rand;
+    bool tail;
+    bool global_rator;          // rator is a Var bound at toplevel
+    uint64_t cached_epoch;      // 0 while nothing is cached
+    Procedure *cached_proc;
     Apply(const Expr &, const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct Lambda : ExprBase {
-    std::vector<std::string> x;
+    static constexpr ExprType tag = E_LAMBDA;
+    std::vector<SymbolId> x;
     Expr e;
-    Lambda(const std::vector<std::string> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    size_t frame_size;
+    std::shared_ptr<Chunk> code;    // compiled body, shared by its closures
+    SymbolId name;                  // binding it was defined under, for the profiler
+    bool local;                     // the body makes no closure, set by markLocalFrames
+    Lambda(const std::vector<SymbolId> &, const Expr &, size_t, SymbolId = -1);
+    virtual Value eval(Env &) override;
 };
 
+/**
+ * @brief Definition; index -1 defines at toplevel, otherwise it fills a
+ * slot of the innermost frame reserved by the parser
+ */
 struct Define : ExprBase {
-    std::string var;
+    static constexpr ExprType tag = E_DEFINE;
+    SymbolId var;
     Expr e;
-    Define(const std::string &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int index;
+    Define(SymbolId, const Expr &, int);
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -409,28 +734,48 @@ struct Define : ExprBase {
 // ================================================================================
 
 struct Let : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    static constexpr ExprType tag = E_LET;
+    std::vector<std::pair<SymbolId, Expr>> bind;
     Expr body;
-    Let(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    size_t frame_size;
+    bool local;                     // the body makes no closure, set by markLocalFrames
+    Let(const std::vector<std::pair<SymbolId, Expr>> &, const Expr &, size_t);
+    virtual Value eval(Env &) override;
 };
 
 struct Letrec : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    static constexpr ExprType tag = E_LETREC;
+    std::vector<std::pair<SymbolId, Expr>> bind;
     Expr body;
-    Letrec(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    size_t frame_size;
+    bool local;                     // no init or body form makes a closure
+    Letrec(const std::vector<std::pair<SymbolId, Expr>> &, const Expr &, size_t);
+    virtual Value eval(Env &) override;
 };
 
+/**
+ * @brief Escape analysis: flag the scopes whose frame no closure can capture
+ *
+ * Walks a parsed expression and sets `local` on every let, letrec and
+ * lambda whose body never evaluates a lambda, so their frames can be lent
+ * out by LocalFrame rather than allocated. Anything it does not know to be
+ * free of closures counts as making one. Returns whether evaluating the
+ * expression may create a closure.
+ */
+bool markLocalFrames(const Expr &);
+
 // ================================================================================
 //                             ASSIGNMENT
 // ================================================================================
 
 struct Set : ExprBase {
-    std::string var;
+    static constexpr ExprType tag = E_SET;
+    SymbolId var;
     Expr e;
-    Set(const std::string &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int depth;
+    int index;
+    Set(SymbolId, const Expr &, int, int);
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -442,4 +787,69 @@ struct Display : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+// ================================================================================
+//                             NATIVE PRIMITIVES
+// ================================================================================
+
+/**
+ * @brief Bind every builtin procedure into a toplevel environment
+ */
+void installPrimitives(Globals &);
+
+/**
+ * @brief The builtin procedure named x, or a null Value if there is none
+ */
+Value lookupPrimitive(SymbolId);
+
+/**
+ * @brief Drop this thread's builtin procedures; they are remade on demand
+ */
+void releasePrimitives();
+
+/**
+ * @brief Drop this thread's tail call marker after its last evaluation
+ *
+ * Left to thread exit, the marker would be freed after the heap is gone.
+ */
+void releaseTailCalls();
+
+/**
+ * @brief Call a memoized procedure on a frame holding its arguments
+ *
+ * Returns the cached result when there is one; otherwise runs the body to
+ * completion, tail calls included, and caches what it returns.
+ */
+Value callMemoized(Procedure *, Env &);
+
+// ================================================================================
+//                             STATIC DISPATCH
+// ================================================================================
+
+/**
+ * @brief Checked downcast of an expression keyed on its tags
+ *
+ * A node class with a `tag` is built with exactly that ExprType; the
+ * primitive bases are matched on their shape. Returns nullptr on a
+ * mismatch and never consults RTTI.
+ */
+template <class T>
+inline T *exprAs(const Expr &e) {
+    return e->e_type == T::tag ? static_cast<T*>(e.get()) : nullptr;
+}
+
+template <>
+inline Unary *exprAs<Unary>(const Expr &e) {
+    return e->shape == S_UNARY ? static_cast<Unary*>(e.get()) : nullptr;
+}
+
+template <>
+inline Binary *exprAs<Binary>(const Expr &e) {
+    return e->shape == S_BINARY ? static_cast<Binary*>(e.get()) : nullptr;
+}
+
+template <>
+inline Variadic *exprAs<Variadic>(const Expr &e) {
+    return e->shape == S_VARIADIC ? static_cast<Variadic*>(e.get()) : nullptr;
+}
+
 #endif
@@ -0,0 +1,260 @@
+/**
+ * @file gc.cpp
+ * @brief Arenas and the mark-sweep cycle collector
+ *
+ * A collection runs in four steps over the list of tracked objects:
+ *   1. copy every reference count into gc_refs;
+ *   2. subtract the references each object holds to other tracked ones;
+ *   3. mark everything reachable from objects left with gc_refs > 0,
+ *      i.e. those also referenced from outside the tracked heap;
+ *   4. sweep the rest: pin them, clear their references to break the
+ *      cycles, then drop the pins so the reference counts free them.
+ */
+
+#include "gc.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+const size_t MIN_THRESHOLD = 10000;     ///< Tracked objects before the first collection
+const size_t BLOCK_BYTES = 64 * 1024;   ///< Size of one arena block
+
+// plain structs so that they outlive every static Value during shutdown;
+// each thread collects its own objects, so the heap is per thread
+struct Heap {
+    GcObject *head;
+    size_t tracked;
+    size_t next_collection;
+    size_t collections;
+    size_t freed;
+    size_t allocated;
+    double total_ms;
+    double last_ms;
+    bool collecting;
+};
+
+thread_local Heap heap = {nullptr, 0, MIN_THRESHOLD, 0, 0, 0, 0.0, 0.0, false};
+
+thread_local std::vector<Arena*> *thread_arenas = nullptr;
+
+// objects waiting for gcFree to delete them, and whether one is running
+thread_local std::vector<GcObject*> *dying = nullptr;
+thread_local bool freeing = false;
+
+std::vector<Arena*> &arenas() {
+    if (thread_arenas == nullptr) {
+        thread_arenas = new std::vector<Arena*>();
+    }
+    return *thread_arenas;
+}
+
+struct Unmark : GcVisitor {
+    void operator()(GcObject *o) override {
+        if (o != nullptr && o->gc_tracked) {
+            --o->gc_refs;
+        }
+    }
+};
+
+struct Mark : GcVisitor {
+    std::vector<GcObject*> pending;
+    void operator()(GcObject *o) override {
+        if (o != nullptr && o->gc_tracked && !o->gc_marked) {
+            o->gc_marked = true;
+            pending.push_back(o);
+        }
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// GcObject
+// ============================================================================
+
+GcObject::GcObject()
+    : refs(0), gc_prev(nullptr), gc_next(nullptr), gc_refs(0),
+      gc_tracked(false), gc_marked(false) {
+    ++heap.allocated;
+}
+
+void GcObject::traverse(GcVisitor &) {}
+
+void GcObject::clear() {}
+
+GcObject::~GcObject() {
+    if (gc_tracked) {
+        gcUntrack(this);
+    }
+}
+
+void gcTrack(GcObject *o) {
+    // collect before linking the new object: it is still unowned here
+    if (heap.tracked >= heap.next_collection && !heap.collecting) {
+        gcCollect();
+    }
+    o->gc_prev = nullptr;
+    o->gc_next = heap.head;
+    if (heap.head != nullptr) {
+        heap.head->gc_prev = o;
+    }
+    heap.head = o;
+    o->gc_tracked = true;
+    ++heap.tracked;
+}
+
+void gcUntrack(GcObject *o) {
+    if (o->gc_prev != nullptr) {
+        o->gc_prev->gc_next = o->gc_next;
+    } else {
+        heap.head = o->gc_next;
+    }
+    if (o->gc_next != nullptr) {
+        o->gc_next->gc_prev = o->gc_prev;
+    }
+    o->gc_prev = o->gc_next = nullptr;
+    o->gc_tracked = false;
+    --heap.tracked;
+}
+
+void gcCollect() {
+    auto start = std::chrono::steady_clock::now();
+    heap.collecting = true;
+
+    for (GcObject *o = heap.head; o != nullptr; o = o->gc_next) {
+        o->gc_refs = (long)o->refs;
+        o->gc_marked = false;
+    }
+    Unmark unmark;
+    for (GcObject *o = heap.head; o != nullptr; o = o->gc_next) {
+        o->traverse(unmark);
+    }
+
+    Mark mark;
+    for (GcObject *o = heap.head; o != nullptr; o = o->gc_next) {
+        if (o->gc_refs > 0 && !o->gc_marked) {
+            o->gc_marked = true;
+            mark.pending.push_back(o);
+        }
+    }
+    while (!mark.pending.empty()) {
+        GcObject *o = mark.pending.back();
+        mark.pending.pop_back();
+        o->traverse(mark);
+    }
+
+    std::vector<GcObject*> garbage;
+    for (GcObject *o = heap.head; o != nullptr; o = o->gc_next) {
+        if (!o->gc_marked) {
+            garbage.push_back(o);
+        }
+    }
+    // pin the garbage so clearing one object cannot free another mid-sweep
+    for (GcObject *o : garbage) {
+        ++o->refs;
+    }
+    for (GcObject *o : garbage) {
+        o->clear();
+    }
+    for (GcObject *o : garbage) {
+        if (--o->refs == 0) {
+            gcFree(o);
+        }
+    }
+
+    heap.collecting = false;
+    heap.freed += garbage.size();
+    heap.collections += 1;
+    heap.next_collection = std::max(MIN_THRESHOLD, 2 * heap.tracked);
+    auto end = std::chrono::steady_clock::now();
+    heap.last_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    heap.total_ms += heap.last_ms;
+}
+
+void gcFree(GcObject *o) {
+    if (freeing) {
+        // inside another object's destructor: let the outer call do it
+        dying->push_back(o);
+        return;
+    }
+    if (dying == nullptr) {
+        dying = new std::vector<GcObject*>();
+    }
+    freeing = true;
+    delete o;
+    while (!dying->empty()) {
+        GcObject *next = dying->back();
+        dying->pop_back();
+        delete next;
+    }
+    freeing = false;
+}
+
+HeapStats gcStats() {
+    HeapStats stats;
+    stats.collections = heap.collections;
+    stats.tracked = heap.tracked;
+    stats.freed = heap.freed;
+    stats.allocated = heap.allocated;
+    stats.heap_bytes = 0;
+    stats.arena_live = 0;
+    for (Arena *arena : arenas()) {
+        stats.heap_bytes += arena->blocks.size() * BLOCK_BYTES;
+        stats.arena_live += arena->live;
+    }
+    stats.total_ms = heap.total_ms;
+    stats.last_ms = heap.last_ms;
+    return stats;
+}
+
+// ============================================================================
+// Arena
+// ============================================================================
+
+Arena::Arena(size_t size, Arena **owner)
+    : cell_size(std::max(size, sizeof(FreeCell))), bump(nullptr), limit(nullptr),
+      free_list(nullptr), live(0), owner(owner) {
+    // keep every cell aligned for the objects placed in it
+    cell_size = (cell_size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t)
+                * alignof(std::max_align_t);
+    arenas().push_back(this);
+}
+
+void Arena::grow() {
+    char *block = static_cast<char*>(std::malloc(BLOCK_BYTES));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    blocks.push_back(block);
+    bump = block;
+    limit = block + BLOCK_BYTES;
+}
+
+Arena::~Arena() {
+    for (char *block : blocks) {
+        std::free(block);
+    }
+}
+
+void gcReleaseArenas() {
+    std::vector<Arena*> &all = arenas();
+    std::vector<Arena*> kept;
+    for (Arena *arena : all) {
+        if (arena->live != 0) {
+            kept.push_back(arena);
+            continue;
+        }
+        *arena->owner = nullptr;
+        delete arena;
+    }
+    all.swap(kept);
+    if (all.empty()) {
+        delete thread_arenas;
+        thread_arenas = nullptr;
+        delete dying;
+        dying = nullptr;
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef GC_HPP
+#define GC_HPP
+
+/**
+ * @file gc.hpp
+ * @brief Heap subsystem: reference-counted objects, arenas and cycle collector
+ *
+ * Every heap object derives from GcObject and is owned through intrusive,
+ * non-atomic reference counts (Value, Env and Globals handles), which frees
+ * acyclic garbage as soon as it is dropped. Objects that can hold
+ * references (pairs, procedures, frames and toplevel bindings) are also
+ * tracked by a mark-sweep collector that reclaims unreachable cycles.
+ *
+ * The collector needs no explicit root set: an object is a root when its
+ * reference count exceeds the references held by other tracked objects.
+ * That makes the global environment, the VM stack and every Value living
+ * in an evaluator's C++ locals roots automatically.
+ *
+ * Since the counts are not atomic, heap objects never cross threads: the
+ * tracked list, the arenas and the counters below are all per thread, and
+ * an object must be released on the thread that made it.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Callback receiving the references held by a tracked object
+ */
+struct GcVisitor {
+    virtual void operator()(struct GcObject *) = 0;
+};
+
+/**
+ * @brief Header shared by all heap objects
+ */
+struct GcObject {
+    size_t refs;            ///< Owning handles (Value, Env, Globals)
+    GcObject *gc_prev;      ///< Neighbours in the list of tracked objects
+    GcObject *gc_next;
+    long gc_refs;           ///< Scratch count used while collecting
+    bool gc_tracked;        ///< Whether the collector knows this object
+    bool gc_marked;         ///< Reached from a root in the current cycle
+    GcObject();
+    virtual void traverse(GcVisitor &);   ///< Report owned references
+    virtual void clear();                 ///< Drop owned references
+    virtual ~GcObject();
+};
+
+void gcTrack(GcObject *);
+void gcUntrack(GcObject *);
+void gcCollect();
+
+/**
+ * @brief Delete an object whose last owning handle is gone
+ *
+ * Objects it owned that die along with it are queued and deleted one
+ * after another rather than from inside its destructor, so dropping a
+ * long list or a long chain of frames takes constant C++ stack.
+ */
+void gcFree(GcObject *);
+
+/**
+ * @brief Free this thread's arenas that hold no live cell
+ *
+ * For a thread that is done with the heap, once its objects are gone. An
+ * owner slot that pointed at a freed arena is reset to nullptr, so its
+ * next allocation makes a new one.
+ */
+void gcReleaseArenas();
+
+/**
+ * @brief Counters reported by (gc-stats)
+ */
+struct HeapStats {
+    size_t collections;     ///< Completed collection cycles
+    size_t tracked;         ///< Live objects known to the collector
+    size_t freed;           ///< Objects reclaimed by the collector in total
+    size_t allocated;       ///< Heap objects created in total
+    size_t heap_bytes;      ///< Bytes reserved by all arenas
+    size_t arena_live;      ///< Arena cells currently in use
+    double total_ms;        ///< Time spent collecting
+    double last_ms;         ///< Duration of the latest collection
+};
+
+HeapStats gcStats();
+
+/**
+ * @brief Intrusive owning handle to a heap object
+ */
+template <class T>
+struct GcRef {
+    T *ptr;
+    GcRef(T *p) : ptr(p) {
+        if (ptr != nullptr) ++ptr->refs;
+    }
+    GcRef(const GcRef &other) : ptr(other.ptr) {
+        if (ptr != nullptr) ++ptr->refs;
+    }
+    GcRef(GcRef &&other) noexcept : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+    GcRef &operator=(const GcRef &other) {
+        GcRef copy(other);
+        std::swap(ptr, copy.ptr);
+        return *this;
+    }
+    GcRef &operator=(GcRef &&other) noexcept {
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+    ~GcRef() {
+        if (ptr != nullptr && --ptr->refs == 0) gcFree(ptr);
+    }
+    T* operator->() const { return ptr; }
+    T& operator*() { return *ptr; }
+    T* get() const { return ptr; }
+};
+
+/**
+ * @brief Bump-pointer allocator for objects of one size
+ *
+ * Cells are carved from large blocks and recycled through a free list,
+ * so allocating a pair or a call frame is a pointer bump in the common
+ * case. Blocks stay with the arena until the thread's heap is released
+ * by gcReleaseArenas.
+ */
+class Arena {
+public:
+    Arena(size_t cell_size, Arena **owner);
+    ~Arena();
+    void *allocate() {
+        ++live;
+        if (free_list != nullptr) {
+            FreeCell *cell = free_list;
+            free_list = cell->next;
+            return cell;
+        }
+        if (bump == nullptr || bump + cell_size > limit) {
+            grow();
+        }
+        void *cell = bump;
+        bump += cell_size;
+        return cell;
+    }
+    void release(void *p) {
+        --live;
+        FreeCell *cell = static_cast<FreeCell*>(p);
+        cell->next = free_list;
+        free_list = cell;
+    }
+
+private:
+    struct FreeCell {
+        FreeCell *next;
+    };
+    void grow();            ///< Start a fresh block to bump from
+    size_t cell_size;
+    char *bump;
+    char *limit;
+    FreeCell *free_list;
+    std::vector<char*> blocks;
+    size_t live;
+    Arena **owner;          ///< Slot holding this arena, cleared when it is released
+    friend HeapStats gcStats();
+    friend void gcReleaseArenas();
+};
+
+#endif // GC_HPP
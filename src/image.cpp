@@ -0,0 +1,1242 @@
+/**
+ * @file image.cpp
+ * @brief Writer and mapped loader of environment images
+ *
+ * An image is a magic word and a format version followed by five
+ * sections, each a count and that many records:
+ *   1. SYMBOLS  names used anywhere below, re-interned on load;
+ *   2. OBJECTS  one shell per heap value or frame, holding its scalar
+ *               payload (digits, string bytes, slot count...);
+ *   3. EXPRS    expression nodes in post-order, children first;
+ *   4. LINKS    the references of composite objects (pairs, vectors,
+ *               hash tables, promises, closures, frames), patched once
+ *               every shell exists, which is what
+ *               lets cycles through set-car! or letrec round-trip;
+ *   5. GLOBALS  the toplevel bindings, by name.
+ * Integers are LEB128 varints, zigzag-coded when signed. A value
+ * reference is 0 for a null Value, otherwise its low two bits select a
+ * heap object (index + 1), a fixnum or one of the constant immediates.
+ */
+
+#include "image.hpp"
+#include "expr.hpp"
+#include "RE.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern const std::map<std::string, ExprType> primitives;
+
+namespace {
+
+const char IMAGE_MAGIC[4] = {'S', 'C', 'M', 'I'};
+const uint64_t IMAGE_VERSION = 7;
+
+enum ObjectKind : uint8_t {
+    K_BIGINT,
+    K_RATIONAL,
+    K_SYMBOL,
+    K_STRING,
+    K_PAIR,
+    K_VECTOR,
+    K_HASHTABLE,
+    K_PROMISE,
+    K_PROC,
+    K_PRIMITIVE,
+    K_TERMINATE,
+    K_FRAME,
+    K_ROOT_FRAME
+};
+
+enum RefTag : uint64_t {
+    R_HEAP   = 0,
+    R_FIXNUM = 1,
+    R_CONST  = 2
+};
+
+uint64_t zigzag(int64_t n) {
+    return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+int64_t unzigzag(uint64_t n) {
+    return static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+}
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+struct Buffer {
+    std::string bytes;
+    uint64_t count = 0;     ///< Records written
+
+    void byte(uint8_t b) { bytes.push_back(static_cast<char>(b)); }
+    void varint(uint64_t n) {
+        while (n >= 0x80) {
+            byte(static_cast<uint8_t>(n | 0x80));
+            n >>= 7;
+        }
+        byte(static_cast<uint8_t>(n));
+    }
+    void svarint(int64_t n) { varint(zigzag(n)); }
+    void string(const std::string &s) {
+        varint(s.size());
+        bytes.append(s);
+    }
+};
+
+class ImageWriter {
+public:
+    explicit ImageWriter(Env &root) : root(root.get()) {}
+
+    std::string write() {
+        Globals &bindings = root->globals;
+        for (SymbolId x = 0; x < (SymbolId)bindings->values.size(); ++x) {
+            if (!bound(x, bindings)) {
+                continue;
+            }
+            uint64_t name = symbol(x);
+            uint64_t value = ref(find(x, bindings));
+            globals.varint(name);
+            globals.varint(value);
+            ++globals.count;
+        }
+        // linking an object can discover more of them, through a closure's
+        // body or a frame's slots, so drain until nothing is pending
+        while (!pending.empty()) {
+            Pending next = pending.back();
+            pending.pop_back();
+            if (next.frame) {
+                linkFrame(static_cast<Frame*>(next.object));
+            } else {
+                linkValue(static_cast<ValueBase*>(next.object));
+            }
+        }
+
+        Buffer out;
+        out.bytes.append(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        out.varint(IMAGE_VERSION);
+        for (Buffer *section : {&symbols, &objects, &exprs, &links, &globals}) {
+            out.varint(section->count);
+            out.bytes.append(section->bytes);
+        }
+        return out.bytes;
+    }
+
+private:
+    struct Pending {
+        void *object;
+        bool frame;
+    };
+
+    Frame *root;
+    Buffer symbols, objects, exprs, links, globals;
+    std::map<SymbolId, uint64_t> symbol_index;
+    std::map<const void*, uint64_t> object_index;
+    std::map<const ExprBase*, uint64_t> expr_index;
+    std::vector<Pending> pending;       ///< Composite objects still to link
+
+    uint64_t symbol(SymbolId x) {
+        auto it = symbol_index.find(x);
+        if (it != symbol_index.end()) {
+            return it->second;
+        }
+        symbols.string(symbolName(x));
+        return symbol_index[x] = symbols.count++;
+    }
+
+    // procedure names are optional: 0 for none, else the symbol index + 1
+    uint64_t optionalSymbol(SymbolId x) {
+        return x < 0 ? 0 : symbol(x) + 1;
+    }
+
+    // false the first time an object is seen, after numbering it; its
+    // shell must then be written before anything else is numbered
+    bool known(const void *o, uint64_t &index) {
+        auto it = object_index.find(o);
+        if (it != object_index.end()) {
+            index = it->second;
+            return true;
+        }
+        index = object_index[o] = objects.count++;
+        return false;
+    }
+
+    uint64_t ref(const Value &v) {
+        if (v.isFixnum()) {
+            return (zigzag(v.fixnum()) << 2) | R_FIXNUM;
+        }
+        if (!v.isHeap()) {
+            return v.bits == 0 ? 0 : ((v.bits >> 3) << 2) | R_CONST;
+        }
+        ValueBase *o = v.get();
+        uint64_t index;
+        if (known(o, index)) {
+            return (index + 1) << 2;
+        }
+        switch (o->v_type) {
+            case V_BIGINT:
+                objects.byte(K_BIGINT);
+                objects.string(static_cast<BigInteger*>(o)->n.toString());
+                break;
+            case V_RATIONAL:
+                objects.byte(K_RATIONAL);
+                objects.string(static_cast<Rational*>(o)->numerator.toString());
+                objects.string(static_cast<Rational*>(o)->denominator.toString());
+                break;
+            case V_SYM: {
+                uint64_t name = symbol(static_cast<Symbol*>(o)->id);
+                objects.byte(K_SYMBOL);
+                objects.varint(name);
+                break;
+            }
+            case V_STRING:
+                objects.byte(K_STRING);
+                objects.string(static_cast<String*>(o)->s);
+                break;
+            case V_PAIR:
+                objects.byte(K_PAIR);
+                pending.push_back({o, false});
+                break;
+            case V_VECTOR:
+                objects.byte(K_VECTOR);
+                objects.varint(static_cast<Vector*>(o)->items.size());
+                pending.push_back({o, false});
+                break;
+            case V_HASHTABLE:
+                objects.byte(K_HASHTABLE);
+                pending.push_back({o, false});
+                break;
+            case V_PROMISE:
+                objects.byte(K_PROMISE);
+                pending.push_back({o, false});
+                break;
+            case V_PROC:
+                objects.byte(K_PROC);
+                pending.push_back({o, false});
+                break;
+            case V_PRIMITIVE: {
+                uint64_t name = symbol(static_cast<Primitive*>(o)->name);
+                objects.byte(K_PRIMITIVE);
+                objects.varint(name);
+                break;
+            }
+            case V_TERMINATE:
+                objects.byte(K_TERMINATE);
+                break;
+            default:
+                throw RuntimeError("image: value cannot be saved");
+        }
+        return (index + 1) << 2;
+    }
+
+    uint64_t ref(const Env &env) {
+        Frame *f = env.get();
+        if (f == nullptr) {
+            return 0;
+        }
+        uint64_t index;
+        if (known(f, index)) {
+            return (index + 1) << 2;
+        }
+        if (f == root) {
+            objects.byte(K_ROOT_FRAME);
+        } else {
+            objects.byte(K_FRAME);
+            objects.varint(f->slots.size());
+            pending.push_back({f, true});
+        }
+        return (index + 1) << 2;
+    }
+
+    // refs only write shells and exprs, never links, so a link record can
+    // be written field by field
+    void linkValue(ValueBase *o) {
+        links.varint(object_index[o]);
+        if (o->v_type == V_PAIR) {
+            Pair *p = static_cast<Pair*>(o);
+            links.varint(ref(p->car));
+            links.varint(ref(p->cdr));
+        } else if (o->v_type == V_VECTOR) {
+            for (const Value &v : static_cast<Vector*>(o)->items) {
+                links.varint(ref(v));
+            }
+        } else if (o->v_type == V_HASHTABLE) {
+            HashTable *table = static_cast<HashTable*>(o);
+            links.varint(table->count);
+            for (size_t i = 0; i < table->keys.size(); ++i) {
+                if (table->keys[i].bits != 0) {
+                    links.varint(ref(table->keys[i]));
+                    links.varint(ref(table->values[i]));
+                }
+            }
+        } else if (o->v_type == V_PROMISE) {
+            // a forced promise is saved as its value alone
+            Promise *promise = static_cast<Promise*>(o);
+            links.byte(promise->forced());
+            if (promise->forced()) {
+                links.varint(ref(promise->value));
+            } else {
+                links.varint(expr(promise->e));
+                links.varint(ref(promise->env));
+            }
+        } else {
+            Procedure *proc = static_cast<Procedure*>(o);
+            params(links, proc->parameters);
+            links.varint(expr(proc->e));
+            links.varint(ref(proc->env));
+            links.varint(proc->frame_size);
+            links.varint(optionalSymbol(proc->name));
+            // a memoized procedure comes back with an empty cache
+            links.varint(proc->memo ? proc->memo->capacity : 0);
+        }
+        ++links.count;
+    }
+
+    void linkFrame(Frame *f) {
+        links.varint(object_index[f]);
+        for (const Value &v : f->slots) {
+            links.varint(ref(v));
+        }
+        links.varint(ref(f->parent));
+        ++links.count;
+    }
+
+    void params(Buffer &out, const std::vector<SymbolId> &xs) {
+        out.varint(xs.size());
+        for (SymbolId x : xs) {
+            out.varint(symbol(x));
+        }
+    }
+
+    void exprList(Buffer &out, const std::vector<Expr> &es) {
+        out.varint(es.size());
+        for (const Expr &e : es) {
+            out.varint(expr(e));
+        }
+    }
+
+    void bindings(Buffer &out, const std::vector<std::pair<SymbolId, Expr>> &bind) {
+        out.varint(bind.size());
+        for (const auto &b : bind) {
+            out.varint(symbol(b.first));
+            out.varint(expr(b.second));
+        }
+    }
+
+    // index + 1 of a node, or 0 for none; children are written first
+    uint64_t expr(const Expr &e) {
+        ExprBase *node = e.get();
+        if (node == nullptr) {
+            return 0;
+        }
+        auto it = expr_index.find(node);
+        if (it != expr_index.end()) {
+            return it->second + 1;
+        }
+        Buffer rec;     // built aside while the children land in exprs
+        rec.byte(node->e_type);
+        rec.byte(node->shape);
+        if (Unary *u = exprAs<Unary>(e)) {
+            rec.varint(expr(u->rand));
+        } else if (Binary *b = exprAs<Binary>(e)) {
+            rec.varint(expr(b->rand1));
+            rec.varint(expr(b->rand2));
+        } else if (Variadic *v = exprAs<Variadic>(e)) {
+            exprList(rec, v->rands);
+            if (ApplyFunc *apply = exprAs<ApplyFunc>(e)) {
+                rec.byte(apply->tail);
+            }
+        } else {
+            switch (node->e_type) {
+                case E_FIXNUM:
+                    rec.varint(ref(static_cast<Fixnum*>(node)->datum));
+                    break;
+                case E_RATIONAL:
+                    rec.varint(ref(static_cast<RationalNum*>(node)->datum));
+                    break;
+                case E_STRING:
+                    rec.varint(ref(static_cast<StringExpr*>(node)->datum));
+                    break;
+                case E_TRUE:
+                case E_FALSE:
+                case E_VOID:
+                case E_EXIT:
+                case E_GCSTATS:
+                case E_RUNTIMESTATS:
+                    break;
+                case E_QUOTE:
+                    rec.varint(ref(static_cast<Quote*>(node)->datum));
+                    break;
+                case E_PROFILE:
+                    rec.varint(expr(static_cast<Profile*>(node)->e));
+                    break;
+                case E_DELAY:
+                    rec.varint(expr(static_cast<Delay*>(node)->e));
+                    break;
+                case E_AND:
+                    exprList(rec, static_cast<AndVar*>(node)->rands);
+                    break;
+                case E_OR:
+                    exprList(rec, static_cast<OrVar*>(node)->rands);
+                    break;
+                case E_BEGIN:
+                    exprList(rec, static_cast<Begin*>(node)->es);
+                    break;
+                case E_IF: {
+                    If *i = static_cast<If*>(node);
+                    rec.varint(expr(i->cond));
+                    rec.varint(expr(i->conseq));
+                    rec.varint(expr(i->alter));
+                    break;
+                }
+                case E_COND: {
+                    Cond *c = static_cast<Cond*>(node);
+                    rec.byte(c->has_else);
+                    rec.varint(c->clauses.size());
+                    for (const std::vector<Expr> &clause : c->clauses) {
+                        exprList(rec, clause);
+                    }
+                    break;
+                }
+                case E_VAR: {
+                    Var *var = static_cast<Var*>(node);
+                    rec.varint(symbol(var->x));
+                    rec.svarint(var->depth);
+                    rec.svarint(var->index);
+                    break;
+                }
+                case E_APPLY: {
+                    Apply *apply = static_cast<Apply*>(node);
+                    rec.varint(expr(apply->rator));
+                    exprList(rec, apply->rand);
+                    rec.byte(apply->tail);
+                    break;
+                }
+                case E_LAMBDA: {
+                    Lambda *lambda = static_cast<Lambda*>(node);
+                    params(rec, lambda->x);
+                    rec.varint(expr(lambda->e));
+                    rec.varint(lambda->frame_size);
+                    rec.varint(optionalSymbol(lambda->name));
+                    break;
+                }
+                case E_DEFINE: {
+                    Define *define = static_cast<Define*>(node);
+                    rec.varint(symbol(define->var));
+                    rec.varint(expr(define->e));
+                    rec.svarint(define->index);
+                    break;
+                }
+                case E_LET: {
+                    Let *let = static_cast<Let*>(node);
+                    bindings(rec, let->bind);
+                    rec.varint(expr(let->body));
+                    rec.varint(let->frame_size);
+                    break;
+                }
+                case E_LETREC: {
+                    Letrec *letrec = static_cast<Letrec*>(node);
+                    bindings(rec, letrec->bind);
+                    rec.varint(expr(letrec->body));
+                    rec.varint(letrec->frame_size);
+                    break;
+                }
+                case E_SET: {
+                    Set *set = static_cast<Set*>(node);
+                    rec.varint(symbol(set->var));
+                    rec.varint(expr(set->e));
+                    rec.svarint(set->depth);
+                    rec.svarint(set->index);
+                    break;
+                }
+                default:
+                    throw RuntimeError("image: expression cannot be saved");
+            }
+        }
+        exprs.bytes.append(rec.bytes);
+        uint64_t index = exprs.count++;
+        expr_index[node] = index;
+        return index + 1;
+    }
+};
+
+// ============================================================================
+// Loader
+// ============================================================================
+
+struct Cursor {
+    const uint8_t *pos;
+    const uint8_t *end;
+
+    uint8_t byte() {
+        if (pos == end) {
+            throw RuntimeError("image: truncated");
+        }
+        return *pos++;
+    }
+    uint64_t varint() {
+        uint64_t n = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            n |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return n;
+            }
+        }
+        throw RuntimeError("image: bad varint");
+    }
+    int64_t svarint() { return unzigzag(varint()); }
+    std::string string() {
+        uint64_t n = varint();
+        if (n > static_cast<uint64_t>(end - pos)) {
+            throw RuntimeError("image: truncated");
+        }
+        std::string s(reinterpret_cast<const char*>(pos), n);
+        pos += n;
+        return s;
+    }
+};
+
+Expr makeUnary(ExprType type, const Expr &rand) {
+    switch (type) {
+        case E_CAR:     return Expr(new Car(rand));
+        case E_CDR:     return Expr(new Cdr(rand));
+        case E_NOT:     return Expr(new Not(rand));
+        case E_BOOLQ:   return Expr(new IsBoolean(rand));
+        case E_INTQ:    return Expr(new IsFixnum(rand));
+        case E_NULLQ:   return Expr(new IsNull(rand));
+        case E_PAIRQ:   return Expr(new IsPair(rand));
+        case E_PROCQ:   return Expr(new IsProcedure(rand));
+        case E_SYMBOLQ: return Expr(new IsSymbol(rand));
+        case E_LISTQ:   return Expr(new IsList(rand));
+        case E_STRINGQ: return Expr(new IsString(rand));
+        case E_VECTORQ: return Expr(new IsVector(rand));
+        case E_HASHTABLEQ: return Expr(new IsHashTable(rand));
+        case E_PROMISEQ: return Expr(new IsPromise(rand));
+        case E_LENGTH:  return Expr(new Length(rand));
+        case E_REVERSE: return Expr(new Reverse(rand));
+        case E_VECTORLENGTH: return Expr(new VectorLength(rand));
+        case E_HASHCOUNT: return Expr(new HashCount(rand));
+        case E_MEMOSTATS: return Expr(new MemoStats(rand));
+        case E_FORCE:   return Expr(new Force(rand));
+        case E_STREAMCAR: return Expr(new StreamCar(rand));
+        case E_STREAMCDR: return Expr(new StreamCdr(rand));
+        case E_DISPLAY: return Expr(new Display(rand));
+        default:        throw RuntimeError("image: bad expression");
+    }
+}
+
+Expr makeBinary(ExprType type, const Expr &rand1, const Expr &rand2) {
+    switch (type) {
+        case E_PLUS:    return makeArithmetic(type, rand1, rand2);
+        case E_MINUS:   return makeArithmetic(type, rand1, rand2);
+        case E_MUL:     return makeArithmetic(type, rand1, rand2);
+        case E_DIV:     return Expr(new Div(rand1, rand2));
+        case E_MODULO:  return Expr(new Modulo(rand1, rand2));
+        case E_EXPT:    return Expr(new Expt(rand1, rand2));
+        case E_LT:      return makeArithmetic(type, rand1, rand2);
+        case E_LE:      return makeArithmetic(type, rand1, rand2);
+        case E_EQ:      return makeArithmetic(type, rand1, rand2);
+        case E_GE:      return makeArithmetic(type, rand1, rand2);
+        case E_GT:      return makeArithmetic(type, rand1, rand2);
+        case E_CONS:    return Expr(new Cons(rand1, rand2));
+        case E_SETCAR:  return Expr(new SetCar(rand1, rand2));
+        case E_SETCDR:  return Expr(new SetCdr(rand1, rand2));
+        case E_EQQ:     return Expr(new IsEq(rand1, rand2));
+        case E_VECTORREF: return Expr(new VectorRef(rand1, rand2));
+        default:        throw RuntimeError("image: bad expression");
+    }
+}
+
+Expr makeVariadic(ExprType type, const std::vector<Expr> &rands) {
+    switch (type) {
+        case E_PLUS:    return Expr(new PlusVar(rands));
+        case E_MINUS:   return Expr(new MinusVar(rands));
+        case E_MUL:     return Expr(new MultVar(rands));
+        case E_DIV:     return Expr(new DivVar(rands));
+        case E_LT:      return Expr(new LessVar(rands));
+        case E_LE:      return Expr(new LessEqVar(rands));
+        case E_EQ:      return Expr(new EqualVar(rands));
+        case E_GE:      return Expr(new GreaterEqVar(rands));
+        case E_GT:      return Expr(new GreaterVar(rands));
+        case E_LIST:    return Expr(new ListFunc(rands));
+        case E_APPEND:  return Expr(new Append(rands));
+        case E_APPLYFUNC: return Expr(new ApplyFunc(rands));
+        case E_MAP:     return Expr(new Map(rands));
+        case E_FOREACH: return Expr(new ForEach(rands));
+        case E_FOLDLEFT: return Expr(new FoldLeft(rands));
+        case E_MAKEVECTOR: return Expr(new MakeVector(rands));
+        case E_VECTOR:  return Expr(new VectorFunc(rands));
+        case E_VECTORSET: return Expr(new VectorSet(rands));
+        case E_MAKEHASHTABLE: return Expr(new MakeHashTable(rands));
+        case E_HASHREF: return Expr(new HashRef(rands));
+        case E_MEMOIZE: return Expr(new Memoize(rands));
+        case E_HASHSET: return Expr(new HashSet(rands));
+        default:        throw RuntimeError("image: bad expression");
+    }
+}
+
+class ImageLoader {
+public:
+    ImageLoader(const uint8_t *data, size_t size, Env &root) : in{data, data + size}, root(root) {}
+
+    void load() {
+        if (static_cast<size_t>(in.end - in.pos) < sizeof(IMAGE_MAGIC) ||
+            std::memcmp(in.pos, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) {
+            throw RuntimeError("image: not an image file");
+        }
+        in.pos += sizeof(IMAGE_MAGIC);
+        if (in.varint() != IMAGE_VERSION) {
+            throw RuntimeError("image: unsupported version");
+        }
+
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            symbols.push_back(intern(in.string()));
+        }
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            objects.push_back(shell());
+        }
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            exprs.push_back(node());
+        }
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            link();
+        }
+
+        Globals globals = makeGlobals();
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            SymbolId x = symbol();
+            insert(x, value(in.varint()), globals);
+        }
+        if (in.pos != in.end) {
+            throw RuntimeError("image: trailing data");
+        }
+        linked.resize(objects.size(), false);
+        for (size_t i = 0; i < objects.size(); ++i) {
+            if (needsLink(objects[i], root) && !linked[i]) {
+                throw RuntimeError("image: missing link");
+            }
+        }
+        for (const Object &o : objects) {
+            checkScopes(o);
+        }
+        root->globals = globals;
+    }
+
+private:
+    /// A restored heap object: exactly one of the two handles is set
+    struct Object {
+        Value v;
+        Env f;
+    };
+
+    Cursor in;
+    Env &root;
+    std::vector<SymbolId> symbols;
+    std::vector<Object> objects;    // also keeps everything alive while loading
+    std::vector<bool> linked;       // objects whose link record has been read
+    std::vector<Expr> exprs;
+
+    SymbolId symbol() {
+        uint64_t index = in.varint();
+        if (index >= symbols.size()) {
+            throw RuntimeError("image: bad symbol");
+        }
+        return symbols[index];
+    }
+
+    SymbolId optionalSymbol() {
+        uint64_t index = in.varint();
+        if (index > symbols.size()) {
+            throw RuntimeError("image: bad symbol");
+        }
+        return index == 0 ? -1 : symbols[index - 1];
+    }
+
+    Object &object(uint64_t r) {
+        uint64_t index = (r >> 2) - 1;
+        if ((r & 3) != R_HEAP || r == 0 || index >= objects.size()) {
+            throw RuntimeError("image: bad reference");
+        }
+        return objects[index];
+    }
+
+    Value value(uint64_t r) {
+        if (r == 0) {
+            return Value(nullptr);
+        }
+        switch (r & 3) {
+            case R_FIXNUM:
+                return IntegerV(static_cast<NumericType>(unzigzag(r >> 2)));
+            case R_CONST: {
+                uint64_t k = r >> 2;
+                if (k < 1 || k > 4) {
+                    throw RuntimeError("image: bad reference");
+                }
+                return Value::immediate((k << 3) | Value::CONST_TAG);
+            }
+            default: {
+                Object &o = object(r);
+                if (o.v.get() == nullptr) {
+                    throw RuntimeError("image: bad reference");
+                }
+                return o.v;
+            }
+        }
+    }
+
+    // a field no live object leaves unassigned: list and vector elements,
+    // table entries, literals and forced promises
+    Value datum(uint64_t r) {
+        Value v = value(r);
+        if (v.get() == nullptr) {
+            throw RuntimeError("image: bad reference");
+        }
+        return v;
+    }
+
+    Env frame(uint64_t r) {
+        if (r == 0) {
+            return Env(nullptr);
+        }
+        Object &o = object(r);
+        if (o.f.get() == nullptr) {
+            throw RuntimeError("image: bad reference");
+        }
+        return o.f;
+    }
+
+    // every child of a node and every body is present, so 0 is rejected
+    Expr expr(uint64_t r) {
+        if (r == 0 || r > exprs.size()) {
+            throw RuntimeError("image: bad expression");
+        }
+        return exprs[r - 1];
+    }
+
+    std::vector<SymbolId> params() {
+        std::vector<SymbolId> xs;
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            xs.push_back(symbol());
+        }
+        return xs;
+    }
+
+    std::vector<Expr> exprList() {
+        std::vector<Expr> es;
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            es.push_back(expr(in.varint()));
+        }
+        return es;
+    }
+
+    std::vector<std::pair<SymbolId, Expr>> bindings() {
+        std::vector<std::pair<SymbolId, Expr>> bind;
+        for (uint64_t n = in.varint(); n > 0; --n) {
+            SymbolId x = symbol();
+            bind.push_back(std::make_pair(x, expr(in.varint())));
+        }
+        return bind;
+    }
+
+    // a decimal integer as written by BigInt::toString
+    BigInt integer() {
+        std::string digits = in.string();
+        size_t i = !digits.empty() && digits[0] == '-' ? 1 : 0;
+        if (i == digits.size()) {
+            throw RuntimeError("image: bad number");
+        }
+        for (; i < digits.size(); ++i) {
+            if (digits[i] < '0' || digits[i] > '9') {
+                throw RuntimeError("image: bad number");
+            }
+        }
+        return BigInt::parse(digits);
+    }
+
+    // the length of a vector or frame, whose link record then holds at
+    // least one byte per element
+    size_t count() {
+        uint64_t n = in.varint();
+        if (n > static_cast<uint64_t>(in.end - in.pos)) {
+            throw RuntimeError("image: truncated");
+        }
+        return n;
+    }
+
+    Object shell() {
+        Object o = {Value(nullptr), Env(nullptr)};
+        switch (in.byte()) {
+            case K_BIGINT:
+                o.v = IntegerV(integer());
+                break;
+            case K_RATIONAL: {
+                BigInt num = integer();
+                BigInt den = integer();
+                // stored reduced, with the sign on the numerator
+                if (den.isZero() || den.isNegative()) {
+                    throw RuntimeError("image: bad rational");
+                }
+                o.v = RationalV(num, den);
+                break;
+            }
+            case K_SYMBOL:
+                o.v = SymbolV(symbol());
+                break;
+            case K_STRING:
+                o.v = StringV(in.string());
+                break;
+            case K_PAIR:
+                o.v = PairV(Value(nullptr), Value(nullptr));
+                break;
+            case K_VECTOR:
+                o.v = VectorV(count(), Value(nullptr));
+                break;
+            case K_HASHTABLE:
+                o.v = HashTableV();
+                break;
+            case K_PROMISE:
+                o.v = PromiseV(Expr(nullptr), Env(nullptr));
+                break;
+            case K_PROC:
+                o.v = ProcedureV(std::vector<SymbolId>(), Expr(nullptr), Env(nullptr), 0);
+                break;
+            case K_PRIMITIVE: {
+                SymbolId name = symbol();
+                o.v = lookupPrimitive(name);
+                if (o.v.get() == nullptr) {
+                    throw RuntimeError("image: unknown builtin " + symbolName(name));
+                }
+                break;
+            }
+            case K_TERMINATE:
+                o.v = TerminateV();
+                break;
+            case K_FRAME:
+                o.f = makeFrame(count(), Env(nullptr));
+                break;
+            case K_ROOT_FRAME:
+                o.f = root;
+                break;
+            default:
+                throw RuntimeError("image: bad object");
+        }
+        return o;
+    }
+
+    /**
+     * Every variable a body refers to must exist in the frames it will run
+     * in: those of its enclosing lets and lambdas inside it, then the frame
+     * the procedure is called in, then the captured frames out to the
+     * root. Sizes are kept innermost last; the first is the root's, whose
+     * depth toplevel names are resolved at.
+     */
+    using Sizes = std::vector<size_t>;
+
+    void checkScopes(const Object &o) {
+        Sizes sizes;
+        if (Procedure *proc = o.v.get() ? valueAs<Procedure>(o.v) : nullptr) {
+            frameSizes(proc->env.get(), sizes);
+            sizes.push_back(proc->frame_size);
+            checkScopes(proc->e, sizes);
+        } else if (Promise *promise = o.v.get() ? valueAs<Promise>(o.v) : nullptr) {
+            if (!promise->forced()) {
+                frameSizes(promise->env.get(), sizes);
+                checkScopes(promise->e, sizes);
+            }
+        }
+    }
+
+    void frameSizes(Frame *f, Sizes &sizes) {
+        for (; f != root.get(); f = f->parent.get()) {
+            // a parent chain that loops never reaches the root
+            if (sizes.size() > objects.size()) {
+                throw RuntimeError("image: bad frame");
+            }
+            sizes.push_back(f->slots.size());
+        }
+        sizes.push_back(root->slots.size());
+        std::reverse(sizes.begin(), sizes.end());
+    }
+
+    // a variable at (depth, index), or with index -1 a toplevel name
+    static void checkSlot(const Sizes &sizes, int depth, int index) {
+        const size_t levels = sizes.size();
+        bool ok = index < 0 ? (size_t)depth + 1 == levels
+                            : (size_t)depth < levels && (size_t)index < sizes[levels - 1 - depth];
+        if (!ok) {
+            throw RuntimeError("image: bad variable");
+        }
+    }
+
+    void checkScopes(const Expr &e, Sizes &sizes) {
+        if (auto var = exprAs<Var>(e)) {
+            checkSlot(sizes, var->depth, var->index);
+        } else if (auto set = exprAs<Set>(e)) {
+            checkSlot(sizes, set->depth, set->index);
+            checkScopes(set->e, sizes);
+        } else if (auto define = exprAs<Define>(e)) {
+            // a toplevel define only runs in the root frame itself, an
+            // internal one has a slot in the current frame
+            if (define->index < 0 ? sizes.size() != 1 : (size_t)define->index >= sizes.back()) {
+                throw RuntimeError("image: bad variable");
+            }
+            checkScopes(define->e, sizes);
+        } else if (auto lambda = exprAs<Lambda>(e)) {
+            if (lambda->frame_size < lambda->x.size()) {
+                throw RuntimeError("image: bad expression");
+            }
+            sizes.push_back(lambda->frame_size);
+            checkScopes(lambda->e, sizes);
+            sizes.pop_back();
+        } else if (auto let = exprAs<Let>(e)) {
+            if (let->frame_size < let->bind.size()) {
+                throw RuntimeError("image: bad expression");
+            }
+            for (const auto &b : let->bind) {
+                checkScopes(b.second, sizes);
+            }
+            sizes.push_back(let->frame_size);
+            checkScopes(let->body, sizes);
+            sizes.pop_back();
+        } else if (auto letrec = exprAs<Letrec>(e)) {
+            if (letrec->frame_size < letrec->bind.size()) {
+                throw RuntimeError("image: bad expression");
+            }
+            sizes.push_back(letrec->frame_size);
+            for (const auto &b : letrec->bind) {
+                checkScopes(b.second, sizes);
+            }
+            checkScopes(letrec->body, sizes);
+            sizes.pop_back();
+        } else if (auto unary = exprAs<Unary>(e)) {
+            checkScopes(unary->rand, sizes);
+        } else if (auto binary = exprAs<Binary>(e)) {
+            checkScopes(binary->rand1, sizes);
+            checkScopes(binary->rand2, sizes);
+        } else if (auto variadic = exprAs<Variadic>(e)) {
+            checkEach(variadic->rands, sizes);
+        } else if (auto apply = exprAs<Apply>(e)) {
+            checkScopes(apply->rator, sizes);
+            checkEach(apply->rand, sizes);
+        } else if (auto if_expr = exprAs<If>(e)) {
+            checkScopes(if_expr->cond, sizes);
+            checkScopes(if_expr->conseq, sizes);
+            checkScopes(if_expr->alter, sizes);
+        } else if (auto cond = exprAs<Cond>(e)) {
+            for (const auto &clause : cond->clauses) {
+                checkEach(clause, sizes);
+            }
+        } else if (auto begin = exprAs<Begin>(e)) {
+            checkEach(begin->es, sizes);
+        } else if (auto and_expr = exprAs<AndVar>(e)) {
+            checkEach(and_expr->rands, sizes);
+        } else if (auto or_expr = exprAs<OrVar>(e)) {
+            checkEach(or_expr->rands, sizes);
+        } else if (auto delay = exprAs<Delay>(e)) {
+            checkScopes(delay->e, sizes);
+        } else if (auto profile = exprAs<Profile>(e)) {
+            checkScopes(profile->e, sizes);
+        }
+    }
+
+    void checkEach(const std::vector<Expr> &es, Sizes &sizes) {
+        for (const Expr &e : es) {
+            checkScopes(e, sizes);
+        }
+    }
+
+    // whether an object's shell is only complete once a link fills it in
+    static bool needsLink(const Object &o, const Env &root) {
+        if (o.f.get() != nullptr) {
+            return o.f.get() != root.get();
+        }
+        ValueType type = o.v->v_type;
+        return type == V_PAIR || type == V_VECTOR || type == V_HASHTABLE ||
+               type == V_PROMISE || type == V_PROC;
+    }
+
+    void link() {
+        uint64_t index = in.varint();
+        if (index >= objects.size()) {
+            throw RuntimeError("image: bad reference");
+        }
+        Object &o = objects[index];
+        // a second record for the same object would refill it half-way
+        if (linked.size() < objects.size()) {
+            linked.resize(objects.size(), false);
+        }
+        if (linked[index]) {
+            throw RuntimeError("image: bad link");
+        }
+        linked[index] = true;
+        if (o.f.get() != nullptr && o.f.get() != root.get()) {
+            for (Value &slot : o.f->slots) {
+                slot = value(in.varint());
+            }
+            o.f->parent = frame(in.varint());
+            if (o.f->parent.get() == nullptr) {
+                throw RuntimeError("image: bad link");
+            }
+        } else if (Pair *p = o.v.get() ? valueAs<Pair>(o.v) : nullptr) {
+            // the image may hold structure that was made cyclic
+            p->car = datum(in.varint());
+            p->cdr = datum(in.varint());
+            noteMutation();
+        } else if (Vector *v = o.v.get() ? valueAs<Vector>(o.v) : nullptr) {
+            for (Value &item : v->items) {
+                item = datum(in.varint());
+            }
+            noteMutation();
+        } else if (HashTable *table = o.v.get() ? valueAs<HashTable>(o.v) : nullptr) {
+            // stored keys are all distinct and already have their contents,
+            // so rehashing them here gives back the same table
+            for (uint64_t n = in.varint(); n > 0; --n) {
+                Value key = datum(in.varint());
+                table->store(key, datum(in.varint()));
+            }
+        } else if (Promise *promise = o.v.get() ? valueAs<Promise>(o.v) : nullptr) {
+            if (in.byte() != 0) {
+                promise->value = datum(in.varint());
+            } else {
+                promise->e = expr(in.varint());
+                promise->env = frame(in.varint());
+                if (promise->env.get() == nullptr) {
+                    throw RuntimeError("image: bad link");
+                }
+                markLocalFrames(promise->e);
+            }
+        } else if (Procedure *proc = o.v.get() ? valueAs<Procedure>(o.v) : nullptr) {
+            proc->parameters = params();
+            proc->e = expr(in.varint());
+            proc->env = frame(in.varint());
+            proc->frame_size = in.varint();
+            proc->name = optionalSymbol();
+            if (proc->env.get() == nullptr || proc->frame_size < proc->parameters.size()) {
+                throw RuntimeError("image: bad link");
+            }
+            // the escape analysis is not saved; the body is simply marked again
+            proc->local_frame = !markLocalFrames(proc->e);
+            if (size_t capacity = in.varint()) {
+                proc->memo.reset(new MemoCache(capacity));
+            }
+        } else {
+            throw RuntimeError("image: bad link");
+        }
+    }
+
+    // a frame depth or slot index: -1 (a toplevel name) or more, and small
+    // enough for an int; checkScopes settles whether the frame has it
+    int slot() {
+        int64_t n = in.svarint();
+        if (n < -1 || n > INT_MAX) {
+            throw RuntimeError("image: bad expression");
+        }
+        return static_cast<int>(n);
+    }
+
+    Value number(uint64_t r) {
+        Value v = datum(r);
+        ValueType type = v->v_type;
+        if (type != V_INT && type != V_BIGINT && type != V_RATIONAL) {
+            throw RuntimeError("image: bad expression");
+        }
+        return v;
+    }
+
+    // a builtin node gets the operand counts the parser allows it, which
+    // its evalRator relies on
+    static void checkOperands(const Expr &e) {
+        const size_t n = exprAs<Variadic>(e)->rands.size();
+        for (const auto &entry : primitives) {
+            if (entry.second != e->e_type) {
+                continue;
+            }
+            Primitive *prim = valueAs<Primitive>(lookupPrimitive(intern(entry.first)));
+            if (prim != nullptr && (n < (size_t)prim->min_args ||
+                                    (prim->max_args >= 0 && n > (size_t)prim->max_args))) {
+                throw RuntimeError("image: bad expression");
+            }
+            return;
+        }
+    }
+
+    Expr node() {
+        ExprType type = static_cast<ExprType>(in.byte());
+        ExprShape shape = static_cast<ExprShape>(in.byte());
+        if (shape == S_UNARY) {
+            return makeUnary(type, expr(in.varint()));
+        }
+        if (shape == S_BINARY) {
+            Expr rand1 = expr(in.varint());
+            return makeBinary(type, rand1, expr(in.varint()));
+        }
+        if (shape == S_VARIADIC) {
+            Expr e = makeVariadic(type, exprList());
+            checkOperands(e);
+            if (ApplyFunc *apply = exprAs<ApplyFunc>(e)) {
+                apply->tail = in.byte() != 0;
+            }
+            return e;
+        }
+        switch (type) {
+            case E_FIXNUM: {
+                Fixnum *n = new Fixnum("0");
+                Expr e(n);
+                n->datum = number(in.varint());
+                return e;
+            }
+            case E_RATIONAL: {
+                RationalNum *n = new RationalNum("0", "1");
+                Expr e(n);
+                n->datum = number(in.varint());
+                return e;
+            }
+            case E_STRING: {
+                Value datum = this->datum(in.varint());
+                String *str = valueAs<String>(datum);
+                if (str == nullptr) {
+                    throw RuntimeError("image: bad expression");
+                }
+                StringExpr *n = new StringExpr(str->s);
+                Expr e(n);
+                n->datum = datum;
+                return e;
+            }
+            case E_TRUE:    return Expr(new True());
+            case E_FALSE:   return Expr(new False());
+            case E_VOID:    return Expr(new MakeVoid());
+            case E_EXIT:    return Expr(new Exit());
+            case E_GCSTATS: return Expr(new GcStats());
+            case E_RUNTIMESTATS: return Expr(new RuntimeStats());
+            case E_QUOTE:   return Expr(new Quote(datum(in.varint())));
+            case E_PROFILE: return Expr(new Profile(expr(in.varint())));
+            case E_DELAY:   return Expr(new Delay(expr(in.varint())));
+            case E_AND:     return Expr(new AndVar(exprList()));
+            case E_OR:      return Expr(new OrVar(exprList()));
+            case E_BEGIN:   return Expr(new Begin(exprList()));
+            case E_IF: {
+                Expr cond = expr(in.varint());
+                Expr conseq = expr(in.varint());
+                return Expr(new If(cond, conseq, expr(in.varint())));
+            }
+            case E_COND: {
+                bool has_else = in.byte() != 0;
+                std::vector<std::vector<Expr>> clauses;
+                for (uint64_t n = in.varint(); n > 0; --n) {
+                    clauses.push_back(exprList());
+                }
+                // every clause but the else begins with its test
+                for (size_t i = 0; i + has_else < clauses.size(); ++i) {
+                    if (clauses[i].empty()) {
+                        throw RuntimeError("image: bad expression");
+                    }
+                }
+                if (has_else && clauses.empty()) {
+                    throw RuntimeError("image: bad expression");
+                }
+                return Expr(new Cond(has_else, clauses));
+            }
+            case E_VAR: {
+                SymbolId x = symbol();
+                int depth = slot();
+                return Expr(new Var(x, depth, slot()));
+            }
+            case E_APPLY: {
+                Expr rator = expr(in.varint());
+                Apply *apply = new Apply(rator, exprList());
+                Expr e(apply);
+                apply->tail = in.byte() != 0;
+                return e;
+            }
+            case E_LAMBDA: {
+                std::vector<SymbolId> xs = params();
+                Expr body = expr(in.varint());
+                size_t frame_size = in.varint();
+                return Expr(new Lambda(xs, body, frame_size, optionalSymbol()));
+            }
+            case E_DEFINE: {
+                SymbolId x = symbol();
+                Expr e = expr(in.varint());
+                return Expr(new Define(x, e, slot()));
+            }
+            case E_LET: {
+                std::vector<std::pair<SymbolId, Expr>> bind = bindings();
+                Expr body = expr(in.varint());
+                return Expr(new Let(bind, body, in.varint()));
+            }
+            case E_LETREC: {
+                std::vector<std::pair<SymbolId, Expr>> bind = bindings();
+                Expr body = expr(in.varint());
+                return Expr(new Letrec(bind, body, in.varint()));
+            }
+            case E_SET: {
+                SymbolId x = symbol();
+                Expr e = expr(in.varint());
+                int depth = slot();
+                return Expr(new Set(x, e, depth, slot()));
+            }
+            default:
+                throw RuntimeError("image: bad expression");
+        }
+    }
+};
+
+/// Read-only mapping of a whole file, released on scope exit
+struct Mapping {
+    void *data = nullptr;
+    size_t size = 0;
+    ~Mapping() {
+        if (data != nullptr) {
+            munmap(data, size);
+        }
+    }
+};
+
+} // namespace
+
+// ============================================================================
+// Entry points
+// ============================================================================
+
+void saveImage(const std::string &path, Env &root) {
+    std::string bytes = ImageWriter(root).write();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+    if (!out) {
+        throw RuntimeError("image: cannot write " + path);
+    }
+}
+
+void loadImage(const std::string &path, Env &root) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw RuntimeError("image: cannot open " + path);
+    }
+    struct stat st;
+    Mapping map;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            map.data = p;
+            map.size = st.st_size;
+        }
+    }
+    close(fd);
+    if (map.data == nullptr) {
+        throw RuntimeError("image: cannot map " + path);
+    }
+    try {
+        ImageLoader(static_cast<const uint8_t*>(map.data), map.size, root).load();
+    } catch (const std::exception &e) {
+        // allocation failures and the like still mean the file is unusable
+        throw RuntimeError(std::string("image: ") + e.what());
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+/**
+ * @file image.hpp
+ * @brief Binary snapshots of the toplevel environment
+ *
+ * An image records every toplevel binding together with everything it
+ * reaches: closures with their parsed bodies and captured frames, quoted
+ * data, strings and exact numbers. Loading one restores the environment
+ * as it was when saved, so a prelude is read, parsed and evaluated once
+ * and later runs start from its image instead.
+ *
+ * Builtins are stored by name and rebound to the primitives of the
+ * loading binary. Bytecode is not stored; the VM recompiles a body the
+ * first time it is called.
+ */
+
+#include "value.hpp"
+#include <string>
+
+/**
+ * @brief Write the toplevel bindings of a root frame to a file
+ */
+void saveImage(const std::string &, Env &);
+
+/**
+ * @brief Replace the toplevel bindings of a root frame with a saved image
+ *
+ * The file is mapped and decoded in place. Throws RuntimeError when it
+ * cannot be opened, is truncated, or was written by another format
+ * version.
+ */
+void loadImage(const std::string &, Env &);
+
+#endif // IMAGE_HPP
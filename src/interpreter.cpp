@@ -0,0 +1,83 @@
+/**
+ * @file interpreter.cpp
+ * @brief Interpreter instances: toplevel setup, evaluation and output
+ */
+
+#include "interpreter.hpp"
+#include "syntax.hpp"
+#include "expr.hpp"
+#include "RE.hpp"
+#include "image.hpp"
+
+namespace {
+
+/**
+ * @brief The toplevel environment: the builtins, or a saved image
+ */
+Env globalEnv(const char *image) {
+    Env env = toplevel();
+    if (image != nullptr) {
+        loadImage(image, env);
+    } else {
+        installPrimitives(env->globals);
+    }
+    return env;
+}
+
+/**
+ * @brief Point this thread's output at a sink for the lifetime of a scope
+ *
+ * The previous stream comes back afterwards, so an instance can run from
+ * inside another one's primitive or next to the REPL on the same thread.
+ */
+struct OutputScope {
+    std::ostream *saved;
+    explicit OutputScope(std::ostream *os) : saved(&outputStream()) { setOutputStream(os); }
+    ~OutputScope() { setOutputStream(saved); }
+};
+
+} // namespace
+
+Interpreter::Interpreter(bool use_vm, const char *image, std::ostream *output)
+    : env(globalEnv(image)), toplevel_scope(env->globals), use_vm(use_vm),
+      out(output != nullptr ? output : &buffer) {}
+
+Interpreter::~Interpreter() {
+    // the toplevel table and the closures bound in it refer to each other;
+    // dropping the bindings frees them now rather than at the next collection
+    env->globals->clear();
+}
+
+Expr Interpreter::parse(const Syntax &stx) {
+    Expr expr = stx->parse(toplevel_scope);
+    markLocalFrames(expr);
+    return expr;
+}
+
+Value Interpreter::run(const Expr &expr) {
+    OutputScope scope(out);
+    return use_vm ? vm.run(*compileToplevel(expr), env) : expr->eval(env);
+}
+
+EvalResult Interpreter::eval(std::string_view source) {
+    EvalResult result = {true, VoidV(), std::string()};
+    try {
+        Reader reader(source);
+        while (!reader.atEnd()) {
+            result.value = run(parse(reader.read()));
+            if (result.value->v_type == V_TERMINATE) {
+                break;
+            }
+        }
+    } catch (const RuntimeError &RE) {
+        result.ok = false;
+        result.error = RE.message();
+    }
+    return result;
+}
+
+std::string Interpreter::takeOutput() {
+    std::string text = buffer.str();
+    buffer.str(std::string());
+    return text;
+}
@@ -0,0 +1,82 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+/**
+ * @file interpreter.hpp
+ * @brief Embedding interface: one self-contained interpreter instance
+ *
+ * An Interpreter owns a toplevel environment, the parser's scope for it,
+ * a VM and an output sink, so several can live side by side and a host
+ * can make one per request:
+ *
+ *     Interpreter interp;
+ *     EvalResult r = interp.eval("(define (sq x) (* x x)) (display (sq 7)) (sq 8)");
+ *     // r.ok, r.value is 64, interp.takeOutput() is "49\n"
+ *
+ * Creating one costs a root frame and the toplevel table of builtins.
+ * Heap objects come from the calling thread's arenas (see gc.hpp), so an
+ * instance and the values it returns must stay on the thread that made
+ * it. The REPL, script and batch modes of main.cpp are clients of this
+ * class.
+ */
+
+#include "value.hpp"
+#include "vm.hpp"
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Outcome of Interpreter::eval
+ */
+struct EvalResult {
+    bool ok;              ///< Whether every form ran without an error
+    Value value;          ///< Value of the last form run; a Terminate value after (exit)
+    std::string error;    ///< Message of the error that stopped evaluation
+};
+
+class Interpreter {
+public:
+    /**
+     * @brief New toplevel with the builtins, or with a saved image
+     *
+     * Output of display goes to output, or to a buffer read through
+     * takeOutput when output is nullptr. Throws RuntimeError when the
+     * image cannot be loaded.
+     */
+    explicit Interpreter(bool use_vm = false, const char *image = nullptr, std::ostream *output = nullptr);
+    ~Interpreter();
+    Interpreter(const Interpreter &) = delete;
+    Interpreter &operator=(const Interpreter &) = delete;
+
+    /**
+     * @brief Read, parse and run every form of source in order
+     *
+     * Stops at the first error, reported in the result rather than
+     * thrown, or at (exit). Definitions made before the error stay.
+     * source is read in place and need only live for the call.
+     */
+    EvalResult eval(std::string_view source);
+
+    /// Parse one form against this instance's toplevel; throws RuntimeError
+    Expr parse(const Syntax &);
+    /// Run one parsed form; throws RuntimeError
+    Value run(const Expr &);
+
+    /// Output buffered since the last call; empty with an external sink
+    std::string takeOutput();
+
+    Env &environment() { return env; }
+    Scope &scope() { return toplevel_scope; }
+
+private:
+    Env env;
+    Scope toplevel_scope;
+    VM vm;
+    bool use_vm;
+    std::ostringstream buffer;
+    std::ostream *out;
+};
+
+#endif // INTERPRETER_HPP
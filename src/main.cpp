@@ -3,39 +3,57 @@
 #include "expr.hpp"
 #include "value.hpp"
 #include "RE.hpp"
+#include "interpreter.hpp"
+#include "image.hpp"
+#include "profile.hpp"
+#include "pool.hpp"
+#include "readahead.hpp"
 #include <sstream>
 #include <iostream>
+#include <fstream>
 #include <map>
 #include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+extern const std::map<std::string, ExprType> primitives;
+extern const std::map<std::string, ExprType> reserved_words;
 
 bool isExplicitVoidCall(Expr expr) {
-    MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
+    static const SymbolId void_name = intern("void");
+    MakeVoid* make_void_expr = exprAs<MakeVoid>(expr);
     if (make_void_expr != nullptr) {
         return true;
     }
     
-    Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
+    Apply* apply_expr = exprAs<Apply>(expr);
     if (apply_expr != nullptr) {
-        Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
-        if (var_expr != nullptr && var_expr->x == "void") {
+        Var* var_expr = exprAs<Var>(apply_expr->rator);
+        if (var_expr != nullptr && var_expr->x == void_name) {
             return true;
         }
     }
     
-    Begin* begin_expr = dynamic_cast<Begin*>(expr.get());
+    Begin* begin_expr = exprAs<Begin>(expr);
     if (begin_expr != nullptr && !begin_expr->es.empty()) {
         return isExplicitVoidCall(begin_expr->es.back());
     }
     
-    If* if_expr = dynamic_cast<If*>(expr.get());
+    If* if_expr = exprAs<If>(expr);
     if (if_expr != nullptr) {
         return isExplicitVoidCall(if_expr->conseq) || isExplicitVoidCall(if_expr->alter);
     }
     
-    Cond* cond_expr = dynamic_cast<Cond*>(expr.get());
+    Cond* cond_expr = exprAs<Cond>(expr);
     if (cond_expr != nullptr) {
         for (const auto& clause : cond_expr->clauses) {
             if (clause.size() > 1 && isExplicitVoidCall(clause.back())) {
@@ -46,39 +64,370 @@ bool isExplicitVoidCall(Expr expr) {
     return false;
 }
 
-void REPL() {
-    // read - evaluation - print loop
-    Assoc global_env = empty();
-    while (1){
+/**
+ * @brief Read - evaluation - print loop over a reader
+ *
+ * The REPL prompts and keeps reading once its input runs out; a batch
+ * program is read without prompts and ends with its file.
+ */
+template <class Source>
+static void transcript(Source &reader, Interpreter &interp, std::ostream &out, bool repl) {
+    while (repl || !reader.atEnd()){
         #ifndef ONLINE_JUDGE
-            std::cout << "scm> ";
+            if (repl) out << "scm> ";
         #endif
-        Syntax stx = readSyntax(std::cin); // read
-        // stx->show(std::cout); // syntax print
+        Syntax stx = reader.read(); // read
+        // stx->show(out); // syntax print
         try{
-            Expr expr = stx->parse(global_env); // parse
-            Value val = expr->eval(global_env);
+            Expr expr = interp.parse(stx); // parse
+            Value val = interp.run(expr);
             if (val->v_type == V_TERMINATE)
                 break;
             bool is_void_value = (val->v_type == V_VOID);
             bool is_explicit_void = isExplicitVoidCall(expr);
             if (!is_void_value || is_explicit_void) {
-                val -> show(std::cout); // value print
-                puts("");
+                val.show(out); // value print
+                out << '\n';
             } 
         }
         catch (const RuntimeError &RE){
-            // std::cout << RE.message();
-            std::cout << "RuntimeError";
-            std::cin.clear();
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-            puts("");
+            // out << RE.message();
+            out << "RuntimeError";
+            reader.resync();
+            out << '\n';
         }
     }
 }
 
+void REPL(Interpreter &interp) {
+    // a terminal is read a line at a time, as it is typed; redirected or
+    // piped input is read ahead on another thread while forms run
+    if (isatty(0)) {
+        Reader reader(std::cin);
+        transcript(reader, interp, std::cout, true);
+        return;
+    }
+    ReadAhead reader(0);
+    transcript(reader, interp, std::cout, true);
+}
+
+// ============================================================================
+// Script mode
+// ============================================================================
+
+enum ScriptStatus { SCRIPT_DONE, SCRIPT_EXIT, SCRIPT_FAILED };
+
+/**
+ * @brief Reserve the toplevel names a form defines before it runs
+ *
+ * Parsing a whole file before evaluating any of it would otherwise
+ * resolve calls to a name redefined later in the file (say `car`) to the
+ * builtin, because the define has not inserted its binding yet. All the
+ * file's defines are declared before its first form is parsed.
+ */
+static void declareDefines(const Syntax &stx, Scope &scope) {
+    static const SymbolId define_name = intern("define");
+    static const SymbolId begin_name = intern("begin");
+    List *list = dynamic_cast<List*>(stx.get());
+    if (list == nullptr || list->stxs.size() < 2) {
+        return;
+    }
+    SymbolSyntax *head = dynamic_cast<SymbolSyntax*>(list->stxs[0].get());
+    if (head == nullptr) {
+        return;
+    }
+    if (head->id == begin_name) {
+        for (size_t i = 1; i < list->stxs.size(); ++i) {
+            declareDefines(list->stxs[i], scope);
+        }
+        return;
+    }
+    if (head->id != define_name) {
+        return;
+    }
+    SymbolSyntax *name = dynamic_cast<SymbolSyntax*>(list->stxs[1].get());
+    if (List *signature = dynamic_cast<List*>(list->stxs[1].get())) {
+        if (!signature->stxs.empty()) {
+            name = dynamic_cast<SymbolSyntax*>(signature->stxs[0].get());
+        }
+    }
+    if (name != nullptr) {
+        scope.defineGlobal(name->id);
+    }
+}
+
+/**
+ * @brief Run every form of a file without the REPL's echo
+ *
+ * Forms are read from a mapped buffer and evaluated in order; values are
+ * not printed, so only explicit output such as display appears. With
+ * whole_file the file is parsed completely first, so a malformed form
+ * anywhere stops the file before any of it runs. The first error is
+ * reported on stderr and ends the run.
+ */
+static ScriptStatus runScript(const char *path, Interpreter &interp, bool whole_file) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << path << ": " << std::strerror(errno) << '\n';
+        return SCRIPT_FAILED;
+    }
+    Reader reader(fd);
+    close(fd);
+    try {
+        if (whole_file) {
+            std::vector<Syntax> forms;
+            while (!reader.atEnd()) {
+                forms.push_back(reader.read());
+                declareDefines(forms.back(), interp.scope());
+            }
+            std::vector<Expr> unit;
+            for (const Syntax &stx : forms) {
+                unit.push_back(interp.parse(stx));
+            }
+            for (const Expr &expr : unit) {
+                if (interp.run(expr)->v_type == V_TERMINATE) {
+                    return SCRIPT_EXIT;
+                }
+            }
+            return SCRIPT_DONE;
+        }
+        while (!reader.atEnd()) {
+            Expr expr = interp.parse(reader.read());
+            if (interp.run(expr)->v_type == V_TERMINATE) {
+                return SCRIPT_EXIT;
+            }
+        }
+    } catch (const RuntimeError &RE) {
+        std::cout.flush();
+        std::cerr << path << ": RuntimeError: " << RE.message() << '\n';
+        return SCRIPT_FAILED;
+    }
+    return SCRIPT_DONE;
+}
+
+// ============================================================================
+// Batch mode
+// ============================================================================
+
+/**
+ * @brief Programs of a batch: the *.in and *.scm files of a directory in
+ * name order, or the paths listed one per line in a manifest file
+ */
+static bool batchPrograms(const char *path, std::vector<std::string> &programs) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        std::cerr << path << ": " << std::strerror(errno) << '\n';
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path);
+        if (dir == nullptr) {
+            std::cerr << path << ": " << std::strerror(errno) << '\n';
+            return false;
+        }
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            size_t dot = name.rfind('.');
+            if (dot != std::string::npos && (name.substr(dot) == ".in" || name.substr(dot) == ".scm")) {
+                programs.push_back(std::string(path) + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(programs.begin(), programs.end());
+        return true;
+    }
+    std::ifstream manifest(path);
+    std::string line;
+    while (std::getline(manifest, line)) {
+        if (!line.empty()) {
+            programs.push_back(line);
+        }
+    }
+    return true;
+}
+
+struct BatchResult {
+    std::string output;
+    bool failed;
+};
+
+/**
+ * @brief Run one program of a batch in a fresh toplevel environment
+ *
+ * The program is read like REPL input, so its output (echoed values,
+ * display and "RuntimeError" lines) matches what the REPL would print
+ * for it without prompts. Everything stays on the calling thread.
+ */
+static void runBatchProgram(const std::string &path, const char *image, bool use_vm, BatchResult &result) {
+    std::ostringstream out;
+    result.failed = false;
+    try {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw RuntimeError(std::strerror(errno));
+        }
+        Reader reader(fd);
+        close(fd);
+        Interpreter interp(use_vm, image, &out);
+        transcript(reader, interp, out, false);
+    } catch (const RuntimeError &RE) {
+        out << path << ": " << RE.message() << '\n';
+        result.failed = true;
+    }
+    // the program's cycles would otherwise wait for this thread's next one
+    gcCollect();
+    result.output = out.str();
+}
+
+// a batch worker's own heap: its builtins, symbols and arenas
+static void releaseThreadHeap() {
+    releasePrimitives();
+    releaseTailCalls();
+    releaseSymbols();
+    gcCollect();
+    releaseLocalFrames();
+    gcReleaseArenas();
+}
+
+/**
+ * @brief Evaluate independent programs on a pool of threads
+ *
+ * With out_dir each program's output goes to out_dir/<name>.out;
+ * otherwise the outputs are printed in batch order, each after a
+ * `==> path <==` line. Returns whether every program could be run.
+ */
+static bool runBatch(const char *path, const char *out_dir, unsigned jobs, const char *image, bool use_vm) {
+    std::vector<std::string> programs;
+    if (!batchPrograms(path, programs)) {
+        return false;
+    }
+    std::vector<BatchResult> results(programs.size());
+    std::vector<Task> tasks;
+    for (size_t i = 0; i < programs.size(); ++i) {
+        tasks.push_back([&, i]() { runBatchProgram(programs[i], image, use_vm, results[i]); });
+    }
+    runTasks(tasks, jobs, releaseThreadHeap);
+
+    bool ok = true;
+    for (size_t i = 0; i < programs.size(); ++i) {
+        ok = ok && !results[i].failed;
+        if (out_dir == nullptr) {
+            std::cout << "==> " << programs[i] << " <==\n" << results[i].output;
+            continue;
+        }
+        std::string name = programs[i].substr(programs[i].rfind('/') + 1);
+        std::string file = std::string(out_dir) + "/" + name.substr(0, name.rfind('.')) + ".out";
+        std::ofstream out(file);
+        out << results[i].output;
+        if (!out) {
+            std::cerr << file << ": cannot write\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief Heap counters of the run as one `key=value` line on stderr
+ *
+ * Printed by `--stats` for tools such as bench-runner, which must not
+ * have to scrape the program's own output.
+ */
+static void reportStats() {
+    HeapStats stats = gcStats();
+    std::cerr << "stats allocated-objects=" << stats.allocated
+              << " collections=" << stats.collections
+              << " freed-objects=" << stats.freed
+              << " gc-us=" << (long long)(stats.total_ms * 1000) << '\n';
+}
 
 int main(int argc, char *argv[]) {
-    REPL();
+    // all output goes through std::cout, so it need not stay in sync with stdio
+    std::ios::sync_with_stdio(false);
+
+    bool use_vm = false;
+    bool whole_file = false;
+    bool stats = false;
+    bool profile = false;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    const char *batch = nullptr;
+    const char *batch_out = nullptr;
+    const char *image = nullptr;
+    const char *save_image = nullptr;
+    std::vector<const char *> scripts;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--vm") == 0) {
+            use_vm = true; // run on the bytecode VM instead of the tree-walker
+        } else if (std::strcmp(argv[i], "--whole-file") == 0) {
+            whole_file = true; // parse each script completely before running it
+        } else if (std::strcmp(argv[i], "--stats") == 0) {
+            stats = true; // report heap counters on stderr at exit
+        } else if (std::strcmp(argv[i], "--profile") == 0) {
+            profile = true; // time every procedure call, flat profile on stderr at exit
+        } else if (std::strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc) {
+            profile = true; // ... and write the collapsed stacks to a file
+            setProfileOutput(argv[++i]);
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i]; // run each program of a directory or manifest on its own
+        } else if (std::strcmp(argv[i], "--batch-out") == 0 && i + 1 < argc) {
+            batch_out = argv[++i]; // ... writing each one's output to a file there
+        } else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = std::max(1, std::atoi(argv[++i])); // threads for --batch
+        } else if (std::strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image = argv[++i]; // start from a saved environment instead of the builtins
+        } else if (std::strcmp(argv[i], "--save-image") == 0 && i + 1 < argc) {
+            save_image = argv[++i]; // snapshot the environment once everything has run
+        } else {
+            scripts.push_back(argv[i]);
+        }
+    }
+
+    if (batch != nullptr) {
+        return runBatch(batch, batch_out, jobs, image, use_vm) ? 0 : 1;
+    }
+
+    std::unique_ptr<Interpreter> interp;
+    try {
+        interp.reset(new Interpreter(use_vm, image, &std::cout));
+    } catch (const RuntimeError &RE) {
+        std::cerr << RE.message() << '\n';
+        return 1;
+    }
+    if (profile) {
+        profileStart();
+    }
+    if (scripts.empty()) {
+        REPL(*interp);
+    }
+    bool failed = false;
+    for (const char *path : scripts) {
+        ScriptStatus status = runScript(path, *interp, whole_file);
+        if (status == SCRIPT_FAILED) {
+            failed = true;
+            break;
+        }
+        if (status == SCRIPT_EXIT) {
+            break;
+        }
+    }
+    if (profile) {
+        std::cout.flush();
+        profileStop(std::cerr);
+    }
+    if (failed) {
+        return 1;
+    }
+    if (save_image != nullptr) {
+        try {
+            saveImage(save_image, interp->environment());
+        } catch (const RuntimeError &RE) {
+            std::cerr << RE.message() << '\n';
+            return 1;
+        }
+    }
+    if (stats) {
+        std::cout.flush();
+        reportStats();
+    }
     return 0;
 }
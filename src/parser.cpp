@@ -22,44 +22,223 @@ using std::string;
 using std::vector;
 using std::pair;
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+/**
+ * @brief Builds a variable reference resolved against the current scope
+ */
+static Expr makeVar(SymbolId x, Scope &env) {
+    int depth, index;
+    env.resolve(x, depth, index);
+    return Expr(new Var(x, depth, index));
+}
+
+/**
+ * @brief Reserves slots for the internal defines of a body
+ *
+ * Internal defines live in the frame of the enclosing lambda/let/letrec.
+ * Declaring them before the body is parsed lets mutually recursive local
+ * procedures see each other regardless of their order.
+ */
+static void declareDefines(const vector<Syntax> &body, size_t from, Scope &env) {
+    for (size_t i = from; i < body.size(); ++i) {
+        auto form = dynamic_cast<List*>(body[i].get());
+        if (form == nullptr || form->stxs.empty()) {
+            continue;
+        }
+        auto head = dynamic_cast<SymbolSyntax*>(form->stxs[0].get());
+        if (head == nullptr || env.bound(head->id)) {
+            continue;
+        }
+        if (head->s == "begin") {
+            declareDefines(form->stxs, 1, env);
+        } else if (head->s == "define" && form->stxs.size() >= 2) {
+            auto name = dynamic_cast<SymbolSyntax*>(form->stxs[1].get());
+            if (auto func = dynamic_cast<List*>(form->stxs[1].get())) {
+                if (!func->stxs.empty()) {
+                    name = dynamic_cast<SymbolSyntax*>(func->stxs[0].get());
+                }
+            }
+            if (name != nullptr) {
+                env.declare(name->id);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Flags every application in tail position of a lambda body
+ *
+ * Tail positions are the body itself and, recursively, the branches of
+ * if/cond, the last form of begin/let/letrec bodies and the last operand
+ * of and/or.
+ */
+static void markTailCalls(const Expr &e) {
+    if (auto apply = exprAs<Apply>(e)) {
+        apply->tail = true;
+    } else if (auto apply_func = exprAs<ApplyFunc>(e)) {
+        apply_func->tail = true;
+    } else if (auto if_expr = exprAs<If>(e)) {
+        markTailCalls(if_expr->conseq);
+        markTailCalls(if_expr->alter);
+    } else if (auto cond_expr = exprAs<Cond>(e)) {
+        for (size_t i = 0; i < cond_expr->clauses.size(); ++i) {
+            const auto &clause = cond_expr->clauses[i];
+            // a test-only clause returns the test value, which is not a tail call
+            bool is_else = cond_expr->has_else && i + 1 == cond_expr->clauses.size();
+            if (clause.size() > 1 || (is_else && !clause.empty())) {
+                markTailCalls(clause.back());
+            }
+        }
+    } else if (auto begin_expr = exprAs<Begin>(e)) {
+        if (!begin_expr->es.empty()) {
+            markTailCalls(begin_expr->es.back());
+        }
+    } else if (auto let_expr = exprAs<Let>(e)) {
+        markTailCalls(let_expr->body);
+    } else if (auto letrec_expr = exprAs<Letrec>(e)) {
+        markTailCalls(letrec_expr->body);
+    } else if (auto and_expr = exprAs<AndVar>(e)) {
+        if (!and_expr->rands.empty()) {
+            markTailCalls(and_expr->rands.back());
+        }
+    } else if (auto or_expr = exprAs<OrVar>(e)) {
+        if (!or_expr->rands.empty()) {
+            markTailCalls(or_expr->rands.back());
+        }
+    }
+}
+
+static bool markEach(const vector<Expr> &es) {
+    bool captures = false;
+    for (const auto &e : es) {
+        captures = markLocalFrames(e) || captures;  // every subexpression is marked
+    }
+    return captures;
+}
+
+static bool markInits(const vector<pair<SymbolId, Expr>> &bind) {
+    bool captures = false;
+    for (const auto &b : bind) {
+        captures = markLocalFrames(b.second) || captures;
+    }
+    return captures;
+}
+
+bool markLocalFrames(const Expr &e) {
+    switch (e->e_type) {
+        case E_FIXNUM: case E_RATIONAL: case E_STRING: case E_TRUE: case E_FALSE:
+        case E_VOID: case E_EXIT: case E_GCSTATS: case E_RUNTIMESTATS:
+        case E_QUOTE: case E_VAR:
+            return false;
+        default:
+            break;
+    }
+    if (auto unary = exprAs<Unary>(e)) {
+        return markLocalFrames(unary->rand);
+    } else if (auto binary = exprAs<Binary>(e)) {
+        bool captures = markLocalFrames(binary->rand1);
+        return markLocalFrames(binary->rand2) || captures;
+    } else if (auto variadic = exprAs<Variadic>(e)) {
+        return markEach(variadic->rands);
+    } else if (auto lambda = exprAs<Lambda>(e)) {
+        lambda->local = !markLocalFrames(lambda->e);
+        return true;
+    } else if (auto let_expr = exprAs<Let>(e)) {
+        // the inits run in the enclosing frame, so only the body matters here
+        bool captures = markInits(let_expr->bind);
+        let_expr->local = !markLocalFrames(let_expr->body);
+        return captures || !let_expr->local;
+    } else if (auto letrec_expr = exprAs<Letrec>(e)) {
+        bool captures = markInits(letrec_expr->bind);
+        captures = markLocalFrames(letrec_expr->body) || captures;
+        letrec_expr->local = !captures;
+        return captures;
+    } else if (auto apply = exprAs<Apply>(e)) {
+        bool captures = markLocalFrames(apply->rator);
+        return markEach(apply->rand) || captures;
+    } else if (auto if_expr = exprAs<If>(e)) {
+        bool captures = markLocalFrames(if_expr->cond);
+        captures = markLocalFrames(if_expr->conseq) || captures;
+        return markLocalFrames(if_expr->alter) || captures;
+    } else if (auto cond_expr = exprAs<Cond>(e)) {
+        bool captures = false;
+        for (const auto &clause : cond_expr->clauses) {
+            captures = markEach(clause) || captures;
+        }
+        return captures;
+    } else if (auto begin_expr = exprAs<Begin>(e)) {
+        return markEach(begin_expr->es);
+    } else if (auto and_expr = exprAs<AndVar>(e)) {
+        return markEach(and_expr->rands);
+    } else if (auto or_expr = exprAs<OrVar>(e)) {
+        return markEach(or_expr->rands);
+    } else if (auto define = exprAs<Define>(e)) {
+        return markLocalFrames(define->e);
+    } else if (auto set = exprAs<Set>(e)) {
+        return markLocalFrames(set->e);
+    } else if (auto profile = exprAs<Profile>(e)) {
+        return markLocalFrames(profile->e);
+    } else if (auto delay = exprAs<Delay>(e)) {
+        // a promise keeps the frame it was made in, as a closure does
+        markLocalFrames(delay->e);
+        return true;
+    }
+    return true;
+}
+
+static Expr makeLambda(const vector<SymbolId> &params, const Expr &body, size_t frame_size, SymbolId name) {
+    markTailCalls(body);
+    return Expr(new Lambda(params, body, frame_size, name));
+}
+
+// an anonymous lambda is profiled as "owner/lambda" after the named
+// procedure it appears in, or as plain "lambda" outside any
+static SymbolId anonymousName(const Scope &env) {
+    static const SymbolId lambda = intern("lambda");
+    return env.owner < 0 ? lambda : intern(symbolName(env.owner) + "/lambda");
+}
+
+// a lambda bound by define, let or letrec is profiled under its binding
+static void nameLambda(const Expr &e, SymbolId name) {
+    if (auto lambda = exprAs<Lambda>(e)) {
+        lambda->name = name;
+    }
+}
 
 /**
  * @brief Default parse method (should be overridden by subclasses)
  */
-Expr Syntax::parse(Assoc &env) {
+Expr Syntax::parse(Scope &env) {
     throw RuntimeError("Unimplemented parse method");
 }
 
-Expr Number::parse(Assoc &env) {
-    return Expr(new Fixnum(n));
+Expr Number::parse(Scope &env) {
+    return Expr(new Fixnum(digits));
 }
 
-Expr RationalSyntax::parse(Assoc &env) {
+Expr RationalSyntax::parse(Scope &env) {
     return Expr(new RationalNum(numerator, denominator));
 }
 
-Expr SymbolSyntax::parse(Assoc &env) {
+Expr SymbolSyntax::parse(Scope &env) {
     if (!util::is_valid_variable_name(s)) {
         throw RuntimeError("Invalid variable name: " + s);
     }
-    return Expr(new Var(s));
+    return makeVar(id, env);
 }
 
-Expr StringSyntax::parse(Assoc &env) {
+Expr StringSyntax::parse(Scope &env) {
     return Expr(new StringExpr(s));
 }
 
-Expr TrueSyntax::parse(Assoc &env) {
+Expr TrueSyntax::parse(Scope &env) {
     return Expr(new True());
 }
 
-Expr FalseSyntax::parse(Assoc &env) {
+Expr FalseSyntax::parse(Scope &env) {
     return Expr(new False());
 }
 
-Expr List::parse(Assoc &env) {
+Expr List::parse(Scope &env) {
     if (stxs.empty()) {
         return Expr(new Quote(Syntax(new List())));
     }
@@ -72,29 +251,29 @@ Expr List::parse(Assoc &env) {
         }
         return Expr(new Apply(stxs[0]->parse(env), rands));
     }
-    string op = id->s;
-    if (bound(op, env)) {
-        Expr rator = Expr(new Var(op));
+    const string &op = id->s;
+    ExprType op_type;
+    if (env.bound(id->id)) {
+        Expr rator = makeVar(id->id, env);
         std::vector<Expr> rands;
         for (size_t i = 1; i < stxs.size(); ++i) {
             rands.push_back(stxs[i]->parse(env));
         }
         return Expr(new Apply(rator, rands));
     }
-    if (primitives.count(op) != 0) {
+    if (primitiveType(id->id, op_type)) {
         vector<Expr> parameters;
         for (size_t i = 1; i < stxs.size(); ++i) {
             parameters.push_back(stxs[i]->parse(env));
         }
-        
-        ExprType op_type = primitives[op];
-        switch (primitives[op]) {
+
+        switch (op_type) {
             case E_PLUS:
-                return parameters.size() == 2 ? Expr(new Plus(parameters[0], parameters[1])) : Expr(new PlusVar(parameters));
+                return parameters.size() == 2 ? makeArithmetic(E_PLUS, parameters[0], parameters[1]) : Expr(new PlusVar(parameters));
             case E_MINUS:
-                 return parameters.size() == 2 ? Expr(new Minus(parameters[0], parameters[1])) : Expr(new MinusVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_MINUS, parameters[0], parameters[1]) : Expr(new MinusVar(parameters));
             case E_MUL:
-                 return parameters.size() == 2 ? Expr(new Mult(parameters[0], parameters[1])) : Expr(new MultVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_MUL, parameters[0], parameters[1]) : Expr(new MultVar(parameters));
             case E_DIV:
                  return parameters.size() == 2 ? Expr(new Div(parameters[0], parameters[1])) : Expr(new DivVar(parameters));
             case E_MODULO:
@@ -105,19 +284,19 @@ Expr List::parse(Assoc &env) {
                 return Expr(new Expt(parameters[0], parameters[1]));
             case E_LT:
                  if (parameters.size() < 2) throw RuntimeError("< expects at least 2 arguments");
-                 return parameters.size() == 2 ? Expr(new Less(parameters[0], parameters[1])) : Expr(new LessVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_LT, parameters[0], parameters[1]) : Expr(new LessVar(parameters));
             case E_LE:
                  if (parameters.size() < 2) throw RuntimeError("<= expects at least 2 arguments");
-                 return parameters.size() == 2 ? Expr(new LessEq(parameters[0], parameters[1])) : Expr(new LessEqVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_LE, parameters[0], parameters[1]) : Expr(new LessEqVar(parameters));
             case E_EQ:
                  if (parameters.size() < 2) throw RuntimeError("= expects at least 2 arguments");
-                 return parameters.size() == 2 ? Expr(new Equal(parameters[0], parameters[1])) : Expr(new EqualVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_EQ, parameters[0], parameters[1]) : Expr(new EqualVar(parameters));
             case E_GE:
                  if (parameters.size() < 2) throw RuntimeError(">= expects at least 2 arguments");
-                 return parameters.size() == 2 ? Expr(new GreaterEq(parameters[0], parameters[1])) : Expr(new GreaterEqVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_GE, parameters[0], parameters[1]) : Expr(new GreaterEqVar(parameters));
             case E_GT:
                  if (parameters.size() < 2) throw RuntimeError("> expects at least 2 arguments");
-                 return parameters.size() == 2 ? Expr(new Greater(parameters[0], parameters[1])) : Expr(new GreaterVar(parameters));
+                 return parameters.size() == 2 ? makeArithmetic(E_GT, parameters[0], parameters[1]) : Expr(new GreaterVar(parameters));
             case E_CONS:
                 if (parameters.size() != 2) throw RuntimeError("cons expects exactly 2 arguments");
                 return Expr(new Cons(parameters[0], parameters[1]));
@@ -135,6 +314,67 @@ Expr List::parse(Assoc &env) {
             case E_SETCDR:
                 if (parameters.size() != 2) throw RuntimeError("set-cdr! expects exactly 2 arguments");
                 return Expr(new SetCdr(parameters[0], parameters[1]));
+            case E_LENGTH:
+                if (parameters.size() != 1) throw RuntimeError("length expects exactly 1 argument");
+                return Expr(new Length(parameters[0]));
+            case E_REVERSE:
+                if (parameters.size() != 1) throw RuntimeError("reverse expects exactly 1 argument");
+                return Expr(new Reverse(parameters[0]));
+            case E_APPEND:
+                return Expr(new Append(parameters));
+            case E_APPLYFUNC:
+                if (parameters.size() < 2) throw RuntimeError("apply expects at least 2 arguments");
+                return Expr(new ApplyFunc(parameters));
+            case E_MAP:
+                if (parameters.size() < 2) throw RuntimeError("map expects at least 2 arguments");
+                return Expr(new Map(parameters));
+            case E_FOREACH:
+                if (parameters.size() < 2) throw RuntimeError("for-each expects at least 2 arguments");
+                return Expr(new ForEach(parameters));
+            case E_FOLDLEFT:
+                if (parameters.size() < 3) throw RuntimeError("fold-left expects at least 3 arguments");
+                return Expr(new FoldLeft(parameters));
+            case E_MAKEVECTOR:
+                if (parameters.size() != 1 && parameters.size() != 2) throw RuntimeError("make-vector expects 1 or 2 arguments");
+                return Expr(new MakeVector(parameters));
+            case E_VECTOR:
+                return Expr(new VectorFunc(parameters));
+            case E_VECTORREF:
+                if (parameters.size() != 2) throw RuntimeError("vector-ref expects exactly 2 arguments");
+                return Expr(new VectorRef(parameters[0], parameters[1]));
+            case E_VECTORSET:
+                if (parameters.size() != 3) throw RuntimeError("vector-set! expects exactly 3 arguments");
+                return Expr(new VectorSet(parameters));
+            case E_VECTORLENGTH:
+                if (parameters.size() != 1) throw RuntimeError("vector-length expects exactly 1 argument");
+                return Expr(new VectorLength(parameters[0]));
+            case E_MAKEHASHTABLE:
+                if (parameters.size() != 0) throw RuntimeError("make-hash-table expects exactly 0 arguments");
+                return Expr(new MakeHashTable(parameters));
+            case E_HASHREF:
+                if (parameters.size() != 2 && parameters.size() != 3) throw RuntimeError("hash-ref expects 2 or 3 arguments");
+                return Expr(new HashRef(parameters));
+            case E_HASHSET:
+                if (parameters.size() != 3) throw RuntimeError("hash-set! expects exactly 3 arguments");
+                return Expr(new HashSet(parameters));
+            case E_HASHCOUNT:
+                if (parameters.size() != 1) throw RuntimeError("hash-count expects exactly 1 argument");
+                return Expr(new HashCount(parameters[0]));
+            case E_MEMOIZE:
+                if (parameters.size() != 1 && parameters.size() != 2) throw RuntimeError("memoize expects 1 or 2 arguments");
+                return Expr(new Memoize(parameters));
+            case E_MEMOSTATS:
+                if (parameters.size() != 1) throw RuntimeError("memo-stats expects exactly 1 argument");
+                return Expr(new MemoStats(parameters[0]));
+            case E_FORCE:
+                if (parameters.size() != 1) throw RuntimeError("force expects exactly 1 argument");
+                return Expr(new Force(parameters[0]));
+            case E_STREAMCAR:
+                if (parameters.size() != 1) throw RuntimeError("stream-car expects exactly 1 argument");
+                return Expr(new StreamCar(parameters[0]));
+            case E_STREAMCDR:
+                if (parameters.size() != 1) throw RuntimeError("stream-cdr expects exactly 1 argument");
+                return Expr(new StreamCdr(parameters[0]));
             case E_NOT:
                 if (parameters.size() != 1) throw RuntimeError("not expects exactly 1 argument");
                 return Expr(new Not(parameters[0]));
@@ -169,6 +409,15 @@ Expr List::parse(Assoc &env) {
             case E_STRINGQ:
                 if (parameters.size() != 1) throw RuntimeError("string? expects exactly 1 argument");
                 return Expr(new IsString(parameters[0]));
+            case E_VECTORQ:
+                if (parameters.size() != 1) throw RuntimeError("vector? expects exactly 1 argument");
+                return Expr(new IsVector(parameters[0]));
+            case E_HASHTABLEQ:
+                if (parameters.size() != 1) throw RuntimeError("hash-table? expects exactly 1 argument");
+                return Expr(new IsHashTable(parameters[0]));
+            case E_PROMISEQ:
+                if (parameters.size() != 1) throw RuntimeError("promise? expects exactly 1 argument");
+                return Expr(new IsPromise(parameters[0]));
             case E_DISPLAY:
                 if (parameters.size() != 1) throw RuntimeError("display expects exactly 1 argument");
                 return Expr(new Display(parameters[0]));
@@ -178,14 +427,20 @@ Expr List::parse(Assoc &env) {
             case E_EXIT:
                 if (parameters.size() != 0) throw RuntimeError("exit expects exactly 0 arguments");
                 return Expr(new Exit());
+            case E_GCSTATS:
+                if (parameters.size() != 0) throw RuntimeError("gc-stats expects exactly 0 arguments");
+                return Expr(new GcStats());
+            case E_RUNTIMESTATS:
+                if (parameters.size() != 0) throw RuntimeError("runtime-stats expects exactly 0 arguments");
+                return Expr(new RuntimeStats());
 
             default:
                 throw RuntimeError("Primitive parser not yet implemented for: " + op);
         }
     }
 
-    if (reserved_words.count(op) != 0) {
-    	switch (reserved_words[op]) {
+    if (reservedType(id->id, op_type)) {
+    	switch (op_type) {
 			case E_BEGIN: {
                 // (begin expr ...)
                 std::vector<Expr> body_expr;
@@ -201,6 +456,28 @@ Expr List::parse(Assoc &env) {
                 }
                 return Expr(new Quote(stxs[1]));
             }
+            case E_PROFILE: {
+                // (profile expr)
+                if (stxs.size() != 2) {
+                    throw RuntimeError("Wrong number of arguments for profile");
+                }
+                return Expr(new Profile(stxs[1]->parse(env)));
+            }
+            case E_DELAY: {
+                // (delay expr)
+                if (stxs.size() != 2) {
+                    throw RuntimeError("Wrong number of arguments for delay");
+                }
+                return Expr(new Delay(stxs[1]->parse(env)));
+            }
+            case E_CONSSTREAM: {
+                // (cons-stream a b) => (cons a (delay b))
+                if (stxs.size() != 3) {
+                    throw RuntimeError("Wrong number of arguments for cons-stream");
+                }
+                Expr head = stxs[1]->parse(env);
+                return Expr(new Cons(head, Expr(new Delay(stxs[2]->parse(env)))));
+            }
             case E_IF: {
                 // (if cond conseq alter)
                 if (stxs.size() != 4) {
@@ -251,34 +528,36 @@ Expr List::parse(Assoc &env) {
                 if (!args_list) {
                     throw RuntimeError("lambda: parameters must be a list");
                 }
-                std::vector<std::string> parms;
+                std::vector<SymbolId> parms;
                 for (const auto& arg : args_list->stxs) {
                     auto name = dynamic_cast<SymbolSyntax*>(arg.get());
                     if (!name) {
                         throw RuntimeError("lambda: parameters must be symbols");
                     }
-                    parms.push_back(name->s);
-                }
-                Assoc env2 = env;
-                for (const auto& p : parms) {
-                    env2 = extend(p, Value(nullptr), env2);
+                    parms.push_back(name->id);
                 }
+                Scope env2(parms, env);
+                declareDefines(stxs, 2, env2);
+                SymbolId name = anonymousName(env);
                 if (stxs.size() == 3) {
-                    return Expr(new Lambda(parms, stxs[2]->parse(env2)));
+                    Expr body = stxs[2]->parse(env2);
+                    return makeLambda(parms, body, env2.names.size(), name);
                 } else {
                     std::vector<Expr> body_exprs;
                     for (size_t i = 2; i < stxs.size(); ++i) {
                         body_exprs.push_back(stxs[i]->parse(env2));
                     }
                     Expr body_expr_seq = Expr(new Begin(body_exprs));
-                    return Expr(new Lambda(parms, body_expr_seq));
+                    return makeLambda(parms, body_expr_seq, env2.names.size(), name);
                 }
 
             }
-            case E_DEFINE: {
+            case E_DEFINE:
+            case E_DEFINEMEMO: {
                 // (define <var> <expr>)
                 // (define <func> (lambda (<parm1> <parm2> ...) <expr1> <expr2> ...))
                 // (define (<func> <parm1> <parm2> ...) <expr1> <expr2> ...)
+                // define-memo takes the same forms and binds (memoize <expr>)
 
                 if (stxs.size() < 3) {
                     throw RuntimeError("define: too few arguments");
@@ -296,18 +575,19 @@ Expr List::parse(Assoc &env) {
                         throw RuntimeError("define: function name must be a symbol");
                     }
 
-                    std::vector<std::string> params;
+                    std::vector<SymbolId> params;
                     for (size_t i = 1; i < func_list->stxs.size(); ++i) {
                         auto param = dynamic_cast<SymbolSyntax*>(func_list->stxs[i].get());
                         if (param == nullptr) {
                             throw RuntimeError("define: parameter must be a symbol");
                         }
-                        params.push_back(param->s);
-                    }
-                    Assoc env2 = env;
-                    for (const auto& p : params) {
-                        env2 = extend(p, Value(nullptr), env2);
+                        params.push_back(param->id);
                     }
+                    // a local define owns a slot in the innermost frame
+                    int index = env.parent == nullptr ? -1 : env.declare(func_name->id);
+                    Scope env2(params, env);
+                    env2.owner = func_name->id;
+                    declareDefines(stxs, 2, env2);
                     std::vector<Expr> body_exprs;
                     for (size_t i = 2; i < stxs.size(); ++i) {
                         body_exprs.push_back(stxs[i]->parse(env2));
@@ -321,16 +601,30 @@ Expr List::parse(Assoc &env) {
                         lambda_body = Expr(new Begin(body_exprs));
                     }
 
-                    Expr lambda_expr = Expr(new Lambda(params, lambda_body));
-                    
-                    return Expr(new Define(func_name->s, lambda_expr));
+                    Expr lambda_expr = makeLambda(params, lambda_body, env2.names.size(), func_name->id);
+                    if (op_type == E_DEFINEMEMO) {
+                        lambda_expr = Expr(new Memoize({lambda_expr}));
+                    }
+                    if (index < 0) {
+                        env.defineGlobal(func_name->id);
+                    }
+                    return Expr(new Define(func_name->id, lambda_expr, index));
                 } else {
                     // (define var expr) or (define <func> (lambda ...))
                     auto var_name = dynamic_cast<SymbolSyntax*>(stxs[1].get());
                     if (var_name == nullptr) {
                         throw RuntimeError("define: variable of function name must be a symbol");
                     }
-                    return Expr(new Define(var_name->s, stxs[2]->parse(env)));
+                    int index = env.parent == nullptr ? -1 : env.declare(var_name->id);
+                    Expr value = stxs[2]->parse(env);
+                    nameLambda(value, var_name->id);
+                    if (op_type == E_DEFINEMEMO) {
+                        value = Expr(new Memoize({value}));
+                    }
+                    if (index < 0) {
+                        env.defineGlobal(var_name->id);
+                    }
+                    return Expr(new Define(var_name->id, value, index));
                 }
                 
             }
@@ -344,8 +638,8 @@ Expr List::parse(Assoc &env) {
                     throw RuntimeError(op + ": bindings must be in a list");
                 }
 
-                std::vector<std::pair<std::string, Expr>> bind;
-                std::vector<std::string> names;
+                std::vector<std::pair<SymbolId, Expr>> bind;
+                std::vector<SymbolId> names;
                 for (const auto& bind_pair_stx : bind_list->stxs) {
                     auto bind_pair = dynamic_cast<List*>(bind_pair_stx.get());
                     if (bind_pair == nullptr || bind_pair->stxs.size() != 2) {
@@ -356,13 +650,12 @@ Expr List::parse(Assoc &env) {
                         throw RuntimeError(op + ": variable in a binding must be a symbol");
                     }
                     auto expr = bind_pair->stxs[1]->parse(env);
-                    bind.push_back({var_name->s, expr});
-                    names.push_back(var_name->s);
-                }
-                Assoc env2 = env;
-                for (const auto& name : names) {
-                    env2 = extend(name, Value(nullptr), env2);
+                    nameLambda(expr, var_name->id);
+                    bind.push_back({var_name->id, expr});
+                    names.push_back(var_name->id);
                 }
+                Scope env2(names, env);
+                declareDefines(stxs, 2, env2);
                 Expr body(nullptr);
                 if (stxs.size() == 3) {
                     body = stxs[2]->parse(env2);
@@ -373,7 +666,7 @@ Expr List::parse(Assoc &env) {
                     }
                     body = Expr(new Begin(body_exprs));
                 }
-                return Expr(new Let(bind, body));
+                return Expr(new Let(bind, body, env2.names.size()));
             }
             case E_LETREC: {
                 // (letrec ((name expr) ...) body ...)
@@ -384,7 +677,7 @@ Expr List::parse(Assoc &env) {
                 if (bind_list == nullptr) {
                     throw RuntimeError(op + ": bindings must be in a list");
                 }
-                Assoc env2 = env;
+                std::vector<SymbolId> names;
                 for (const auto& bind_pair_stx : bind_list->stxs) {
                     auto bind_pair = dynamic_cast<List*>(bind_pair_stx.get());
                     if (bind_pair == nullptr || bind_pair->stxs.size() != 2) {
@@ -394,15 +687,18 @@ Expr List::parse(Assoc &env) {
                     if (var_name == nullptr) {
                         throw RuntimeError(op + ": variable in a binding must be a symbol");
                     }
-                    env2 = extend(var_name->s, Value(nullptr), env2);
+                    names.push_back(var_name->id);
                 }
+                Scope env2(names, env);
+                declareDefines(stxs, 2, env2);
 
-                std::vector<std::pair<std::string, Expr>> bind;
+                std::vector<std::pair<SymbolId, Expr>> bind;
                 for (const auto& bind_pair_stx : bind_list->stxs) {
                     auto bind_pair = dynamic_cast<List*>(bind_pair_stx.get());
                     auto var_name = dynamic_cast<SymbolSyntax*>(bind_pair->stxs[0].get());
                     auto expr = bind_pair->stxs[1]->parse(env2);
-                    bind.push_back({var_name->s, expr});
+                    nameLambda(expr, var_name->id);
+                    bind.push_back({var_name->id, expr});
                 }
 
                 Expr body(nullptr);
@@ -415,7 +711,7 @@ Expr List::parse(Assoc &env) {
                     }
                     body = Expr(new Begin(body_exprs));
                 }
-                return Expr(new Letrec(bind, body));   
+                return Expr(new Letrec(bind, body, env2.names.size()));   
             }
             case E_SET: {
                 // (set! var expr)
@@ -427,14 +723,18 @@ Expr List::parse(Assoc &env) {
                     throw RuntimeError("set!: variable must be a symbol");
                 }
                 Expr expr = stxs[2]->parse(env);
-                return Expr(new Set(var_name->s, expr));
+                int depth, index;
+                if (!env.resolve(var_name->id, depth, index)) {
+                    env.defineGlobal(var_name->id);
+                }
+                return Expr(new Set(var_name->id, expr, depth, index));
             }
         	default:
             	throw RuntimeError("Unknown reserved word: " + op);
     	}
     }
 
-    Expr rator = Expr(new Var(op));
+    Expr rator = makeVar(id->id, env);
     std::vector<Expr> rands;
     for (size_t i = 1; i < stxs.size(); ++i) {
         rands.push_back(stxs[i]->parse(env));
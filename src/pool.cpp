@@ -0,0 +1,90 @@
+/**
+ * @file pool.cpp
+ * @brief Work-stealing scheduler behind runTasks
+ */
+
+#include "pool.hpp"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+/// Indices of the tasks dealt to one worker
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+};
+
+bool popBack(WorkQueue &q, size_t &task) {
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty()) {
+        return false;
+    }
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+}
+
+bool stealFront(WorkQueue &q, size_t &task) {
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty()) {
+        return false;
+    }
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+void work(const std::vector<Task> &tasks, std::vector<std::unique_ptr<WorkQueue>> &queues, size_t self,
+          const Task &at_exit) {
+    const size_t n = queues.size();
+    size_t task;
+    for (;;) {
+        if (popBack(*queues[self], task)) {
+            tasks[task]();
+            continue;
+        }
+        // no task is ever added, so once every queue is empty the batch is done
+        bool stole = false;
+        for (size_t i = 1; i < n && !stole; ++i) {
+            stole = stealFront(*queues[(self + i) % n], task);
+        }
+        if (!stole) {
+            break;
+        }
+        tasks[task]();
+    }
+    if (at_exit) {
+        at_exit();
+    }
+}
+
+} // namespace
+
+void runTasks(const std::vector<Task> &tasks, unsigned threads, const Task &at_exit) {
+    size_t n = std::min<size_t>(std::max(1u, threads), tasks.size());
+    if (n <= 1) {
+        for (const Task &task : tasks) {
+            task();
+        }
+        return;
+    }
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (size_t i = 0; i < n; ++i) {
+        queues.emplace_back(new WorkQueue());
+    }
+    // dealt in reverse so that each worker starts on its earliest task
+    for (size_t t = tasks.size(); t-- > 0;) {
+        queues[t % n]->tasks.push_back(t);
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < n; ++i) {
+        workers.emplace_back(work, std::cref(tasks), std::ref(queues), i, std::cref(at_exit));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+/**
+ * @file pool.hpp
+ * @brief Work-stealing thread pool for batches of independent tasks
+ *
+ * Tasks are dealt round-robin onto one deque per worker. A worker runs
+ * tasks from the back of its own deque and, once that is empty, steals
+ * from the front of the others, so a few slow programs do not leave the
+ * rest of the pool idle while one worker's share is still queued.
+ */
+
+#include <functional>
+#include <vector>
+
+using Task = std::function<void()>;
+
+/**
+ * @brief Run every task on up to the given number of threads
+ *
+ * Returns once all tasks have finished. A single thread runs the tasks
+ * in order on the calling thread; otherwise each task runs on a new
+ * worker thread, which calls at_exit (if set) once it has no work left,
+ * to release whatever per-thread state the tasks built up. Tasks must not
+ * throw.
+ */
+void runTasks(const std::vector<Task> &, unsigned, const Task &at_exit = Task());
+
+#endif // POOL_HPP
@@ -0,0 +1,255 @@
+/**
+ * @file printer.cpp
+ * @brief Cycle detection and output of values for Printer
+ */
+
+#include "printer.hpp"
+#include <charconv>
+#include <memory>
+
+namespace {
+
+// the buffer of this thread's printers; one nested in another, or still
+// running when it is taken, makes its own
+thread_local std::unique_ptr<std::string> spare_buffer;
+
+bool isContainer(const Value &v) {
+    return v.isHeap() && (v->v_type == V_PAIR || v->v_type == V_VECTOR);
+}
+
+size_t childCount(ValueBase *o) {
+    return o->v_type == V_PAIR ? 2 : static_cast<Vector*>(o)->items.size();
+}
+
+const Value &child(ValueBase *o, size_t i) {
+    if (o->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(o);
+        return i == 0 ? p->car : p->cdr;
+    }
+    return static_cast<Vector*>(o)->items[i];
+}
+
+} // namespace
+
+Printer::Printer(std::ostream &os)
+    : os(os), buf(spare_buffer ? spare_buffer.release() : new std::string()), next_label(0) {
+    buf->reserve(BLOCK);
+}
+
+Printer::~Printer() {
+    flush();
+    if (spare_buffer) {
+        delete buf;
+    } else {
+        spare_buffer.reset(buf);
+    }
+}
+
+void Printer::append(const char *s, size_t n) {
+    buf->append(s, n);
+    if (buf->size() >= BLOCK) {
+        flush();
+    }
+}
+
+void Printer::flush() {
+    if (!buf->empty()) {
+        os.write(buf->data(), buf->size());
+        buf->clear();
+    }
+}
+
+void Printer::integer(long long n) {
+    char text[24];
+    char *end = std::to_chars(text, text + sizeof(text), n).ptr;
+    append(text, end - text);
+}
+
+/**
+ * Depth-first walk of the lists and vectors under root, marking every
+ * object that is reached again while it is still being walked. Only
+ * objects with more than one reference are recorded; a single-reference
+ * object is left as soon as its last element is taken, so the cdr chain
+ * of a fresh list never builds up on the stack.
+ */
+void Printer::findCycles(const Value &root) {
+    std::unordered_map<const ValueBase*, bool> inside;   // shared objects seen: still being walked
+    levels.push_back({root.get(), 0});
+    if (root->refs > 1) {
+        inside[root.get()] = true;
+    }
+    while (!levels.empty()) {
+        Level &top = levels.back();
+        ValueBase *o = top.object;
+        size_t count = childCount(o);
+        size_t i = top.index++;
+        if (i == count) {
+            if (o->refs > 1) {
+                inside[o] = false;
+            }
+            levels.pop_back();
+            continue;
+        }
+        const Value &v = child(o, i);
+        if (i == 0 && o->v_type == V_PAIR && !isContainer(static_cast<Pair*>(o)->cdr)) {
+            top.index = count;   // nothing to walk in the cdr
+        }
+        if (top.index == count && o->refs == 1) {
+            levels.pop_back();
+        }
+        if (!isContainer(v)) {
+            continue;
+        }
+        ValueBase *c = v.get();
+        if (c->refs > 1) {
+            auto it = inside.find(c);
+            if (it != inside.end()) {
+                if (it->second) {
+                    labels[c] = -1;
+                }
+                continue;
+            }
+            inside[c] = true;
+        }
+        levels.push_back({c, 0});
+    }
+}
+
+// the label of a cyclic object: its back reference once it has been
+// printed, which ends that branch, or its definition ahead of it
+bool Printer::reference(ValueBase *o) {
+    long &label = labels[o];
+    put('#');
+    if (label >= 0) {
+        integer(label);
+        put('#');
+        return true;
+    }
+    label = next_label++;
+    integer(label);
+    put('=');
+    return false;
+}
+
+void Printer::atom(const Value &v) {
+    if (v.isFixnum()) {
+        integer(v.fixnum());
+        return;
+    }
+    switch (v->v_type) {
+        case V_BOOL:
+            append(static_cast<Boolean*>(v.get())->b ? "#t" : "#f", 2);
+            break;
+        case V_NULL:
+        case V_TERMINATE:
+            append("()", 2);
+            break;
+        case V_VOID:
+            append("#<void>", 7);
+            break;
+        case V_SYM:
+            append(static_cast<Symbol*>(v.get())->s);
+            break;
+        case V_STRING:
+            put('"');
+            append(static_cast<String*>(v.get())->s);
+            put('"');
+            break;
+        case V_BIGINT:
+            append(static_cast<BigInteger*>(v.get())->n.toString());
+            break;
+        case V_PROC:
+        case V_PRIMITIVE:
+            append("#<procedure>", 12);
+            break;
+        default:
+            flush();
+            v->show(os);
+    }
+}
+
+// the element to print after the one just printed, closing every list
+// and vector that it ends; nullptr once the outermost one is closed
+const Value *Printer::next() {
+    while (!levels.empty()) {
+        Level &top = levels.back();
+        if (top.object == nullptr) {
+            put(')');
+            levels.pop_back();
+            continue;
+        }
+        if (top.object->v_type == V_PAIR) {
+            const Value &cdr = static_cast<Pair*>(top.object)->cdr;
+            if (cdr.isHeap() && cdr->v_type == V_PAIR && !labelled(cdr.get())) {
+                put(' ');
+                top.object = cdr.get();
+                return &static_cast<Pair*>(top.object)->car;
+            }
+            if (cdr->v_type == V_NULL) {
+                put(')');
+                levels.pop_back();
+                continue;
+            }
+            // a labelled pair in the cdr is printed as a dotted tail too
+            append(" . ", 3);
+            top.object = nullptr;
+            return &cdr;
+        }
+        Vector *vec = static_cast<Vector*>(top.object);
+        if (++top.index < vec->items.size()) {
+            put(' ');
+            return &vec->items[top.index];
+        }
+        put(')');
+        levels.pop_back();
+    }
+    return nullptr;
+}
+
+void Printer::write(const Value &v) {
+    if (!isContainer(v)) {
+        atom(v);
+        return;
+    }
+    labels.clear();
+    next_label = 0;
+    if (structureMutated()) {
+        findCycles(v);
+    }
+    const Value *cur = &v;
+    while (cur != nullptr) {
+        if (!isContainer(*cur)) {
+            atom(*cur);
+            cur = next();
+            continue;
+        }
+        ValueBase *o = cur->get();
+        if (labelled(o) && reference(o)) {
+            cur = next();
+            continue;
+        }
+        if (o->v_type == V_PAIR) {
+            put('(');
+            levels.push_back({o, 0});
+            cur = &static_cast<Pair*>(o)->car;
+            continue;
+        }
+        Vector *vec = static_cast<Vector*>(o);
+        append("#(", 2);
+        if (vec->items.empty()) {
+            put(')');
+            cur = next();
+            continue;
+        }
+        levels.push_back({o, 0});
+        cur = &vec->items[0];
+    }
+}
+
+void Printer::display(const Value &v) {
+    if (v.isHeap() && v->v_type == V_STRING) {
+        append(static_cast<String*>(v.get())->s);
+        return;
+    }
+    write(v);
+}
@@ -0,0 +1,78 @@
+#ifndef PRINTER_HPP
+#define PRINTER_HPP
+
+/**
+ * @file printer.hpp
+ * @brief Buffered, iterative printer of values
+ *
+ * Output is collected in a per-thread buffer and handed to the stream in
+ * blocks, rather than through one stream insertion per token. Lists and
+ * vectors are walked with an explicit stack, one entry per level of
+ * nesting and none per element, so a long list prints in constant C++
+ * stack; fixnums are formatted with std::to_chars.
+ *
+ * Once the thread has mutated a pair or vector (see noteMutation), a
+ * first pass looks for the objects a list or vector reaches again while
+ * still inside them. Those are printed with datum labels, as
+ * `#0=(1 2 . #0#)`, so a structure made cyclic by set-car!, set-cdr! or
+ * vector-set! prints finitely; structure that is only shared prints as
+ * before. An object held by a single reference cannot be reached twice,
+ * so the pass only records the shared ones.
+ */
+
+#include "value.hpp"
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Printer {
+public:
+    static const size_t BLOCK = 1 << 16;   ///< Buffered bytes that are handed to the stream at once
+
+    explicit Printer(std::ostream &);
+    ~Printer();                         ///< Flushes what is still buffered
+    Printer(const Printer &) = delete;
+    Printer &operator=(const Printer &) = delete;
+
+    /// External representation of a value, strings in double quotes
+    void write(const Value &);
+    /// As write, except that a string is printed as its characters
+    void display(const Value &);
+    void put(char c) {
+        buf->push_back(c);
+        if (buf->size() >= BLOCK) {
+            flush();
+        }
+    }
+    void append(const char *, size_t);
+    void append(const std::string &s) {
+        append(s.data(), s.size());
+    }
+    void flush();
+
+private:
+    /// A list or vector being printed: the pair whose car was just printed,
+    /// or the vector and the index of that element; nullptr closes a dotted tail
+    struct Level {
+        ValueBase *object;
+        size_t index;
+    };
+
+    std::ostream &os;
+    std::string *buf;
+    std::vector<Level> levels;
+    std::unordered_map<const ValueBase*, long> labels;  ///< Cyclic objects, -1 until printed
+    long next_label;
+
+    void findCycles(const Value &);
+    bool labelled(const ValueBase *o) const {
+        return !labels.empty() && labels.count(o) != 0;
+    }
+    bool reference(ValueBase *);
+    void atom(const Value &);
+    void integer(long long);
+    const Value *next();
+};
+
+#endif // PRINTER_HPP
@@ -0,0 +1,237 @@
+/**
+ * @file profile.cpp
+ * @brief Call timing, flat profile and collapsed stacks
+ */
+
+#include "profile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+thread_local bool profiling = false;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/// One calling context; node 0 is the root above every toplevel call
+struct CallNode {
+    SymbolId name;
+    int parent;
+    std::vector<std::pair<SymbolId, int>> children;
+    int64_t self_ns;
+};
+
+/// An open call: its node, when it started and how long its callees ran
+struct Activation {
+    int node;
+    int chain;           ///< Node of the ordinary call its tail calls started from
+    Clock::time_point start;
+    int64_t callee_ns;
+};
+
+/// Flat profile line of one procedure
+struct Totals {
+    uint64_t calls;
+    int64_t self_ns;
+    int64_t total_ns;    ///< Counted on the outermost activation only
+    int active;          ///< Activations currently open, for recursion
+};
+
+struct ProfileState {
+    std::vector<CallNode> tree;
+    std::vector<Activation> stack;
+    std::vector<Totals> totals;   ///< Indexed by SymbolId + 1
+    int sessions = 0;
+    Clock::time_point started;
+    std::string output;
+};
+
+thread_local ProfileState prof;
+
+const std::string &procName(SymbolId name) {
+    static const std::string anonymous = "lambda";
+    return name < 0 ? anonymous : symbolName(name);
+}
+
+Totals &totalsOf(SymbolId name) {
+    if ((size_t)(name + 1) >= prof.totals.size()) {
+        prof.totals.resize(name + 2, Totals{0, 0, 0, 0});
+    }
+    return prof.totals[name + 1];
+}
+
+int childOf(int parent, SymbolId name) {
+    // directly recursive calls stay on their caller's node
+    if (parent != 0 && prof.tree[parent].name == name) {
+        return parent;
+    }
+    for (const auto &child : prof.tree[parent].children) {
+        if (child.first == name) {
+            return child.second;
+        }
+    }
+    int node = (int)prof.tree.size();
+    prof.tree.push_back(CallNode{name, parent, {}, 0});
+    prof.tree[parent].children.push_back({name, node});
+    return node;
+}
+
+void reset() {
+    prof.tree.assign(1, CallNode{-1, -1, {}, 0});
+    prof.stack.clear();
+    prof.totals.clear();
+}
+
+void writeCollapsed(std::ostream &os, int node, std::string &path) {
+    const CallNode &n = prof.tree[node];
+    size_t mark = path.size();
+    if (node != 0) {
+        if (!path.empty()) {
+            path += ';';
+        }
+        path += procName(n.name);
+        if (n.self_ns > 0) {
+            os << path << ' ' << n.self_ns << '\n';
+        }
+    }
+    for (const auto &child : n.children) {
+        writeCollapsed(os, child.second, path);
+    }
+    path.resize(mark);
+}
+
+void report(std::ostream &os) {
+    double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - prof.started).count();
+    std::vector<SymbolId> names;
+    uint64_t calls = 0;
+    for (size_t i = 0; i < prof.totals.size(); ++i) {
+        if (prof.totals[i].calls > 0) {
+            names.push_back((SymbolId)i - 1);
+            calls += prof.totals[i].calls;
+        }
+    }
+    std::sort(names.begin(), names.end(), [](SymbolId a, SymbolId b) {
+        return totalsOf(a).self_ns > totalsOf(b).self_ns;
+    });
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "profile: %.3f ms, %llu calls\n", elapsed_ms,
+                  (unsigned long long)calls);
+    os << line;
+    std::snprintf(line, sizeof(line), "%12s %12s %12s %7s  %s\n", "calls", "self ms", "total ms",
+                  "self %", "procedure");
+    os << line;
+    for (SymbolId name : names) {
+        const Totals &t = totalsOf(name);
+        double self_ms = t.self_ns / 1e6;
+        std::snprintf(line, sizeof(line), "%12llu %12.3f %12.3f %6.1f%%  ", (unsigned long long)t.calls,
+                      self_ms, t.total_ns / 1e6, elapsed_ms > 0 ? 100 * self_ms / elapsed_ms : 0.0);
+        os << line << procName(name) << '\n';
+    }
+
+    if (!prof.output.empty()) {
+        std::ofstream out(prof.output);
+        std::string path;
+        writeCollapsed(out, 0, path);
+        if (!out) {
+            os << "profile: cannot write " << prof.output << '\n';
+        }
+    }
+}
+
+} // namespace
+
+void profileStart() {
+    if (prof.sessions++ == 0) {
+        reset();
+        prof.started = Clock::now();
+        profiling = true;
+    }
+}
+
+void profileStop(std::ostream &os) {
+    if (prof.sessions == 0 || --prof.sessions > 0) {
+        return;
+    }
+    profileUnwind(0);
+    profiling = false;
+    report(os);
+}
+
+void setProfileOutput(const std::string &path) {
+    prof.output = path;
+}
+
+void profileEnter(SymbolId name) {
+    int parent = prof.stack.empty() ? 0 : prof.stack.back().node;
+    Totals &t = totalsOf(name);
+    ++t.calls;
+    ++t.active;
+    int node = childOf(parent, name);
+    prof.stack.push_back(Activation{node, node, Clock::now(), 0});
+}
+
+void profileLeave() {
+    if (prof.stack.empty()) {
+        return;
+    }
+    Activation a = prof.stack.back();
+    prof.stack.pop_back();
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - a.start).count();
+    int64_t self = elapsed - a.callee_ns;
+    CallNode &node = prof.tree[a.node];
+    node.self_ns += self;
+    Totals &t = totalsOf(node.name);
+    t.self_ns += self;
+    if (--t.active == 0) {
+        t.total_ns += elapsed;
+    }
+    if (!prof.stack.empty()) {
+        prof.stack.back().callee_ns += elapsed;
+    }
+}
+
+void profileTailCall(SymbolId name) {
+    if (prof.stack.empty()) {
+        profileEnter(name);
+        return;
+    }
+    int from = prof.stack.back().node;
+    int chain = prof.stack.back().chain;
+    profileLeave();
+    // the callee is drawn under the frame it replaced; a procedure already
+    // on this chain of tail calls folds back onto its node, so a tail loop
+    // through several procedures stays a bounded path
+    int node = -1;
+    for (int n = from;; n = prof.tree[n].parent) {
+        if (prof.tree[n].name == name) {
+            node = n;
+            break;
+        }
+        if (n == chain) {
+            break;
+        }
+    }
+    if (node < 0) {
+        node = childOf(from, name);
+    }
+    Totals &t = totalsOf(name);
+    ++t.calls;
+    ++t.active;
+    prof.stack.push_back(Activation{node, chain, Clock::now(), 0});
+}
+
+size_t profileDepth() {
+    return prof.stack.size();
+}
+
+void profileUnwind(size_t depth) {
+    while (prof.stack.size() > depth) {
+        profileLeave();
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+/**
+ * @file profile.hpp
+ * @brief Call profiler for Scheme procedures
+ *
+ * While a profile is running every call of a compound procedure is timed,
+ * on the tree-walker and on the VM alike. Procedures are reported under
+ * the define, let or letrec name they were bound to; an anonymous lambda
+ * is reported as "owner/lambda" after the named procedure whose body it
+ * appears in. A tail call ends the caller's entry and starts the callee's,
+ * so a loop shows up as one entry per iteration rather than as a stack.
+ *
+ * Stopping a profile prints a flat profile (calls, self and inclusive
+ * time per procedure) and, when an output file was set, writes the call
+ * tree as collapsed stacks, one `a;b;c weight` line per path with the
+ * path's self time in nanoseconds, ready for flamegraph.pl. A tail callee
+ * is drawn under the frame it replaced, so `go;sq` rather than a toplevel
+ * `sq`. Direct recursion, and a tail call back to a procedure already on
+ * the chain of tail calls, fold into the existing frame to keep deep
+ * recursion from producing one path per level.
+ *
+ * When no profile is running the evaluator only tests `profiling` once
+ * per procedure call.
+ */
+
+#include "Def.hpp"
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+/// Whether calls are being timed on this thread; checked before every hook
+extern thread_local bool profiling;
+
+/**
+ * @brief Start a profile, or join the one already running
+ *
+ * Profiles nest: only the outermost start clears the previous results.
+ */
+void profileStart();
+
+/**
+ * @brief Leave a profile; the outermost stop reports to the stream
+ */
+void profileStop(std::ostream &);
+
+/**
+ * @brief File that receives the collapsed stacks, none if empty
+ */
+void setProfileOutput(const std::string &);
+
+/// A compound procedure starts running
+void profileEnter(SymbolId);
+/// The running procedure returns
+void profileLeave();
+/// The running procedure is replaced by a tail call
+void profileTailCall(SymbolId);
+
+/// Entries currently open, as a mark for profileUnwind
+size_t profileDepth();
+/// Close the entries opened after a mark, when an error unwinds them
+void profileUnwind(size_t);
+
+/**
+ * @brief Open entry for the lifetime of a C++ scope, closed on unwinding
+ */
+struct ProfileEntry {
+    explicit ProfileEntry(SymbolId name) { profileEnter(name); }
+    ~ProfileEntry() { profileLeave(); }
+};
+
+#endif // PROFILE_HPP
@@ -0,0 +1,167 @@
+/**
+ * @file readahead.cpp
+ * @brief Reader thread and form queue behind ReadAhead
+ */
+
+#include "readahead.hpp"
+#include <cerrno>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @brief Stream buffer over a descriptor whose reads a stop can interrupt
+ *
+ * A read waits on both the descriptor and a wake pipe, so the reader thread
+ * does not keep the REPL from exiting while a pipe stays open.
+ */
+class FdInput : public std::streambuf {
+public:
+    FdInput(int fd, int wake) : fd(fd), wake(wake) {}
+
+protected:
+    virtual int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        while (true) {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {wake, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return traits_type::eof();
+            }
+            if (fds[1].revents != 0) {
+                return traits_type::eof();
+            }
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return traits_type::eof();
+            }
+            setg(chunk, chunk, chunk + n);
+            return traits_type::to_int_type(*gptr());
+        }
+    }
+
+private:
+    int fd;
+    int wake;
+    char chunk[1 << 16];
+};
+
+} // namespace
+
+ReadAhead::ReadAhead(int fd, size_t capacity)
+    : capacity(capacity), done(false), stop(false), starved(false), full(false), direct(false) {
+    if (pipe(wake) != 0) {
+        wake[0] = wake[1] = -1; // poll skips a negative descriptor
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        reader.reset(new Reader(fd));
+    } else {
+        input.reset(new FdInput(fd, wake[0]));
+        stream.reset(new std::istream(input.get()));
+        reader.reset(new Reader(*stream));
+    }
+    thread = std::thread(&ReadAhead::produce, this);
+}
+
+ReadAhead::~ReadAhead() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    writable.notify_all();
+    if (wake[1] >= 0) {
+        char byte = 0;
+        ssize_t ignored = write(wake[1], &byte, 1);
+        (void)ignored;
+    }
+    thread.join();
+    if (wake[0] >= 0) {
+        close(wake[0]);
+        close(wake[1]);
+    }
+}
+
+void ReadAhead::produce() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stop) {
+        guard.unlock();
+        // the reader is only touched here until done is set
+        Syntax form;
+        bool end = reader->atEnd();
+        if (!end) {
+            form = reader->read();
+        }
+        guard.lock();
+        if (end) {
+            break;
+        }
+        while (forms.size() >= capacity && !stop) {
+            full = true;
+            writable.wait(guard);
+        }
+        full = false;
+        if (stop) {
+            break;
+        }
+        forms.push_back(form);
+        // signal only a waiting REPL: a wakeup per form costs more than
+        // building most forms
+        if (starved) {
+            readable.notify_one();
+        }
+    }
+    done = true;
+    readable.notify_all();
+}
+
+bool ReadAhead::atEnd() {
+    if (direct) {
+        return reader->atEnd();
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    while (forms.empty() && !done) {
+        starved = true;
+        readable.wait(guard);
+    }
+    starved = false;
+    if (forms.empty()) {
+        // the reader thread has stopped at the end of the input; any
+        // further reads behave as they would on a plain Reader
+        direct = true;
+        guard.unlock();
+        return reader->atEnd();
+    }
+    return false;
+}
+
+Syntax ReadAhead::read() {
+    if (atEnd() || direct) {
+        return reader->read();
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    Syntax form = forms.front();
+    forms.pop_front();
+    // let the queue drain halfway, so the reader thread refills it in
+    // one stretch rather than a form per wakeup
+    if (full && forms.size() <= capacity / 2) {
+        writable.notify_one();
+    }
+    return form;
+}
+
+void ReadAhead::resync() {
+    // queued forms already start after the failing one
+    if (direct) {
+        reader->resync();
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef READAHEAD_HPP
+#define READAHEAD_HPP
+
+/**
+ * @file readahead.hpp
+ * @brief Reader thread for the REPL on piped or redirected input
+ *
+ * A second thread lexes the input and builds the Syntax trees of the next
+ * toplevel forms into a bounded queue while the current one is parsed and
+ * evaluated, so reading never waits for evaluation and the reverse. Only
+ * Syntax is built ahead: parsing depends on the definitions made so far
+ * and stays on the evaluating thread.
+ *
+ * After an error the REPL resumes at the token that follows the failing
+ * form, so the queue needs no repair: its next form is the one a plain
+ * Reader would read next, even when it starts on the same line.
+ */
+
+#include "syntax.hpp"
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
+class ReadAhead {
+public:
+    /**
+     * @brief Start reading the file descriptor on a new thread
+     *
+     * A regular file is mapped whole; anything else is read as it arrives.
+     * At most capacity forms are held before the reader thread waits.
+     */
+    explicit ReadAhead(int fd, size_t capacity = 64);
+    ~ReadAhead();            ///< Stops the reader thread, even mid-read
+    ReadAhead(const ReadAhead &) = delete;
+    ReadAhead &operator=(const ReadAhead &) = delete;
+
+    /// The next form in input order, as Reader::read would return it
+    Syntax read();
+    /// Only whitespace and comments remain
+    bool atEnd();
+    /// Resume after an error, as Reader::resync does
+    void resync();
+
+private:
+    int wake[2];                        ///< Pipe that interrupts a blocked read
+    std::unique_ptr<std::streambuf> input;
+    std::unique_ptr<std::istream> stream;
+    std::unique_ptr<Reader> reader;
+
+    std::mutex lock;
+    std::condition_variable readable;   ///< A form was queued, or input ended
+    std::condition_variable writable;   ///< A form was taken, or stop was set
+    std::deque<Syntax> forms;
+    size_t capacity;
+    bool done;                          ///< The reader thread has finished
+    bool stop;
+    bool starved;                       ///< The REPL waits for a form
+    bool full;                          ///< The reader thread waits for room
+    bool direct;                        ///< Input ended; reading on this thread
+    std::thread thread;
+
+    void produce();
+};
+
+#endif // READAHEAD_HPP
@@ -1,18 +1,24 @@
 #include "syntax.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <cstring>
 #include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 Syntax::Syntax(SyntaxBase *stx) : ptr(stx) {}
 SyntaxBase* Syntax::operator->() const { return ptr.get(); }
 SyntaxBase& Syntax::operator*() { return *ptr; }
 SyntaxBase* Syntax::get() const { return ptr.get(); }
 
-Number::Number(int n) : n(n) {}
+Number::Number(const std::string &digits) : digits(digits) {}
 void Number::show(std::ostream &os) {
-    os << "the-number-" << n;
+    os << "the-number-" << digits;
 }
 
-RationalSyntax::RationalSyntax(int num, int den) : numerator(num), denominator(den) {}
+RationalSyntax::RationalSyntax(const std::string &num, const std::string &den) : numerator(num), denominator(den) {}
 void RationalSyntax::show(std::ostream &os) {
     os << numerator << "/" << denominator;
 }
@@ -25,7 +31,7 @@ void FalseSyntax::show(std::ostream &os) {
     os << "#f";
 }
 
-SymbolSyntax::SymbolSyntax(const std::string &s1) : s(s1) {}
+SymbolSyntax::SymbolSyntax(const std::string &s1) : s(s1), id(intern(s1)) {}
 void SymbolSyntax::show(std::ostream &os) {
     os << s;
 }
@@ -44,180 +50,253 @@ void List::show(std::ostream &os) {
     os << ')';
 }
 
-std::istream &readSpace(std::istream &is) {
-    while (true) {
-        // 跳过空白字符
-        while (isspace(is.peek()))
-            is.get();
-        
-        // 检查是否是注释
-        if (is.peek() == ';') {
-            // 跳过注释直到行末
-            while (is.peek() != '\n' && is.peek() != EOF)
-                is.get();
-        // 继续循环以跳过注释后的空白字符
-        } else {
-            // 没有更多空白字符或注释，退出循环
-            break;
+// ============================================================================
+// Reader
+// ============================================================================
+
+Reader::Reader(std::istream &is)
+    : is(&is), pos(nullptr), end(nullptr), mapping(nullptr), mapping_size(0) {}
+
+Reader::Reader(int fd)
+    : is(nullptr), pos(nullptr), end(nullptr), mapping(nullptr), mapping_size(0) {
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && offset >= 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapping = p;
+            mapping_size = st.st_size;
+            pos = static_cast<const char*>(p) + std::min((off_t)st.st_size, offset);
+            end = static_cast<const char*>(p) + st.st_size;
+            return;
         }
     }
-    return is;
+    // not mappable (a pipe, or an empty file): read everything up front
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer.append(chunk, n);
+    }
+    pos = buffer.data();
+    end = pos + buffer.size();
 }
 
-Syntax readList(std::istream &is);
+Reader::Reader(std::string_view text)
+    : is(nullptr), pos(text.data()), end(text.data() + text.size()), mapping(nullptr), mapping_size(0) {}
 
-// Helper function to try parsing as integer or rational
-bool tryParseNumber(const std::string &s, int &result) {
-    bool neg = false;
-    int n = 0;
-    int i = 0;
-    
-    // Single '+' or '-' are not numbers
-    if (s.size() == 1 && (s[0] == '+' || s[0] == '-'))
-        return false;
-    
-    // Handle sign
-    if (s[0] == '-') {
-        i += 1;
-        neg = true;
-    } else if (s[0] == '+') {
-        i += 1;
-    }
-    
-    // Check if all remaining characters are digits
-    for (; i < s.size(); i++) {
-        if ('0' <= s[i] && s[i] <= '9') {
-        n = n * 10 + s[i] - '0';
-        } else {
-        return false;  // Not a valid number
-        }
+Reader::~Reader() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
     }
-    
-    result = neg ? -n : n;
-    return true;
 }
 
-// Helper function to try parsing as rational number
-bool tryParseRational(const std::string &s, int &numerator, int &denominator) {
-    size_t slash_pos = s.find('/');
-    if (slash_pos == std::string::npos || slash_pos == 0 || slash_pos == s.size() - 1) {
-        return false; // No slash or slash at beginning/end
-    }
-    
-    std::string num_str = s.substr(0, slash_pos);
-    std::string den_str = s.substr(slash_pos + 1);
-    
-    // Parse numerator (can be negative)
-    if (!tryParseNumber(num_str, numerator)) {
+// pulls in the next line; only called once the buffer is used up
+bool Reader::refill() {
+    if (is == nullptr) {
         return false;
     }
-    
-    // Parse denominator (must be positive)
-    if (!tryParseNumber(den_str, denominator) || denominator <= 0) {
+    if (!std::getline(*is, buffer)) {
         return false;
     }
-    
+    if (!is->eof()) {
+        buffer.push_back('\n');
+    }
+    pos = buffer.data();
+    end = pos + buffer.size();
     return true;
 }
 
-// Helper function to create identifier/symbol syntax
-Syntax createIdentifierSyntax(const std::string &s) {
-    if (s == "#t")
-        return Syntax(new TrueSyntax());
-    if (s == "#f")
-        return Syntax(new FalseSyntax());
-    return Syntax(new SymbolSyntax(s));
+inline int Reader::peek() {
+    if (pos == end && !refill()) {
+        return EOF;
+    }
+    return (unsigned char)*pos;
+}
+
+// the failing form has been read whole, so reading simply goes on
+// from the token after it; only a stream's error state is reset
+void Reader::resync() {
+    if (is != nullptr) {
+        is->clear();
+    }
+}
+
+static inline bool isDelimiter(int c) {
+    // ';' also ends a token: a comment may follow without a space
+    return c == '(' || c == ')' || c == '[' || c == ']' || c == ';' ||
+           c == EOF || isspace(c);
+}
+
+void Reader::skipSpace() {
+    while (true) {
+        // 跳过空白字符
+        while (pos != end && isspace((unsigned char)*pos))
+            ++pos;
+        if (pos == end) {
+            if (!refill())
+                return;
+            continue;
+        }
+        // 检查是否是注释
+        if (*pos != ';')
+            return;
+        // 跳过注释直到行末
+        const char *nl = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        pos = nl != nullptr ? nl : end;
+    }
+}
+
+Syntax Reader::read() {
+    skipSpace();
+    return readItem();
+}
+
+bool Reader::atEnd() {
+    skipSpace();
+    return peek() == EOF;
 }
 
 // no leading space
-Syntax readItem(std::istream &is) {
-    if (is.peek() == '(' || is.peek() == '[') {
-        is.get();
-        return readList(is);
-    }
-    if (is.peek() == '\'') {
-        is.get();
-        // 读取单引号后的语法元素
-        Syntax quoted_syntax = readItem(is);
-    
-        // 创建 (quote <syntax>) 的列表结构
+Syntax Reader::readItem() {
+    int c = peek();
+    if (c == '(' || c == '[') {
+        ++pos;
+        return readList();
+    }
+    if (c == '\'') {
+        ++pos;
+        // 读取单引号后的语法元素, 创建 (quote <syntax>) 的列表结构
+        Syntax quoted_syntax = readItem();
         List *quote_list = new List();
         quote_list->stxs.push_back(Syntax(new SymbolSyntax("quote")));
         quote_list->stxs.push_back(quoted_syntax);
-        
         return Syntax(quote_list);
     }
     // 处理字符串字面量
-    if (is.peek() == '"') {
-        is.get(); // 消费开始的双引号
-        std::string str;
-        while (is.peek() != '"' && is.peek() != EOF) {
-        char c = is.get();
-        if (c == '\\') {
-            // 处理转义字符
-            char next = is.get();
-            switch (next) {
-                case 'n': str.push_back('\n'); break;
-                case 't': str.push_back('\t'); break;
-                case 'r': str.push_back('\r'); break;
-                case '\\': str.push_back('\\'); break;
-                case '"': str.push_back('"'); break;
-                default: str.push_back(next); break;
-            }
-        } else {
-            str.push_back(c);
+    if (c == '"') {
+        ++pos; // 消费开始的双引号
+        return readString();
+    }
+    return readAtom();
+}
+
+Syntax Reader::readList() {
+    List *stx = new List();
+    Syntax result(stx);
+    while (true) {
+        skipSpace();
+        int c = peek();
+        if (c == ')' || c == ']') {
+            ++pos; // ')'
+            break;
+        }
+        if (c == EOF) {
+            // unterminated list: close it rather than read past the end
+            break;
         }
+        stx->stxs.push_back(readItem());
+    }
+    return result;
+}
+
+Syntax Reader::readString() {
+    std::string str;
+    while (true) {
+        // copy the run up to the next quote or escape in one go
+        const char *run = pos;
+        while (pos != end && *pos != '"' && *pos != '\\')
+            ++pos;
+        str.append(run, pos);
+        if (pos == end) {
+            if (!refill())
+                break;
+            continue;
         }
-        if (is.peek() == '"') {
-            is.get(); // 消费结束的双引号
+        if (*pos == '"') {
+            ++pos; // 消费结束的双引号
+            break;
         }
-        return Syntax(new StringSyntax(str));
-    }
-    
-    // Read token
-    std::string s;
-    do {
-        int c = is.peek();
-        if (c == '(' || c == ')' ||
-            c == '[' || c == ']' || 
-            c == ';' ||  // 添加分号作为分隔符
-            isspace(c) ||
-            c == EOF)
+        // 处理转义字符
+        ++pos;
+        int next = peek();
+        if (next == EOF)
             break;
-        is.get();
-        s.push_back(c);
-    } while (true);
-    
-    // Try parsing as rational first
-    int numerator, denominator;
-    if (tryParseRational(s, numerator, denominator)) {
-        return Syntax(new RationalSyntax(numerator, denominator));
-    }
-    
-    // Try parsing as integer
-    int number_value;
-    if (tryParseNumber(s, number_value)) {
-        return Syntax(new Number(number_value));
-    }
-    
-    // Not a number, treat as identifier/symbol
-    return createIdentifierSyntax(s);
+        ++pos;
+        switch (next) {
+            case 'n': str.push_back('\n'); break;
+            case 't': str.push_back('\t'); break;
+            case 'r': str.push_back('\r'); break;
+            case '\\': str.push_back('\\'); break;
+            case '"': str.push_back('"'); break;
+            default: str.push_back((char)next); break;
+        }
+    }
+    return Syntax(new StringSyntax(str));
 }
 
-Syntax readList(std::istream &is) {
-    List *stx = new List();
-    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ']') {
-        stx->stxs.push_back(readItem(is));
+// Classifies a token as an integer, a rational, a boolean or a symbol in
+// one pass. Integers are an optional sign and digits; a rational is an
+// integer, '/', an optional '+' and digits that are not all zero. As with
+// the original reader, an empty token reads as the number 0.
+static Syntax makeAtom(const char *b, const char *e) {
+    size_t len = e - b;
+    const char *p = b;
+    bool neg = false;
+    if (p != e && (*p == '+' || *p == '-')) {
+        neg = *p == '-';
+        ++p;
     }
-    is.get(); // ')'
-    return Syntax(stx);
-}
+    const char *num_begin = p;
+    while (p != e && isdigit((unsigned char)*p))
+        ++p;
+    const char *num_end = p;
 
-Syntax readSyntax(std::istream &is) {
-    return readItem(readSpace(is));
+    if (p == e && !(len == 1 && num_begin != b)) {
+        std::string digits(num_begin, num_end);
+        return Syntax(new Number(neg ? "-" + digits : digits));
+    }
+    if (p != e && *p == '/' && num_end != num_begin && p + 1 != e) {
+        const char *q = p + 1;
+        if (*q == '+')
+            ++q;
+        const char *den_begin = q;
+        bool nonzero = false;
+        while (q != e && isdigit((unsigned char)*q)) {
+            nonzero = nonzero || *q != '0';
+            ++q;
+        }
+        if (q == e && q != den_begin && nonzero) {
+            std::string numerator(num_begin, num_end);
+            std::string denominator(den_begin, e);
+            return Syntax(new RationalSyntax(neg ? "-" + numerator : numerator, denominator));
+        }
+    }
+
+    // Not a number, treat as identifier/symbol
+    if (len == 2 && b[0] == '#' && b[1] == 't')
+        return Syntax(new TrueSyntax());
+    if (len == 2 && b[0] == '#' && b[1] == 'f')
+        return Syntax(new FalseSyntax());
+    return Syntax(new SymbolSyntax(std::string(b, e)));
 }
 
-std::istream &operator>>(std::istream &is, Syntax &stx) {
-    stx = readSyntax(is);
-    return is;
+Syntax Reader::readAtom() {
+    const char *start = pos;
+    while (pos != end && !isDelimiter((unsigned char)*pos))
+        ++pos;
+    if (pos != end || is == nullptr) {
+        return makeAtom(start, pos);
+    }
+    // the token runs to the end of the buffered line: keep a copy while
+    // more input is pulled in
+    std::string token(start, pos);
+    while (refill()) {
+        start = pos;
+        while (pos != end && !isDelimiter((unsigned char)*pos))
+            ++pos;
+        token.append(start, pos);
+        if (pos != end)
+            break;
+    }
+    return makeAtom(token.data(), token.data() + token.size());
 }
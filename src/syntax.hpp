@@ -3,11 +3,12 @@
 
 #include <cstring>
 #include <memory>
+#include <string_view>
 #include <vector>
 #include "Def.hpp"
 
 struct SyntaxBase {
-    virtual Expr parse(Assoc &) = 0;
+    virtual Expr parse(Scope &) = 0;
     virtual void show(std::ostream &) = 0;
     virtual ~SyntaxBase() = default;
 };
@@ -19,58 +20,95 @@ struct Syntax {
     SyntaxBase* operator->() const;
     SyntaxBase& operator*();
     SyntaxBase* get() const;
-    Expr parse(Assoc &);
+    Expr parse(Scope &);
 };
 
 struct Number : SyntaxBase {
-    int n;
-    Number(int);
-    virtual Expr parse(Assoc &) override;
+    std::string digits;     ///< Decimal literal, with a '-' when negative
+    Number(const std::string &);
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct RationalSyntax : SyntaxBase {
-    int numerator;
-    int denominator;
-    RationalSyntax(int num, int den);
-    virtual Expr parse(Assoc &) override;
+    std::string numerator;
+    std::string denominator;
+    RationalSyntax(const std::string &num, const std::string &den);
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct TrueSyntax : SyntaxBase {
     // This will not match
-    virtual Expr parse(Assoc &) override;
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct FalseSyntax : SyntaxBase {
     // FalseSyntax();
-    virtual Expr parse(Assoc &) override;
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct SymbolSyntax : SyntaxBase {
     std::string s;
+    SymbolId id;    ///< Interned name
     SymbolSyntax(const std::string &);
-    virtual Expr parse(Assoc &) override;
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct StringSyntax : SyntaxBase {
     std::string s;
     StringSyntax(const std::string &);
-    virtual Expr parse(Assoc &) override;
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct List : SyntaxBase {
     std::vector<Syntax> stxs;
     List();
-    virtual Expr parse(Assoc &) override;
+    virtual Expr parse(Scope &) override;
     virtual void show(std::ostream &) override;
 };
 
-Syntax readSyntax(std::istream &);
+/**
+ * @brief Buffered reader turning source text into Syntax trees
+ *
+ * Scans a flat character buffer with a cursor instead of peeking at the
+ * stream once per character. Interactive input is pulled in a line at a
+ * time, so the REPL still answers as soon as an expression is complete,
+ * while a regular file is mapped into memory whole. Tokens are classified
+ * in a single pass over the buffer and only copied into the Syntax node
+ * that is built from them.
+ */
+class Reader {
+public:
+    explicit Reader(std::istream &);    ///< Refill from a stream line by line
+    explicit Reader(int fd);            ///< Map (or slurp) the rest of a file
+    explicit Reader(std::string_view);  ///< Read text that outlives the reader, without a copy
+    ~Reader();
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
 
-std::istream &operator>>(std::istream &, Syntax);
+    Syntax read();
+    bool atEnd();                       ///< Only whitespace and comments remain
+    void resync();                      ///< Resume after an error at the next token
+
+private:
+    std::istream *is;       ///< Source of further lines, or nullptr
+    std::string buffer;     ///< Current line, or the whole file when not mapped
+    const char *pos;        ///< Next unread character
+    const char *end;        ///< End of the buffered input
+    void *mapping;          ///< mmap'd file, if any
+    size_t mapping_size;
+
+    bool refill();
+    int peek();
+    void skipSpace();
+    Syntax readItem();
+    Syntax readList();
+    Syntax readString();
+    Syntax readAtom();
+};
 #endif
\ No newline at end of file
@@ -9,103 +9,276 @@
 #include "value.hpp"
 #include "utils.hpp"
 #include "RE.hpp"
+#include "counters.hpp"
+#include "printer.hpp"
+#include <iostream>
+#include <deque>
+#include <iterator>
 
 // ============================================================================
 // Base ValueBase Implementation
 // ============================================================================
 
-ValueBase::ValueBase(ValueType vt) : v_type(vt) {}
-
-void ValueBase::showCdr(std::ostream &os) {
-    os << " . ";
-    show(os);
-    os << ')';
+ValueBase::ValueBase(ValueType vt) : v_type(vt) {
+    COUNT(allocations[vt]);
 }
 
 // ============================================================================
 // Value Smart Pointer Implementation
 // ============================================================================
 
-Value::Value(ValueBase *ptr) : ptr(ptr) {}
+// shared objects behind the immediates; never freed since their refs are
+// never counted
+static Integer fixnum_header;
+static Boolean false_header(false);
+static Boolean true_header(true);
+static Null null_header;
+static Void void_header;
+
+ValueBase *const immediate_headers[] = {
+    &fixnum_header, &false_header, &true_header, &null_header, &void_header
+};
+
+void Value::show(std::ostream &os) const {
+    Printer(os).write(*this);
+}
+
+static inline void visitValue(GcVisitor &visit, const Value &v) {
+    if (v.isHeap()) {
+        visit(v.get());
+    }
+}
+
+// ============================================================================
+// Arenas
+// ============================================================================
+
+// one set per thread, like the collector's heap, since objects never
+// cross threads; only freed by gcReleaseArenas, so that statics released
+// during shutdown stay valid
+template <class T>
+static Arena &arenaOf() {
+    static thread_local Arena *arena = nullptr;
+    if (arena == nullptr) {
+        arena = new Arena(sizeof(T), &arena);
+    }
+    return *arena;
+}
+
+void *Pair::operator new(size_t) { return arenaOf<Pair>().allocate(); }
+void Pair::operator delete(void *p) { arenaOf<Pair>().release(p); }
+void *Procedure::operator new(size_t) { return arenaOf<Procedure>().allocate(); }
+void Procedure::operator delete(void *p) { arenaOf<Procedure>().release(p); }
+void *Frame::operator new(size_t) { return arenaOf<Frame>().allocate(); }
+void Frame::operator delete(void *p) { arenaOf<Frame>().release(p); }
+void *Promise::operator new(size_t) { return arenaOf<Promise>().allocate(); }
+void Promise::operator delete(void *p) { arenaOf<Promise>().release(p); }
+
+// ============================================================================
+// Toplevel Bindings Implementation
+// ============================================================================
+
+thread_local uint64_t binding_epoch = 1;
+
+GlobalTable::GlobalTable() {
+    gcTrack(this);
+}
+
+GlobalTable::~GlobalTable() {
+    ++binding_epoch;
+}
 
-ValueBase* Value::operator->() const { 
-    return ptr.get(); 
+void GlobalTable::traverse(GcVisitor &visit) {
+    for (const Value &v : values) {
+        visitValue(visit, v);
+    }
 }
 
-ValueBase& Value::operator*() { 
-    return *ptr; 
+void GlobalTable::clear() {
+    ++binding_epoch;
+    values.clear();
+    defined.clear();
 }
 
-ValueBase* Value::get() const { 
-    return ptr.get(); 
+Globals::Globals(GlobalTable *x) : GcRef<GlobalTable>(x) {}
+
+Globals makeGlobals() {
+    return Globals(new GlobalTable());
 }
 
-void Value::show(std::ostream &os) {
-    ptr->show(os);
+void insert(SymbolId x, const Value &v, Globals &g) {
+    if ((size_t)x >= g->values.size()) {
+        g->values.resize(x + 1, Value(nullptr));
+        g->defined.resize(x + 1, false);
+    }
+    g->values[x] = v;
+    g->defined[x] = true;
+    ++binding_epoch;
+}
+
+void modify(SymbolId x, const Value &v, Globals &g) {
+    if (!bound(x, g)) {
+        throw RuntimeError("undefined variable: " + symbolName(x));
+    }
+    g->values[x] = v;
+    ++binding_epoch;
+}
+
+bool bound(SymbolId x, Globals &g) {
+    return (size_t)x < g->defined.size() && g->defined[x];
 }
 
 // ============================================================================
-// Environment (Association List) Implementation
+// Lexical Frames Implementation
 // ============================================================================
 
-AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
-    : x(x), v(v), next(next) {}
+Frame::Frame(size_t size, const Env &parent)
+    : slots(size, Value(nullptr)), parent(parent), globals(nullptr), scoped(false) {
+    gcTrack(this);
+}
 
-Assoc::Assoc(AssocList *x) : ptr(x) {}
+void Frame::traverse(GcVisitor &visit) {
+    for (const Value &v : slots) {
+        visitValue(visit, v);
+    }
+    visit(parent.get());
+    visit(globals.get());
+}
+
+void Frame::clear() {
+    slots.clear();
+    parent = Env(nullptr);
+    globals = Globals(nullptr);
+}
 
-AssocList* Assoc::operator->() const { 
-    return ptr.get(); 
+Env makeFrame(size_t size, const Env &parent) {
+    COUNT(frames);
+    return Env(new Frame(size, parent));
 }
 
-AssocList& Assoc::operator*() { 
-    return *ptr; 
+Env toplevel() {
+    Env env = makeFrame(0, Env(nullptr));
+    env->globals = makeGlobals();
+    return env;
 }
 
-AssocList* Assoc::get() const { 
-    return ptr.get(); 
+// spare frames, indexed by the nesting depth of the scopes using them; a
+// deque so that growing it leaves the frames lent out where they are
+static thread_local std::deque<Env> *local_frames = nullptr;
+static thread_local size_t local_depth = 0;
+// spares kept once the outermost scope ends; a deep recursion lends many
+static const size_t LOCAL_FRAME_SPARES = 256;
+
+static Env spareFrame() {
+    Env frame(new Frame(0, Env(nullptr)));
+    gcUntrack(frame.get());
+    return frame;
 }
 
-Assoc empty() {
-    return Assoc(nullptr);
+static Env &lendFrame() {
+    if (local_frames == nullptr) {
+        local_frames = new std::deque<Env>();
+    }
+    if (local_depth == local_frames->size()) {
+        local_frames->push_back(spareFrame());
+    }
+    return (*local_frames)[local_depth++];
 }
 
-Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
-    return Assoc(new AssocList(x, v, lst));
+LocalFrame::LocalFrame(size_t size, const Env &parent, bool scoped) : env(lendFrame()) {
+    COUNT(local_frames);
+    env->slots.resize(size, Value(nullptr));
+    env->parent = parent;
+    env->scoped = scoped;
 }
 
-void modify(const std::string &x, const Value &v, Assoc &lst) {
-    for (auto i = lst; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            i->v = v;
-            return;
+LocalFrame::~LocalFrame() {
+    --local_depth;
+    Frame *f = env.get();
+    if (f->refs == 1) {
+        f->slots.clear();           // keeps the capacity for the next scope
+        f->parent = Env(nullptr);
+    } else {
+        f->scoped = false;
+        gcTrack(f);
+        env = spareFrame();
+    }
+    if (local_depth == 0 && local_frames->size() > LOCAL_FRAME_SPARES) {
+        local_frames->resize(LOCAL_FRAME_SPARES, Env(nullptr));
+    }
+}
+
+void releaseLocalFrames() {
+    delete local_frames;
+    local_frames = nullptr;
+}
+
+Scope::Scope(Globals &globals) : parent(nullptr), globals(globals), root(this), owner(-1) {
+    for (SymbolId x = 0; x < (SymbolId)globals->values.size(); ++x) {
+        if (!::bound(x, globals)) {
+            continue;
+        }
+        Value v = find(x, globals);
+        Primitive *prim = v.get() != nullptr ? valueAs<Primitive>(v) : nullptr;
+        if (prim == nullptr || prim->name != x) {
+            defineGlobal(x);
         }
     }
-    throw RuntimeError("undefined variable: " + x);
 }
 
-void insert(const std::string &x, const Value &v, Assoc &lst) {
-    if (!lst.get()) {
-        auto head = Assoc(nullptr);
-        lst = extend(x, v, head);
-        return;
+Scope::Scope(const std::vector<SymbolId> &names, Scope &parent)
+    : names(names), parent(&parent), globals(parent.globals), root(parent.root), owner(parent.owner) {}
+
+bool Scope::resolve(SymbolId x, int &depth, int &index) {
+    depth = 0;
+    for (Scope *s = this; s != nullptr; s = s->parent, ++depth) {
+        // later bindings of the same name shadow earlier ones
+        for (int i = (int)s->names.size() - 1; i >= 0; --i) {
+            if (s->names[i] == x) {
+                index = i;
+                return true;
+            }
+        }
     }
-    lst->next = extend(x, v, lst->next);
+    depth = this->depth();
+    index = -1;
+    return false;
+}
+
+int Scope::depth() const {
+    int d = 0;
+    for (const Scope *s = parent; s != nullptr; s = s->parent) {
+        ++d;
+    }
+    return d;
 }
 
-Value find(const std::string &x, Assoc &l) {
-    for (auto i = l; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            return i->v;
+int Scope::declare(SymbolId x) {
+    for (int i = (int)names.size() - 1; i >= 0; --i) {
+        if (names[i] == x) {
+            return i;
         }
     }
-    return Value(nullptr);
+    names.push_back(x);
+    return (int)names.size() - 1;
 }
 
-bool bound(const std::string &name, Assoc &env) {
-    for (Assoc p = env; p.get(); p = p->next) {
-        if (p->x == name) return true;
+void Scope::defineGlobal(SymbolId x) {
+    std::vector<bool> &user = root->user_globals;
+    if ((size_t)x >= user.size()) {
+        user.resize(x + 1, false);
     }
-    return false;
+    user[x] = true;
+}
+
+bool Scope::bound(SymbolId x) {
+    int depth, index;
+    if (resolve(x, depth, index)) {
+        return true;
+    }
+    // a toplevel name still bound to its own builtin keeps the inline form
+    const std::vector<bool> &user = root->user_globals;
+    return (size_t)x < user.size() && user[x];
 }
 
 // ============================================================================
@@ -119,41 +292,54 @@ void Void::show(std::ostream &os) {
     os << "#<void>";
 }
 
-Value VoidV() {
-    return Value(new Void());
-}
-
 // Integer
-Integer::Integer(NumericType n) : ValueBase(V_INT), n(n) {}
+Integer::Integer() : ValueBase(V_INT) {}
 
 void Integer::show(std::ostream &os) {
-    os << n;
+    // unreachable: Value::show prints fixnums from the handle
+    os << "#<fixnum>";
+}
+
+// BigInteger
+BigInteger::BigInteger(const BigInt &n) : ValueBase(V_BIGINT), n(n) {}
+
+void BigInteger::show(std::ostream &os) {
+    os << n.toString();
 }
 
-Value IntegerV(NumericType n) {
-    return Value(new Integer(n));
+Value IntegerV(const BigInt &n) {
+    if (n.fitsInt()) {
+        return IntegerV(n.toInt());
+    }
+    return Value(new BigInteger(n));
 }
 
-Rational::Rational(NumericType num, NumericType den) : ValueBase(V_RATIONAL), numerator(num), denominator(den) {
-    if (denominator == 0) {
+// Rational
+Rational::Rational(const BigInt &num, const BigInt &den) : ValueBase(V_RATIONAL), numerator(num), denominator(den) {
+    if (denominator.isZero()) {
         throw std::runtime_error("Division by zero");
     }
-    if (denominator < (NumericType)0) {
+    if (denominator.isNegative()) {
         numerator = -numerator;
         denominator = -denominator;
     }
-    util::normalize_rational(numerator, denominator);
+    BigInt g = BigInt::gcd(numerator, denominator);
+    if (!g.isOne()) {
+        BigInt rem;
+        BigInt::divmod(numerator, g, numerator, rem);
+        BigInt::divmod(denominator, g, denominator, rem);
+    }
 }
 
 void Rational::show(std::ostream &os) {
-    if (denominator == 1) {
-        os << numerator;
+    if (denominator.isOne()) {
+        os << numerator.toString();
     } else {
-        os << numerator << "/" << denominator;
+        os << numerator.toString() << "/" << denominator.toString();
     }
 }
 
-Value RationalV(NumericType num, NumericType den) {
+Value RationalV(const BigInt &num, const BigInt &den) {
     return Value(new Rational(num, den));
 }
 
@@ -164,19 +350,43 @@ void Boolean::show(std::ostream &os) {
     os << (b ? "#t" : "#f");
 }
 
-Value BooleanV(bool b) {
-    return Value(new Boolean(b));
-}
-
 // Symbol
-Symbol::Symbol(const std::string &s) : ValueBase(V_SYM), s(s) {}
+Symbol::Symbol(SymbolId id) : ValueBase(V_SYM), s(symbolName(id)), id(id) {}
 
 void Symbol::show(std::ostream &os) {
     os << s;
 }
 
+// one Symbol per identifier and thread, kept for the lifetime of the
+// program; ids are shared, the refcounted objects are not
+static thread_local std::vector<Value> *thread_symbols = nullptr;
+
+static std::vector<Value> &threadSymbols() {
+    if (thread_symbols == nullptr) {
+        thread_symbols = new std::vector<Value>();
+    }
+    return *thread_symbols;
+}
+
+Value SymbolV(SymbolId id) {
+    std::vector<Value> *symbols = &threadSymbols();
+    if ((size_t)id >= symbols->size()) {
+        symbols->resize(id + 1, Value(nullptr));
+    }
+    Value &sym = (*symbols)[id];
+    if (sym.get() == nullptr) {
+        sym = Value(new Symbol(id));
+    }
+    return sym;
+}
+
 Value SymbolV(const std::string &s) {
-    return Value(new Symbol(s));
+    return SymbolV(intern(s));
+}
+
+void releaseSymbols() {
+    delete thread_symbols;
+    thread_symbols = nullptr;
 }
 
 // String
@@ -201,14 +411,6 @@ void Null::show(std::ostream &os) {
     os << "()";
 }
 
-void Null::showCdr(std::ostream &os) {
-    os << ')';
-}
-
-Value NullV() {
-    return Value(new Null());
-}
-
 // Terminate
 Terminate::Terminate() : ValueBase(V_TERMINATE) {}
 
@@ -226,39 +428,423 @@ Value TerminateV() {
 
 // Pair
 Pair::Pair(const Value &car, const Value &cdr) 
-    : ValueBase(V_PAIR), car(car), cdr(cdr) {}
+    : ValueBase(V_PAIR), car(car), cdr(cdr) {
+    gcTrack(this);
+}
 
-void Pair::show(std::ostream &os) {
-    os << '(' << car;
-    cdr->showCdr(os);
+void Pair::traverse(GcVisitor &visit) {
+    visitValue(visit, car);
+    visitValue(visit, cdr);
 }
 
-void Pair::showCdr(std::ostream &os) {
-    os << ' ' << car;
-    cdr->showCdr(os);
+void Pair::clear() {
+    car = Value(nullptr);
+    cdr = Value(nullptr);
+}
+
+void Pair::show(std::ostream &os) {
+    Printer(os).write(Value(this));
 }
 
 Value PairV(const Value &car, const Value &cdr) {
     return Value(new Pair(car, cdr));
 }
 
+// Vector
+Vector::Vector(size_t n, const Value &fill) : ValueBase(V_VECTOR), items(n, fill) {
+    gcTrack(this);
+}
+
+Vector::Vector(const Value *xs, size_t n) : ValueBase(V_VECTOR), items(xs, xs + n) {
+    gcTrack(this);
+}
+
+void Vector::traverse(GcVisitor &visit) {
+    for (const Value &v : items) {
+        visitValue(visit, v);
+    }
+}
+
+void Vector::clear() {
+    items.clear();
+}
+
+void Vector::show(std::ostream &os) {
+    Printer(os).write(Value(this));
+}
+
+static thread_local bool structure_mutated = false;
+
+void noteMutation() {
+    structure_mutated = true;
+}
+
+bool structureMutated() {
+    return structure_mutated;
+}
+
+Value VectorV(size_t n, const Value &fill) {
+    return Value(new Vector(n, fill));
+}
+
+Value VectorV(const Value *xs, size_t n) {
+    return Value(new Vector(xs, n));
+}
+
+// HashTable
+static size_t mixHash(uint64_t h) {
+    // the fixnum tag and pointer alignment leave the low bits constant
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static size_t hashKey(const Value &key) {
+    if (!key.isHeap()) {
+        return mixHash(key.bits);
+    }
+    switch (key->v_type) {
+        case V_SYM:
+            return mixHash((uint64_t)static_cast<Symbol*>(key.get())->id);
+        case V_STRING:
+            return std::hash<std::string>()(static_cast<String*>(key.get())->s);
+        case V_BIGINT:
+            return std::hash<std::string>()(static_cast<BigInteger*>(key.get())->n.toString());
+        case V_RATIONAL: {
+            Rational *r = static_cast<Rational*>(key.get());
+            return std::hash<std::string>()(r->numerator.toString() + "/" + r->denominator.toString());
+        }
+        default:
+            return mixHash(key.bits);
+    }
+}
+
+static bool sameKey(const Value &a, const Value &b) {
+    if (a.bits == b.bits) {
+        return true;
+    }
+    if (!a.isHeap() || !b.isHeap() || a->v_type != b->v_type) {
+        return false;
+    }
+    switch (a->v_type) {
+        case V_SYM:
+            return static_cast<Symbol*>(a.get())->id == static_cast<Symbol*>(b.get())->id;
+        case V_STRING:
+            return static_cast<String*>(a.get())->s == static_cast<String*>(b.get())->s;
+        case V_BIGINT:
+            return static_cast<BigInteger*>(a.get())->n.compare(static_cast<BigInteger*>(b.get())->n) == 0;
+        case V_RATIONAL: {
+            Rational *x = static_cast<Rational*>(a.get());
+            Rational *y = static_cast<Rational*>(b.get());
+            return x->numerator.compare(y->numerator) == 0 && x->denominator.compare(y->denominator) == 0;
+        }
+        default:
+            return false;
+    }
+}
+
+HashTable::HashTable() : ValueBase(V_HASHTABLE), keys(8, Value(nullptr)), values(8, Value(nullptr)), count(0) {
+    gcTrack(this);
+}
+
+Value *HashTable::lookup(const Value &key) {
+    size_t mask = keys.size() - 1;
+    for (size_t i = hashKey(key) & mask; keys[i].bits != 0; i = (i + 1) & mask) {
+        if (sameKey(keys[i], key)) {
+            return &values[i];
+        }
+    }
+    return nullptr;
+}
+
+void HashTable::store(const Value &key, const Value &value) {
+    if (Value *slot = lookup(key)) {
+        *slot = value;
+        return;
+    }
+    // kept at most three quarters full so that probes stay short
+    if ((count + 1) * 4 > keys.size() * 3) {
+        std::vector<Value> old_keys, old_values;
+        old_keys.swap(keys);
+        old_values.swap(values);
+        keys.assign(old_keys.size() * 2, Value(nullptr));
+        values.assign(old_keys.size() * 2, Value(nullptr));
+        size_t mask = keys.size() - 1;
+        for (size_t j = 0; j < old_keys.size(); ++j) {
+            if (old_keys[j].bits == 0) {
+                continue;
+            }
+            size_t i = hashKey(old_keys[j]) & mask;
+            while (keys[i].bits != 0) {
+                i = (i + 1) & mask;
+            }
+            keys[i] = std::move(old_keys[j]);
+            values[i] = std::move(old_values[j]);
+        }
+    }
+    size_t mask = keys.size() - 1;
+    size_t i = hashKey(key) & mask;
+    while (keys[i].bits != 0) {
+        i = (i + 1) & mask;
+    }
+    keys[i] = key;
+    values[i] = value;
+    ++count;
+}
+
+void HashTable::traverse(GcVisitor &visit) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+        visitValue(visit, keys[i]);
+        visitValue(visit, values[i]);
+    }
+}
+
+void HashTable::clear() {
+    // left as an empty table, since lookup expects a power-of-two size
+    keys.assign(8, Value(nullptr));
+    values.assign(8, Value(nullptr));
+    count = 0;
+}
+
+void HashTable::show(std::ostream &os) {
+    os << "#<hash-table>";
+}
+
+Value HashTableV() {
+    return Value(new HashTable());
+}
+
+// Promise
+Promise::Promise(const Expr &e, const Env &env) : ValueBase(V_PROMISE), e(e), env(env), value(nullptr) {
+    gcTrack(this);
+}
+
+void Promise::traverse(GcVisitor &visit) {
+    visit(env.get());
+    visitValue(visit, value);
+}
+
+void Promise::clear() {
+    env = Env(nullptr);
+    value = Value(nullptr);
+}
+
+void Promise::show(std::ostream &os) {
+    os << "#<promise>";
+}
+
+Value PromiseV(const Expr &e, const Env &env) {
+    return Value(new Promise(e, env));
+}
+
+// MemoCache
+// pairs looked at per argument list before hashing or comparing gives up
+static const size_t MEMO_KEY_BUDGET = 4096;
+
+static size_t combineHash(size_t h, size_t x) {
+    return h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+static bool isPairValue(const Value &v) {
+    return v.isHeap() && v->v_type == V_PAIR;
+}
+
+// clears cacheable on meeting a hash table, whose contents a key cannot
+// follow: it would hash by identity and still match after a hash-set!
+static size_t structuralHash(const Value &v, size_t &budget, bool &cacheable) {
+    size_t h = 0;
+    const Value *p = &v;
+    while (isPairValue(*p) && budget > 0) {
+        --budget;
+        Pair *pair = static_cast<Pair*>(p->get());
+        h = combineHash(h, structuralHash(pair->car, budget, cacheable));
+        p = &pair->cdr;
+    }
+    if (Vector *vec = valueAs<Vector>(*p)) {
+        h = combineHash(h, vec->items.size());
+        for (size_t i = 0; i < vec->items.size() && budget > 0; ++i) {
+            --budget;
+            h = combineHash(h, structuralHash(vec->items[i], budget, cacheable));
+        }
+        return h;
+    }
+    if (valueAs<HashTable>(*p) != nullptr) {
+        cacheable = false;
+    }
+    return combineHash(h, hashKey(*p));
+}
+
+static bool vectorsEqual(Vector *a, Vector *b, size_t &budget);
+
+static bool structurallyEqual(const Value &a, const Value &b, size_t &budget) {
+    const Value *x = &a, *y = &b;
+    while (x->bits != y->bits) {
+        if (!isPairValue(*x) || !isPairValue(*y)) {
+            Vector *v = valueAs<Vector>(*x), *w = valueAs<Vector>(*y);
+            return v != nullptr && w != nullptr ? vectorsEqual(v, w, budget) : sameKey(*x, *y);
+        }
+        if (budget == 0) {
+            return false;
+        }
+        --budget;
+        Pair *p = static_cast<Pair*>(x->get());
+        Pair *q = static_cast<Pair*>(y->get());
+        if (!structurallyEqual(p->car, q->car, budget)) {
+            return false;
+        }
+        x = &p->cdr;
+        y = &q->cdr;
+    }
+    return true;
+}
+
+static bool vectorsEqual(Vector *a, Vector *b, size_t &budget) {
+    if (a->items.size() != b->items.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a->items.size(); ++i) {
+        if (budget == 0) {
+            return false;
+        }
+        --budget;
+        if (!structurallyEqual(a->items[i], b->items[i], budget)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MemoCache::MemoCache(size_t capacity) : capacity(capacity), hits(0), misses(0) {}
+
+bool MemoCache::hash(const Value *args, size_t n, size_t &h) {
+    size_t budget = MEMO_KEY_BUDGET;
+    bool cacheable = true;
+    h = n;
+    for (size_t i = 0; i < n; ++i) {
+        h = combineHash(h, structuralHash(args[i], budget, cacheable));
+    }
+    return cacheable;
+}
+
+Value *MemoCache::lookup(const Value *args, size_t n, size_t h) {
+    auto range = index.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        Entry &entry = *it->second;
+        if (entry.args.size() != n) {
+            continue;
+        }
+        size_t budget = MEMO_KEY_BUDGET;
+        size_t i = 0;
+        while (i < n && structurallyEqual(entry.args[i], args[i], budget)) {
+            ++i;
+        }
+        if (i == n) {
+            ++hits;
+            entries.splice(entries.begin(), entries, it->second);
+            return &entries.front().result;
+        }
+    }
+    ++misses;
+    return nullptr;
+}
+
+void MemoCache::store(const Value *args, size_t n, size_t h, const Value &result) {
+    entries.push_front(Entry{std::vector<Value>(args, args + n), result, h});
+    index.emplace(h, entries.begin());
+    if (entries.size() <= capacity) {
+        return;
+    }
+    auto oldest = std::prev(entries.end());
+    auto range = index.equal_range(oldest->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == oldest) {
+            index.erase(it);
+            break;
+        }
+    }
+    entries.pop_back();
+}
+
+void MemoCache::traverse(GcVisitor &visit) {
+    for (const Entry &entry : entries) {
+        for (const Value &arg : entry.args) {
+            visitValue(visit, arg);
+        }
+        visitValue(visit, entry.result);
+    }
+}
+
+void MemoCache::clear() {
+    index.clear();
+    entries.clear();
+}
+
 // Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
+Procedure::Procedure(const std::vector<SymbolId> &xs, const Expr &e, const Env &env, size_t frame_size,
+                     SymbolId name)
+    : ValueBase(V_PROC), parameters(xs), e(e), env(env), frame_size(frame_size), name(name),
+      local_frame(false) {
+    gcTrack(this);
+}
+
+void Procedure::traverse(GcVisitor &visit) {
+    visit(env.get());
+    if (memo) {
+        memo->traverse(visit);
+    }
+}
+
+void Procedure::clear() {
+    env = Env(nullptr);
+    if (memo) {
+        memo->clear();
+    }
+}
 
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
 }
 
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
-    return Value(new Procedure(xs, e, env));
+Value ProcedureV(const std::vector<SymbolId> &xs, const Expr &e, const Env &env, size_t frame_size,
+                 SymbolId name) {
+    return Value(new Procedure(xs, e, env, frame_size, name));
+}
+
+// Primitive
+Primitive::Primitive(SymbolId name, PrimitiveFn fn, int min_args, int max_args)
+    : ValueBase(V_PRIMITIVE), name(name), fn(fn), min_args(min_args), max_args(max_args) {}
+
+Value Primitive::call(const Value *args, size_t n) {
+    if ((int)n < min_args || (max_args >= 0 && (int)n > max_args)) {
+        throw RuntimeError("Wrong number of arguments");
+    }
+    return fn(args, n);
+}
+
+void Primitive::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
+Value PrimitiveV(SymbolId name, PrimitiveFn fn, int min_args, int max_args) {
+    return Value(new Primitive(name, fn, min_args, max_args));
 }
 
 // ============================================================================
 // Utility Functions Implementation
 // ============================================================================
 
+static thread_local std::ostream *output_stream = &std::cout;
+
+std::ostream &outputStream() {
+    return *output_stream;
+}
+
+void setOutputStream(std::ostream *os) {
+    output_stream = os;
+}
+
 std::ostream &operator<<(std::ostream &os, Value &v) {
-    v->show(os);
+    v.show(os);
     return os;
 }
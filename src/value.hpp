@@ -10,9 +10,15 @@
  */
 
 #include "Def.hpp"
-#include "expr.hpp"
+#include "bigint.hpp"
+#include "gc.hpp"
+#include "counters.hpp"
 #include <memory>
 #include <cstring>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 // ============================================================================
@@ -22,58 +28,208 @@
 /**
  * @brief Base class for all values in the Scheme interpreter
  */
-struct ValueBase {
+struct ValueBase : GcObject {
     ValueType v_type;
     ValueBase(ValueType);
     virtual void show(std::ostream &) = 0;
-    virtual void showCdr(std::ostream &);
     virtual ~ValueBase() = default;
 };
 
 /**
- * @brief Smart pointer wrapper for ValueBase objects
+ * @brief Tagged one-word handle to a value
+ *
+ * Heap objects are referenced by an aligned pointer (low three bits clear)
+ * and counted through GcObject::refs. Fixnums are stored in the word
+ * itself with the low bit set, and #t, #f, '() and void are small tagged
+ * constants, so none of them allocates. For an immediate, `operator->`
+ * and `get()` yield a shared static object of the matching type, which
+ * keeps `v->v_type` dispatch and `Boolean::b` reads working; the integer
+ * itself is read with `fixnum()`.
  */
 struct Value {
-    std::shared_ptr<ValueBase> ptr;
+    uintptr_t bits;
+
+    enum : uintptr_t {
+        TAG_MASK   = 7,
+        FIXNUM_TAG = 1,
+        CONST_TAG  = 2,
+        FALSE_BITS = (1 << 3) | CONST_TAG,
+        TRUE_BITS  = (2 << 3) | CONST_TAG,
+        NULL_BITS  = (3 << 3) | CONST_TAG,
+        VOID_BITS  = (4 << 3) | CONST_TAG
+    };
+
     Value(ValueBase *);
-    void show(std::ostream &);
+    Value(const Value &);
+    Value(Value &&) noexcept;
+    Value &operator=(const Value &);
+    Value &operator=(Value &&) noexcept;
+    ~Value();
+    static Value immediate(uintptr_t);
+    bool isHeap() const;
+    bool isFixnum() const;
+    NumericType fixnum() const;
+    bool isFalse() const;
+    bool isTrue() const;
+    void show(std::ostream &) const;
     ValueBase* operator->() const;
     ValueBase& operator*();
     ValueBase* get() const;
 };
 
 // ============================================================================
-// Environment (Association Lists)
+// Toplevel Bindings
 // ============================================================================
 
 /**
- * @brief Smart pointer wrapper for AssocList (Environment)
+ * @brief Smart pointer wrapper for GlobalTable (toplevel bindings)
  */
-struct Assoc {
-    std::shared_ptr<AssocList> ptr;
-    Assoc(AssocList *);
-    AssocList* operator->() const;
-    AssocList& operator*();
-    AssocList* get() const;
+struct Globals : GcRef<GlobalTable> {
+    Globals(GlobalTable *);
 };
 
 /**
- * @brief Association list node for variable bindings
+ * @brief Toplevel bindings, each stored at the SymbolId of its name
+ *
+ * Toplevel names get no parse-time slots, since `define` forms keep
+ * adding them, but every name is already interned to a small dense
+ * integer. The binding of x therefore lives at index x, and looking it
+ * up, defining it or assigning it costs the same however many names the
+ * program defines.
  */
-struct AssocList {
-    std::string x;      ///< Variable name
-    Value v;            ///< Variable value
-    Assoc next;         ///< Next binding in the chain
-    AssocList(const std::string &, const Value &, Assoc &);
+struct GlobalTable : GcObject {
+    std::vector<Value> values;      ///< Value of each name, null while its define runs
+    std::vector<bool> defined;      ///< Whether each name is bound at all
+    GlobalTable();
+    ~GlobalTable();
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
 };
 
-// Environment operations
-Assoc empty();
-Assoc extend(const std::string&, const Value &, Assoc &);
-void modify(const std::string&, const Value &, Assoc &);
-void insert(const std::string&, const Value &, Assoc &);
-Value find(const std::string &, Assoc &);
-bool bound(const std::string &, Assoc &);
+/**
+ * @brief Count of changes to toplevel bindings on this thread
+ *
+ * Advanced by every insert and modify, and whenever a table drops its
+ * bindings, so a call site that cached its callee can tell that the
+ * binding is unchanged with a single compare.
+ */
+extern thread_local uint64_t binding_epoch;
+
+// Toplevel operations
+Globals makeGlobals();
+void insert(SymbolId, const Value &, Globals &);
+void modify(SymbolId, const Value &, Globals &);
+bool bound(SymbolId, Globals &);
+
+/// Toplevel binding of x, or a null Value when it has none
+inline Value find(SymbolId x, Globals &g) {
+    COUNT(global_lookups);
+    return (size_t)x < g->values.size() ? g->values[x] : Value(nullptr);
+}
+
+// ============================================================================
+// Lexical Frames
+// ============================================================================
+
+/**
+ * @brief Smart pointer wrapper for Frame (runtime environment)
+ */
+struct Env : GcRef<Frame> {
+    Env(Frame *);
+};
+
+/**
+ * @brief Activation record of one lexical scope
+ *
+ * Every binding introduced by a lambda, let or letrec (parameters and
+ * internal defines alike) owns a slot whose index is fixed by the parser,
+ * so one frame holds all of them. The outermost frame has no slots and
+ * carries the toplevel bindings instead.
+ */
+struct Frame : GcObject {
+    std::vector<Value> slots;   ///< Bindings, indexed by the parse-time slot
+    Env parent;                 ///< Lexically enclosing frame
+    Globals globals;            ///< Toplevel bindings (outermost frame only)
+    bool scoped;                ///< Lent out for a let or letrec, so never taken over by a tail call
+    Frame(size_t, const Env &);
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
+    static void *operator new(size_t);
+    static void operator delete(void *);
+};
+
+inline Env::Env(Frame *f) : GcRef<Frame>(f) {}
+
+Env makeFrame(size_t, const Env &);
+Env toplevel();
+
+/// Frame depth levels out from e, for a variable resolved to (depth, index)
+inline Frame *nthFrame(Env &e, int depth) {
+    COUNT(frame_lookups);
+    COUNT_N(frame_hops, depth);
+    Frame *f = e.get();
+    for (int i = 0; i < depth; ++i) {
+        f = f->parent.get();
+    }
+    return f;
+}
+
+/**
+ * @brief Frame of a scope that nothing captures, for the span of a C++ scope
+ *
+ * A let, letrec or lambda body that markLocalFrames found to create no
+ * closure runs in a frame taken from a per-thread stack of spare frames:
+ * entering the scope refills one instead of allocating it, and the
+ * collector never tracks it. Leaving the scope drops the bindings and
+ * keeps the frame for the next scope at the same depth. Should the frame
+ * still be referred to then after all, it is handed to the collector as
+ * an ordinary frame and the stack gets a fresh one in its place.
+ *
+ * A call frame may be taken over by a tail call of the body, since the
+ * pending calls run before the caller's scope ends. A let or letrec
+ * frame is lent `scoped`: the body's tail call runs after it is gone.
+ */
+struct LocalFrame {
+    Env &env;
+    LocalFrame(size_t, const Env &, bool scoped = true);
+    ~LocalFrame();
+    LocalFrame(const LocalFrame &) = delete;
+    LocalFrame &operator=(const LocalFrame &) = delete;
+};
+
+/**
+ * @brief Free this thread's spare frames, before its arenas are released
+ */
+void releaseLocalFrames();
+
+/**
+ * @brief Parse-time mirror of a Frame, used to resolve variables
+ *
+ * The parser opens one Scope for every frame the evaluator will create
+ * and records the slot layout in `names`. Resolving a name yields the
+ * number of frames to walk up and the slot to read, or a miss when the
+ * name must be looked up among the toplevel bindings.
+ *
+ * Whether a toplevel name still means its builtin is kept in a table
+ * indexed by SymbolId on the outermost scope: it is filled from the
+ * bindings once, then every toplevel define or set! the parser produces
+ * marks its name, so the check never walks the global chain.
+ */
+struct Scope {
+    std::vector<SymbolId> names;      ///< Slot layout of the frame
+    Scope *parent;                    ///< Enclosing scope, nullptr at toplevel
+    Globals &globals;                 ///< Toplevel bindings seen by the parser
+    Scope *root;                      ///< Outermost scope, owner of user_globals
+    std::vector<bool> user_globals;   ///< Toplevel names bound to anything but their builtin
+    SymbolId owner;                   ///< Named procedure whose body is being parsed, -1 outside one
+    Scope(Globals &);
+    Scope(const std::vector<SymbolId> &, Scope &);
+    bool resolve(SymbolId, int &, int &);
+    int depth() const;
+    int declare(SymbolId);
+    void defineGlobal(SymbolId);
+    bool bound(SymbolId);
+};
 
 // ============================================================================
 // Simple Value Types
@@ -83,6 +239,7 @@ bool bound(const std::string &, Assoc &);
  * @brief Void value (represents no meaningful return value)
  */
 struct Void : ValueBase {
+    static constexpr ValueType tag = V_VOID;
     Void();
     virtual void show(std::ostream &) override;
 };
@@ -90,29 +247,51 @@ Value VoidV();
 
 /**
  * @brief Integer value
+ *
+ * Integers are immediates; this is only the shared header that fixnum
+ * handles resolve to. Read the number with Value::fixnum().
  */
 struct Integer : ValueBase {
-    NumericType n;
-    Integer(NumericType);
+    static constexpr ValueType tag = V_INT;
+    Integer();
     virtual void show(std::ostream &) override;
 };
 Value IntegerV(NumericType);
 
+/**
+ * @brief Integer outside the fixnum range
+ *
+ * Arithmetic promotes to a BigInteger only when a fixnum result would
+ * overflow, and IntegerV(const BigInt &) demotes back, so a BigInteger
+ * never holds a value that fits in NumericType.
+ */
+struct BigInteger : ValueBase {
+    static constexpr ValueType tag = V_BIGINT;
+    BigInt n;
+    BigInteger(const BigInt &);
+    virtual void show(std::ostream &) override;
+};
+Value IntegerV(const BigInt &);
+
 /**
  * @brief Rational number value
+ *
+ * Kept in lowest terms with a positive denominator.
  */
 struct Rational : ValueBase {
-    NumericType numerator;
-    NumericType denominator;
-    Rational(NumericType, NumericType);
+    static constexpr ValueType tag = V_RATIONAL;
+    BigInt numerator;
+    BigInt denominator;
+    Rational(const BigInt &, const BigInt &);
     virtual void show(std::ostream &) override;
 };
-Value RationalV(NumericType, NumericType);
+Value RationalV(const BigInt &, const BigInt &);
 
 /**
  * @brief Boolean value
  */
 struct Boolean : ValueBase {
+    static constexpr ValueType tag = V_BOOL;
     bool b;
     Boolean(bool);
     virtual void show(std::ostream &) override;
@@ -121,18 +300,28 @@ Value BooleanV(bool);
 
 /**
  * @brief Symbol value
+ *
+ * Symbols are interned: there is exactly one Symbol per name, created on
+ * first use and shared afterwards, so eq? on symbols is a pointer compare
+ * and quoting a symbol never allocates.
  */
 struct Symbol : ValueBase {
+    static constexpr ValueType tag = V_SYM;
     std::string s;
-    Symbol(const std::string &);
+    SymbolId id;
+    Symbol(SymbolId);
     virtual void show(std::ostream &) override;
 };
+Value SymbolV(SymbolId);
 Value SymbolV(const std::string &);
+/// Drop this thread's Symbol objects; ids stay valid and are remade on demand
+void releaseSymbols();
 
 /**
  * @brief String value
  */
 struct String : ValueBase {
+    static constexpr ValueType tag = V_STRING;
     std::string s;
     String(const std::string &);
     virtual void show(std::ostream &) override;
@@ -147,9 +336,9 @@ Value StringV(const std::string &);
  * @brief Null value (empty list)
  */
 struct Null : ValueBase {
+    static constexpr ValueType tag = V_NULL;
     Null();
     virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
 };
 Value NullV();
 
@@ -157,6 +346,7 @@ Value NullV();
  * @brief Termination signal value
  */
 struct Terminate : ValueBase {
+    static constexpr ValueType tag = V_TERMINATE;
     Terminate();
     virtual void show(std::ostream &) override;
 };
@@ -170,25 +360,161 @@ Value TerminateV();
  * @brief Pair value (cons cell)
  */
 struct Pair : ValueBase {
+    static constexpr ValueType tag = V_PAIR;
     Value car;  ///< First element
     Value cdr;  ///< Second element
     Pair(const Value &, const Value &);
     virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
+    static void *operator new(size_t);
+    static void operator delete(void *);
 };
 Value PairV(const Value &, const Value &);
 
+/**
+ * @brief Vector value: a fixed number of slots stored contiguously
+ */
+struct Vector : ValueBase {
+    static constexpr ValueType tag = V_VECTOR;
+    std::vector<Value> items;   ///< Elements in index order
+    Vector(size_t, const Value &);
+    Vector(const Value *, size_t);
+    virtual void show(std::ostream &) override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
+};
+Value VectorV(size_t, const Value &);
+Value VectorV(const Value *, size_t);
+
+/// Record that a pair or vector was changed in place; until the first such
+/// change on a thread, none of its lists and vectors can reach itself
+void noteMutation();
+bool structureMutated();
+
+/**
+ * @brief Mutable hash table
+ *
+ * Keys match when eq? would call them equal, and strings and rationals
+ * also match by content. Entries live in two parallel arrays whose size
+ * is a power of two, probed linearly from the key's hash; a null key
+ * marks a free slot. Entries are never removed, so a probe stops at the
+ * first free slot.
+ */
+struct HashTable : ValueBase {
+    static constexpr ValueType tag = V_HASHTABLE;
+    std::vector<Value> keys;    ///< Key of each slot, null when free
+    std::vector<Value> values;  ///< Value stored under the slot's key
+    size_t count;               ///< Occupied slots
+    HashTable();
+    Value *lookup(const Value &);               ///< Value under a key, or nullptr
+    void store(const Value &, const Value &);   ///< Add or replace an entry
+    virtual void show(std::ostream &) override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
+};
+Value HashTableV();
+
+/**
+ * @brief Promise made by delay or cons-stream
+ *
+ * Holds the delayed expression and the frame it closes over until it is
+ * first forced, and only the result from then on: a forced stream cell
+ * does not keep the environment that built it alive, and the cells a
+ * consumer has moved past are freed as it goes.
+ */
+struct Promise : ValueBase {
+    static constexpr ValueType tag = V_PROMISE;
+    Expr e;         ///< Delayed expression, null once forced
+    Env env;        ///< Frame it is evaluated in, null once forced
+    Value value;    ///< Result of the first force
+    Promise(const Expr &, const Env &);
+    bool forced() const { return e.get() == nullptr; }
+    virtual void show(std::ostream &) override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
+    static void *operator new(size_t);
+    static void operator delete(void *);
+};
+Value PromiseV(const Expr &, const Env &);
+
+/**
+ * @brief Result cache of a procedure made by memoize or define-memo
+ *
+ * Argument lists are keyed structurally: atoms compare as hash table keys
+ * do (eq?, with strings and numbers by content), pairs by their cars and
+ * cdrs and vectors element by element. The key holds the argument objects
+ * themselves, so a pair or vector mutated after the call no longer finds
+ * its entry. A hash table's contents are not part of any key, so a call
+ * with one anywhere in its arguments is not cached at all. Hashing stops
+ * after a fixed number of nodes and so does comparison, which then
+ * reports a miss; a cyclic or very long argument is just never found.
+ * Once capacity entries are held the least recently used one is dropped.
+ */
+struct MemoCache {
+    struct Entry {
+        std::vector<Value> args;
+        Value result;
+        size_t hash;
+    };
+    std::list<Entry> entries;       ///< Most recently used first
+    std::unordered_multimap<size_t, std::list<Entry>::iterator> index;
+    size_t capacity;
+    uint64_t hits;
+    uint64_t misses;
+    explicit MemoCache(size_t);
+    /// Hash of an argument list; false when the call must not be cached
+    static bool hash(const Value *, size_t, size_t &);
+    /// Cached result for the arguments, or nullptr; counts a hit or a miss
+    Value *lookup(const Value *, size_t, size_t hash);
+    void store(const Value *, size_t, size_t hash, const Value &);
+    void traverse(GcVisitor &);
+    void clear();
+};
+
 /**
  * @brief Procedure (function) value
  */
 struct Procedure : ValueBase {
-    std::vector<std::string> parameters;   ///< Parameter names
+    static constexpr ValueType tag = V_PROC;
+    std::vector<SymbolId> parameters;      ///< Parameter names
     Expr e;                                ///< Function body expression
-    Assoc env;                             ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
+    Env env;                               ///< Closure environment
+    size_t frame_size;                     ///< Slots of a call frame (parameters first)
+    std::shared_ptr<Chunk> code;           ///< Bytecode of the body, once compiled by the VM
+    SymbolId name;                         ///< Name the profiler reports it under, -1 if none
+    std::unique_ptr<MemoCache> memo;       ///< Results so far, for a memoized procedure
+    bool local_frame;                      ///< No closure captures a call frame, see LocalFrame
+    Procedure(const std::vector<SymbolId> &, const Expr &, const Env &, size_t, SymbolId = -1);
+    virtual void show(std::ostream &) override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clear() override;
+    static void *operator new(size_t);
+    static void operator delete(void *);
+};
+Value ProcedureV(const std::vector<SymbolId> &, const Expr &, const Env &, size_t, SymbolId = -1);
+
+/// Native entry point of a builtin: the argument array and its length
+using PrimitiveFn = Value (*)(const Value *, size_t);
+
+/**
+ * @brief Builtin procedure implemented in C++
+ *
+ * One Primitive per builtin is bound into the toplevel environment at
+ * startup, so passing `car` or `+` around is a plain variable lookup and
+ * calling it is a single indirect call on the evaluated arguments.
+ */
+struct Primitive : ValueBase {
+    static constexpr ValueType tag = V_PRIMITIVE;
+    SymbolId name;      ///< Name the builtin is bound to
+    PrimitiveFn fn;     ///< Implementation
+    int min_args;       ///< Fewest arguments accepted
+    int max_args;       ///< Most arguments accepted, -1 for no limit
+    Primitive(SymbolId, PrimitiveFn, int, int);
+    Value call(const Value *, size_t);
     virtual void show(std::ostream &) override;
 };
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
+Value PrimitiveV(SymbolId, PrimitiveFn, int, int);
 
 // ============================================================================
 // Utility Functions
@@ -196,4 +522,133 @@ Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
 
 std::ostream &operator<<(std::ostream &, Value &);
 
+/**
+ * @brief Stream that display writes to
+ *
+ * Per thread and std::cout unless redirected, so that programs run side by
+ * side in batch mode each collect their own output.
+ */
+std::ostream &outputStream();
+void setOutputStream(std::ostream *);
+
+// ============================================================================
+// Static Dispatch
+// ============================================================================
+
+/**
+ * @brief Checked downcast of a value keyed on v_type
+ *
+ * Returns nullptr unless the value is a T, and never consults RTTI.
+ */
+template <class T>
+inline T *valueAs(const Value &v) {
+    if constexpr (T::tag == V_INT || T::tag == V_BOOL || T::tag == V_NULL || T::tag == V_VOID) {
+        return v->v_type == T::tag ? static_cast<T*>(v.get()) : nullptr;
+    } else {
+        // never an immediate, so the tag bits settle most mismatches
+        // without loading an object
+        return v.isHeap() && v.get()->v_type == T::tag ? static_cast<T*>(v.get()) : nullptr;
+    }
+}
+
+// ============================================================================
+// Inline Value Operations
+// ============================================================================
+
+/// Shared objects behind immediates: index 0 for fixnums, constant k at k
+extern ValueBase *const immediate_headers[];
+
+inline Value::Value(ValueBase *p) : bits(reinterpret_cast<uintptr_t>(p)) {
+    if (p != nullptr) {
+        ++p->refs;
+    }
+}
+
+inline bool Value::isHeap() const {
+    return (bits & TAG_MASK) == 0 && bits != 0;
+}
+
+inline Value::Value(const Value &other) : bits(other.bits) {
+    if (isHeap()) {
+        ++reinterpret_cast<ValueBase*>(bits)->refs;
+    }
+}
+
+inline Value::Value(Value &&other) noexcept : bits(other.bits) {
+    other.bits = 0;
+}
+
+inline Value::~Value() {
+    if (isHeap()) {
+        ValueBase *p = reinterpret_cast<ValueBase*>(bits);
+        if (--p->refs == 0) {
+            gcFree(p);
+        }
+    }
+}
+
+inline Value &Value::operator=(const Value &other) {
+    Value copy(other);
+    std::swap(bits, copy.bits);
+    return *this;
+}
+
+inline Value &Value::operator=(Value &&other) noexcept {
+    std::swap(bits, other.bits);
+    return *this;
+}
+
+inline Value Value::immediate(uintptr_t b) {
+    Value v(nullptr);
+    v.bits = b;
+    return v;
+}
+
+inline bool Value::isFixnum() const {
+    return (bits & FIXNUM_TAG) != 0;
+}
+
+inline NumericType Value::fixnum() const {
+    return static_cast<NumericType>(static_cast<intptr_t>(bits) >> 1);
+}
+
+inline bool Value::isFalse() const {
+    return bits == FALSE_BITS;
+}
+
+inline bool Value::isTrue() const {
+    return bits == TRUE_BITS;
+}
+
+inline ValueBase* Value::get() const {
+    if ((bits & TAG_MASK) == 0) {
+        return reinterpret_cast<ValueBase*>(bits);
+    }
+    return immediate_headers[(bits & FIXNUM_TAG) ? 0 : (bits >> 3)];
+}
+
+inline ValueBase* Value::operator->() const {
+    return get();
+}
+
+inline ValueBase& Value::operator*() {
+    return *get();
+}
+
+inline Value IntegerV(NumericType n) {
+    return Value::immediate((static_cast<uintptr_t>(static_cast<intptr_t>(n)) << 1) | Value::FIXNUM_TAG);
+}
+
+inline Value BooleanV(bool b) {
+    return Value::immediate(b ? Value::TRUE_BITS : Value::FALSE_BITS);
+}
+
+inline Value NullV() {
+    return Value::immediate(Value::NULL_BITS);
+}
+
+inline Value VoidV() {
+    return Value::immediate(Value::VOID_BITS);
+}
+
 #endif // VALUE
\ No newline at end of file
@@ -0,0 +1,816 @@
+/**
+ * @file vm.cpp
+ * @brief Bytecode compiler and dispatch loop of the stack VM
+ *
+ * The compiler lowers the core forms (literals, variables, control flow,
+ * binding forms, calls and the common primitives) to instructions and
+ * leaves everything else to an OP_EVAL escape into the tree-walker, so
+ * both backends share one set of semantics.
+ */
+
+#include "vm.hpp"
+#include "RE.hpp"
+#include "profile.hpp"
+#include "counters.hpp"
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+// ============================================================================
+// Compiler
+// ============================================================================
+
+namespace {
+
+class Compiler {
+public:
+    explicit Compiler(Chunk &chunk) : chunk(chunk) {}
+    void compile(const Expr &);
+
+private:
+    Chunk &chunk;
+
+    int emit(int word) {
+        chunk.code.push_back(word);
+        return (int)chunk.code.size() - 1;
+    }
+    int here() const { return (int)chunk.code.size(); }
+    void patch(int at) { chunk.code[at] = here(); }
+    int node(const Expr &e) {
+        chunk.nodes.push_back(e);
+        return (int)chunk.nodes.size() - 1;
+    }
+    void constant(const Value &v) {
+        chunk.consts.push_back(v);
+        emit(OP_CONST);
+        emit((int)chunk.consts.size() - 1);
+    }
+    void sequence(const std::vector<Expr> &es, size_t from);
+    void fallback(const Expr &e) {
+        emit(OP_EVAL);
+        emit(node(e));
+    }
+};
+
+/**
+ * @brief Opcode with an integer fast path for a binary primitive
+ */
+int binaryOpcode(ExprType type) {
+    switch (type) {
+        case E_PLUS:  return OP_ADD;
+        case E_MINUS: return OP_SUB;
+        case E_MUL:   return OP_MUL;
+        case E_LT:    return OP_LT;
+        case E_LE:    return OP_LE;
+        case E_EQ:    return OP_NUM_EQ;
+        case E_GE:    return OP_GE;
+        case E_GT:    return OP_GT;
+        default:      return OP_BINARY;
+    }
+}
+
+// compiles es[from..] leaving the value of the last one (void if none)
+void Compiler::sequence(const std::vector<Expr> &es, size_t from) {
+    if (from >= es.size()) {
+        constant(VoidV());
+        return;
+    }
+    for (size_t i = from; i < es.size(); ++i) {
+        if (i > from) {
+            emit(OP_POP);
+        }
+        compile(es[i]);
+    }
+}
+
+void Compiler::compile(const Expr &e) {
+    switch (e->e_type) {
+        case E_FIXNUM:
+            constant(static_cast<Fixnum*>(e.get())->datum);
+            return;
+        case E_RATIONAL:
+            constant(static_cast<RationalNum*>(e.get())->datum);
+            return;
+        case E_STRING:
+            constant(static_cast<StringExpr*>(e.get())->datum);
+            return;
+        case E_TRUE:
+            constant(static_cast<True*>(e.get())->datum);
+            return;
+        case E_FALSE:
+            constant(static_cast<False*>(e.get())->datum);
+            return;
+        case E_QUOTE:
+            constant(static_cast<Quote*>(e.get())->datum);
+            return;
+        case E_VOID:
+            constant(VoidV());
+            return;
+        case E_AND: {
+            auto and_expr = static_cast<AndVar*>(e.get());
+            if (and_expr->rands.empty()) {
+                constant(BooleanV(true));
+                return;
+            }
+            std::vector<int> exits;
+            for (size_t i = 0; i + 1 < and_expr->rands.size(); ++i) {
+                compile(and_expr->rands[i]);
+                emit(OP_AND_JUMP);
+                exits.push_back(emit(0));
+            }
+            compile(and_expr->rands.back());
+            for (int at : exits) {
+                patch(at);
+            }
+            return;
+        }
+        case E_OR: {
+            auto or_expr = static_cast<OrVar*>(e.get());
+            if (or_expr->rands.empty()) {
+                constant(BooleanV(false));
+                return;
+            }
+            std::vector<int> exits;
+            for (size_t i = 0; i + 1 < or_expr->rands.size(); ++i) {
+                compile(or_expr->rands[i]);
+                emit(OP_OR_JUMP);
+                exits.push_back(emit(0));
+            }
+            compile(or_expr->rands.back());
+            for (int at : exits) {
+                patch(at);
+            }
+            return;
+        }
+        case E_BEGIN:
+            sequence(static_cast<Begin*>(e.get())->es, 0);
+            return;
+        case E_IF: {
+            auto if_expr = static_cast<If*>(e.get());
+            compile(if_expr->cond);
+            emit(OP_JUMP_IF_FALSE);
+            int to_alter = emit(0);
+            compile(if_expr->conseq);
+            emit(OP_JUMP);
+            int to_end = emit(0);
+            patch(to_alter);
+            compile(if_expr->alter);
+            patch(to_end);
+            return;
+        }
+        case E_COND: {
+            // a clause is taken only when its test yields exactly #t
+            auto cond_expr = static_cast<Cond*>(e.get());
+            size_t n = cond_expr->has_else ? cond_expr->clauses.size() - 1 : cond_expr->clauses.size();
+            std::vector<int> exits;
+            for (size_t i = 0; i < n; ++i) {
+                const auto &clause = cond_expr->clauses[i];
+                compile(clause[0]);
+                emit(OP_JUMP_UNLESS_TRUE);
+                int to_next = emit(0);
+                if (clause.size() == 1) {
+                    constant(BooleanV(true));
+                } else {
+                    sequence(clause, 1);
+                }
+                emit(OP_JUMP);
+                exits.push_back(emit(0));
+                patch(to_next);
+            }
+            if (cond_expr->has_else) {
+                sequence(cond_expr->clauses[n], 0);
+            } else {
+                constant(VoidV());
+            }
+            for (int at : exits) {
+                patch(at);
+            }
+            return;
+        }
+        case E_VAR: {
+            auto var = static_cast<Var*>(e.get());
+            if (var->index >= 0) {
+                emit(OP_LOCAL);
+                emit(var->depth);
+                emit(var->index);
+                emit(node(e));
+            } else {
+                emit(OP_GLOBAL);
+                emit(node(e));
+            }
+            return;
+        }
+        case E_APPLY: {
+            auto apply = static_cast<Apply*>(e.get());
+            compile(apply->rator);
+            emit(OP_CHECK_PROC);
+            for (const auto &arg : apply->rand) {
+                compile(arg);
+            }
+            emit(apply->tail ? OP_TAIL_CALL : OP_CALL);
+            emit((int)apply->rand.size());
+            return;
+        }
+        case E_APPLYFUNC: {
+            // (apply f obj ... list) is a call whose last operand is spread
+            auto apply = static_cast<ApplyFunc*>(e.get());
+            if (apply->rands.size() < 2) {
+                break;
+            }
+            compile(apply->rands[0]);
+            emit(OP_CHECK_PROC);
+            for (size_t i = 1; i < apply->rands.size(); ++i) {
+                compile(apply->rands[i]);
+            }
+            emit(apply->tail ? OP_TAIL_APPLY : OP_APPLY);
+            emit((int)apply->rands.size() - 1);
+            return;
+        }
+        case E_LAMBDA:
+            emit(OP_CLOSURE);
+            emit(node(e));
+            return;
+        case E_DEFINE: {
+            auto define = static_cast<Define*>(e.get());
+            if (define->index >= 0) {
+                compile(define->e);
+                emit(OP_DEFINE_LOCAL);
+                emit(define->index);
+            } else {
+                int k = node(e);
+                emit(OP_DECLARE_GLOBAL);
+                emit(k);
+                compile(define->e);
+                emit(OP_DEFINE_GLOBAL);
+                emit(k);
+            }
+            return;
+        }
+        case E_LET: {
+            auto let = static_cast<Let*>(e.get());
+            for (const auto &binding : let->bind) {
+                compile(binding.second);
+            }
+            emit(OP_ENTER_FRAME);
+            emit((int)let->bind.size());
+            emit((int)let->frame_size);
+            compile(let->body);
+            emit(OP_LEAVE_FRAME);
+            return;
+        }
+        case E_LETREC: {
+            auto letrec = static_cast<Letrec*>(e.get());
+            emit(OP_ENTER_FRAME);
+            emit(0);
+            emit((int)letrec->frame_size);
+            for (size_t i = 0; i < letrec->bind.size(); ++i) {
+                compile(letrec->bind[i].second);
+                emit(OP_STORE_SLOT);
+                emit((int)i);
+            }
+            compile(letrec->body);
+            emit(OP_LEAVE_FRAME);
+            return;
+        }
+        case E_SET: {
+            auto set = static_cast<Set*>(e.get());
+            compile(set->e);
+            if (set->index >= 0) {
+                emit(OP_SET_LOCAL);
+                emit(set->depth);
+                emit(set->index);
+            } else {
+                emit(OP_SET_GLOBAL);
+                emit(node(e));
+            }
+            return;
+        }
+        default:
+            break;
+    }
+
+    if (auto unary = exprAs<Unary>(e)) {
+        compile(unary->rand);
+        switch (e->e_type) {
+            case E_CAR:   emit(OP_CAR); break;
+            case E_CDR:   emit(OP_CDR); break;
+            case E_NULLQ: emit(OP_NULLQ); break;
+            case E_NOT:   emit(OP_NOT); break;
+            default:
+                emit(OP_UNARY);
+                emit(node(e));
+        }
+    } else if (auto binary = exprAs<Binary>(e)) {
+        compile(binary->rand1);
+        compile(binary->rand2);
+        if (e->e_type == E_CONS) {
+            emit(OP_CONS);
+        } else {
+            emit(binaryOpcode(e->e_type));
+            emit(node(e));
+        }
+    } else if (auto variadic = exprAs<Variadic>(e)) {
+        for (const auto &arg : variadic->rands) {
+            compile(arg);
+        }
+        emit(OP_VARIADIC);
+        emit(node(e));
+        emit((int)variadic->rands.size());
+    } else {
+        // exit, gc-stats, runtime-stats, ...
+        fallback(e);
+    }
+}
+
+} // namespace
+
+std::shared_ptr<Chunk> compileToplevel(const Expr &e) {
+    auto chunk = std::make_shared<Chunk>();
+    Compiler(*chunk).compile(e);
+    chunk->code.push_back(OP_HALT);
+    return chunk;
+}
+
+std::shared_ptr<Chunk> compileBody(const Expr &e) {
+    auto chunk = std::make_shared<Chunk>();
+    Compiler(*chunk).compile(e);
+    chunk->code.push_back(OP_RETURN);
+    return chunk;
+}
+
+// ============================================================================
+// Virtual machine
+// ============================================================================
+
+VM::VM() {
+    stack.reserve(1024);
+    frames.reserve(256);
+}
+
+// frames kept once their activations end; a deep recursion releases many
+static const size_t VM_SPARE_FRAMES = 256;
+
+// a frame for a call or let, refilled from the spares when there is one
+inline Env VM::takeFrame(size_t size, const Env &parent) {
+    if (spare.empty()) {
+        return makeFrame(size, parent);
+    }
+    COUNT(local_frames);
+    Env frame = std::move(spare.back());
+    spare.pop_back();
+    if (frame->slots.size() != size) {
+        frame->slots.resize(size, Value(nullptr));
+    }
+    frame->parent = parent;
+    return frame;
+}
+
+// ends an activation's hold on its frame; a frame nothing else refers to
+// (no closure or promise captured it) is emptied and kept for reuse
+inline void VM::dropFrame(Env &frame) {
+    Frame *f = frame.get();
+    if (f->refs == 1 && spare.size() < VM_SPARE_FRAMES) {
+        // emptied in place: the next call is usually of the same size
+        for (Value &slot : f->slots) {
+            slot = Value(nullptr);
+        }
+        f->parent = Env(nullptr);
+        spare.push_back(std::move(frame));
+    } else {
+        frame = Env(nullptr);
+    }
+}
+
+// A computed goto leaves a handler's scope without running destructors, so
+// handlers must not hold locals with destructors (Value, Env) across
+// VM_DISPATCH; keep them in temporaries or an inner block instead.
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(op) L_##op:
+#define VM_DISPATCH() goto *dispatch_table[*pc++]
+#else
+#define VM_CASE(op) case op: L_##op:
+#define VM_DISPATCH() break
+#endif
+
+// fixnum fast path of the binary arithmetic opcodes; an overflowing
+// result goes through the node, which promotes it to a bignum
+#define VM_ARITH_OP(op, checked_builtin)                                      \
+    VM_CASE(op) {                                                             \
+        int k = *pc++;                                                        \
+        Value &a = stack[stack.size() - 2];                                   \
+        const Value &b = stack.back();                                        \
+        NumericType r;                                                        \
+        if (a.isFixnum() && b.isFixnum() &&                                   \
+            !checked_builtin(a.fixnum(), b.fixnum(), &r)) {                   \
+            a = IntegerV(r);                                                  \
+        } else {                                                              \
+            a = static_cast<Binary*>(chunk->nodes[k].get())->evalRator(a, b); \
+        }                                                                     \
+        stack.pop_back();                                                     \
+        VM_DISPATCH();                                                        \
+    }
+
+// fixnum fast path of the binary comparison opcodes
+#define VM_COMPARE_OP(op, cmp)                                                \
+    VM_CASE(op) {                                                             \
+        int k = *pc++;                                                        \
+        Value &a = stack[stack.size() - 2];                                   \
+        const Value &b = stack.back();                                        \
+        if (a.isFixnum() && b.isFixnum()) {                                   \
+            a = BooleanV(a.fixnum() cmp b.fixnum());                          \
+        } else {                                                              \
+            a = static_cast<Binary*>(chunk->nodes[k].get())->evalRator(a, b); \
+        }                                                                     \
+        stack.pop_back();                                                     \
+        VM_DISPATCH();                                                        \
+    }
+
+// shrinks the stack to n values; unlike erase this inlines to a loop of
+// destructor calls, which is all a call needs for its few arguments
+static inline void popTo(std::vector<Value> &stack, size_t n) {
+    while (stack.size() > n) {
+        stack.pop_back();
+    }
+}
+
+// replaces the list on top of the stack by its elements; returns the
+// argument count of a call whose n operands ended with that list
+static int spreadLast(std::vector<Value> &stack, int n) {
+    Value list = std::move(stack.back());
+    stack.pop_back();
+    const Value *cur = &list;
+    while ((*cur)->v_type == V_PAIR) {
+        Pair *p = static_cast<Pair*>(cur->get());
+        stack.push_back(p->car);
+        cur = &p->cdr;
+        ++n;
+    }
+    if ((*cur)->v_type != V_NULL) {
+        throw RuntimeError("apply: expects last argument to be a list");
+    }
+    return n - 1;
+}
+
+Value VM::run(const Chunk &entry, Env &e) {
+    const size_t stack_floor = stack.size();
+    const size_t frames_floor = frames.size();
+    const size_t profile_floor = profileDepth();
+#ifdef RUNTIME_COUNTERS
+    const uint64_t depth_floor = runtime_counters.depth;
+#endif
+    const Chunk *chunk = &entry;
+    const int *pc = entry.code.data();
+    Env env = e;
+    bool call_tail;     // operands of the call handler, shared with apply
+    int call_argc;
+
+    try {
+#ifdef VM_COMPUTED_GOTO
+        // must list the labels in OpCode order
+        static void *dispatch_table[] = {
+            &&L_OP_CONST, &&L_OP_LOCAL, &&L_OP_GLOBAL, &&L_OP_SET_LOCAL,
+            &&L_OP_SET_GLOBAL, &&L_OP_DECLARE_GLOBAL, &&L_OP_DEFINE_GLOBAL,
+            &&L_OP_DEFINE_LOCAL, &&L_OP_POP, &&L_OP_JUMP, &&L_OP_JUMP_IF_FALSE,
+            &&L_OP_JUMP_UNLESS_TRUE, &&L_OP_AND_JUMP, &&L_OP_OR_JUMP,
+            &&L_OP_ENTER_FRAME, &&L_OP_LEAVE_FRAME, &&L_OP_STORE_SLOT,
+            &&L_OP_CLOSURE, &&L_OP_CHECK_PROC, &&L_OP_CALL, &&L_OP_TAIL_CALL,
+            &&L_OP_APPLY, &&L_OP_TAIL_APPLY, &&L_OP_RETURN, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_LT,
+            &&L_OP_LE, &&L_OP_NUM_EQ, &&L_OP_GE, &&L_OP_GT, &&L_OP_CAR,
+            &&L_OP_CDR, &&L_OP_CONS, &&L_OP_NULLQ, &&L_OP_NOT, &&L_OP_UNARY,
+            &&L_OP_BINARY, &&L_OP_VARIADIC, &&L_OP_EVAL, &&L_OP_HALT
+        };
+        static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == OP_COUNT,
+                      "dispatch table out of sync with OpCode");
+        VM_DISPATCH();
+#else
+        for (;;) switch (*pc++) {
+#endif
+
+        VM_CASE(OP_CONST) {
+            stack.push_back(chunk->consts[*pc++]);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_LOCAL) {
+            int depth = pc[0], index = pc[1], k = pc[2];
+            pc += 3;
+            const Value &v = nthFrame(env, depth)->slots[index];
+            if (v.get() != nullptr) {
+                stack.push_back(v);
+            } else {
+                // unassigned: let the tree-walker report it or supply a primitive
+                stack.push_back(chunk->nodes[k]->eval(env));
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_GLOBAL) {
+            const Expr &var_node = chunk->nodes[*pc++];
+            auto var = static_cast<Var*>(var_node.get());
+            stack.push_back(find(var->x, nthFrame(env, var->depth)->globals));
+            if (stack.back().get() == nullptr) {
+                stack.back() = var_node->eval(env);
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_SET_LOCAL) {
+            int depth = pc[0], index = pc[1];
+            pc += 2;
+            nthFrame(env, depth)->slots[index] = stack.back();
+            stack.back() = VoidV();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_SET_GLOBAL) {
+            auto set = static_cast<Set*>(chunk->nodes[*pc++].get());
+            modify(set->var, stack.back(), nthFrame(env, set->depth)->globals);
+            stack.back() = VoidV();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_DECLARE_GLOBAL) {
+            auto define = static_cast<Define*>(chunk->nodes[*pc++].get());
+            insert(define->var, Value(nullptr), env->globals);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_DEFINE_GLOBAL) {
+            auto define = static_cast<Define*>(chunk->nodes[*pc++].get());
+            modify(define->var, stack.back(), env->globals);
+            stack.back() = VoidV();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_DEFINE_LOCAL) {
+            env->slots[*pc++] = stack.back();
+            stack.back() = VoidV();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_POP) {
+            stack.pop_back();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_JUMP) {
+            pc = chunk->code.data() + *pc;
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_JUMP_IF_FALSE) {
+            int target = *pc++;
+            if (stack.back().isFalse()) {
+                pc = chunk->code.data() + target;
+            }
+            stack.pop_back();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_JUMP_UNLESS_TRUE) {
+            int target = *pc++;
+            if (!stack.back().isTrue()) {
+                pc = chunk->code.data() + target;
+            }
+            stack.pop_back();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_AND_JUMP) {
+            int target = *pc++;
+            if (stack.back().isFalse()) {
+                pc = chunk->code.data() + target;
+            } else {
+                stack.pop_back();
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_OR_JUMP) {
+            int target = *pc++;
+            if (!stack.back().isFalse()) {
+                pc = chunk->code.data() + target;
+            } else {
+                stack.pop_back();
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_ENTER_FRAME) {
+            int n = pc[0], size = pc[1];
+            pc += 2;
+            env = takeFrame(size, env);
+            size_t base = stack.size() - n;
+            for (int i = 0; i < n; ++i) {
+                env->slots[i] = std::move(stack[base + i]);
+            }
+            popTo(stack, base);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_LEAVE_FRAME) {
+            {
+                Env parent = env->parent;
+                dropFrame(env);
+                env = std::move(parent);
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_STORE_SLOT) {
+            env->slots[*pc++] = std::move(stack.back());
+            stack.pop_back();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_CLOSURE) {
+            auto lambda = static_cast<Lambda*>(chunk->nodes[*pc++].get());
+            if (!lambda->code) {
+                lambda->code = compileBody(lambda->e);
+            }
+            COUNT(closures);
+            stack.push_back(ProcedureV(lambda->x, lambda->e, env, lambda->frame_size, lambda->name));
+            Procedure *proc = static_cast<Procedure*>(stack.back().get());
+            proc->code = lambda->code;
+            proc->local_frame = lambda->local;
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_CHECK_PROC) {
+            ValueType type = stack.back()->v_type;
+            if (type != V_PROC && type != V_PRIMITIVE) {
+                throw RuntimeError("Attempt to apply a non-procedure");
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_APPLY)
+        VM_CASE(OP_TAIL_APPLY) {
+            call_tail = pc[-1] == OP_TAIL_APPLY;
+            call_argc = spreadLast(stack, *pc++);
+            goto L_call;
+        }
+        VM_CASE(OP_CALL)
+        VM_CASE(OP_TAIL_CALL)
+            call_tail = pc[-1] == OP_TAIL_CALL;
+            call_argc = *pc++;
+        L_call: {
+            bool tail = call_tail;
+            int n = call_argc;
+            size_t base = stack.size() - n - 1;
+            if (stack[base]->v_type == V_PRIMITIVE) {
+                // builtins read their arguments in place on the stack
+                auto prim = static_cast<Primitive*>(stack[base].get());
+                stack[base] = prim->call(stack.data() + base + 1, n);
+                popTo(stack, base + 1);
+                if (tail) {
+                    goto L_OP_RETURN;
+                }
+                VM_DISPATCH();
+            }
+            auto proc = static_cast<Procedure*>(stack[base].get());
+            if (!proc->code) {
+                // procedures made by the tree-walker are compiled on first call
+                proc->code = compileBody(proc->e);
+            }
+            if ((size_t)n != proc->parameters.size()) {
+                throw RuntimeError("Wrong number of arguments");
+            }
+            if (proc->memo) {
+                // as in callMemoized: a hit is answered here, and a miss
+                // runs as a call that is never a tail call, since OP_RETURN
+                // stores its result first
+                const Value *call_args = stack.data() + base + 1;
+                size_t hash;
+                if (!MemoCache::hash(call_args, n, hash)) {
+                    ++proc->memo->misses;
+                } else if (Value *hit = proc->memo->lookup(call_args, n, hash)) {
+                    stack[base] = *hit;
+                    popTo(stack, base + 1);
+                    if (tail) {
+                        goto L_OP_RETURN;
+                    }
+                    VM_DISPATCH();
+                } else {
+                    memo_calls.push_back(MemoCall{frames.size() + 1, stack[base],
+                                                  std::vector<Value>(call_args, call_args + n), hash});
+                }
+                tail = false;
+            }
+            {
+                if (profiling) {
+                    tail ? profileTailCall(proc->name) : profileEnter(proc->name);
+                }
+                if (tail) {
+                    // the arguments are on the stack, so a self tail call
+                    // gets the frame it is leaving back from the spares
+                    dropFrame(env);
+                    frames.back().proc = std::move(stack[base]);
+                } else {
+                    COUNT_ENTER();
+                    frames.push_back(CallFrame{std::move(stack[base]), chunk, pc, std::move(env)});
+                }
+                env = takeFrame(proc->frame_size, proc->env);
+                for (int i = 0; i < n; ++i) {
+                    env->slots[i] = std::move(stack[base + 1 + i]);
+                }
+                popTo(stack, base);
+                chunk = proc->code.get();
+                pc = chunk->code.data();
+            }
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_RETURN) {
+            if (profiling) {
+                profileLeave();
+            }
+            COUNT_LEAVE();
+            if (!memo_calls.empty() && memo_calls.back().depth == frames.size()) {
+                MemoCall &call = memo_calls.back();
+                static_cast<Procedure*>(call.proc.get())->memo->store(call.key.data(), call.key.size(),
+                                                                     call.hash, stack.back());
+                memo_calls.pop_back();
+            }
+            CallFrame &caller = frames.back();
+            chunk = caller.chunk;
+            pc = caller.pc;
+            dropFrame(env);
+            env = std::move(caller.env);
+            frames.pop_back();
+            VM_DISPATCH();
+        }
+        VM_ARITH_OP(OP_ADD, __builtin_add_overflow)
+        VM_ARITH_OP(OP_SUB, __builtin_sub_overflow)
+        VM_ARITH_OP(OP_MUL, __builtin_mul_overflow)
+        VM_COMPARE_OP(OP_LT, <)
+        VM_COMPARE_OP(OP_LE, <=)
+        VM_COMPARE_OP(OP_NUM_EQ, ==)
+        VM_COMPARE_OP(OP_GE, >=)
+        VM_COMPARE_OP(OP_GT, >)
+        VM_CASE(OP_CAR) {
+            Value &v = stack.back();
+            if (v->v_type != V_PAIR) {
+                throw RuntimeError("expects argument to be a pair");
+            }
+            v = Value(static_cast<Pair*>(v.get())->car);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_CDR) {
+            Value &v = stack.back();
+            if (v->v_type != V_PAIR) {
+                throw RuntimeError("expects argument to be a pair");
+            }
+            v = Value(static_cast<Pair*>(v.get())->cdr);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_CONS) {
+            Value &a = stack[stack.size() - 2];
+            a = PairV(a, stack.back());
+            stack.pop_back();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_NULLQ) {
+            Value &v = stack.back();
+            v = BooleanV(v->v_type == V_NULL);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_NOT) {
+            Value &v = stack.back();
+            v = BooleanV(v.isFalse());
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_UNARY) {
+            auto unary = static_cast<Unary*>(chunk->nodes[*pc++].get());
+            stack.back() = unary->evalRator(stack.back());
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_BINARY) {
+            auto binary = static_cast<Binary*>(chunk->nodes[*pc++].get());
+            Value &a = stack[stack.size() - 2];
+            a = binary->evalRator(a, stack.back());
+            stack.pop_back();
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_VARIADIC) {
+            auto variadic = static_cast<Variadic*>(chunk->nodes[pc[0]].get());
+            int n = pc[1];
+            pc += 2;
+            size_t base = stack.size() - n;
+            args.assign(stack.begin() + base, stack.end());
+            stack.push_back(variadic->evalRator(args));
+            args.clear();
+            stack.erase(stack.begin() + base, stack.end() - 1);
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_EVAL) {
+            stack.push_back(chunk->nodes[*pc++]->eval(env));
+            VM_DISPATCH();
+        }
+        VM_CASE(OP_HALT) {
+            Value result = std::move(stack.back());
+            stack.pop_back();
+            return result;
+        }
+
+#ifndef VM_COMPUTED_GOTO
+        default:
+            throw RuntimeError("VM: bad opcode");
+        }
+#endif
+    } catch (...) {
+        // drop whatever the failed form left behind
+        stack.erase(stack.begin() + stack_floor, stack.end());
+        frames.erase(frames.begin() + frames_floor, frames.end());
+        while (!memo_calls.empty() && memo_calls.back().depth > frames_floor) {
+            memo_calls.pop_back();
+        }
+        profileUnwind(profile_floor);
+#ifdef RUNTIME_COUNTERS
+        runtime_counters.depth = depth_floor;
+#endif
+        throw;
+    }
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# --batch： 由 ctest 运行， 第一个参数为解释器的路径， 其余参数（如 --vm）原样传给它
+# 对本目录下的程序做批量求值， 每个程序的输出必须与单独经管道交给 REPL 时
+# 去掉提示符后的输出一致， 与线程数、 输出方式无关
+
+code=$1
+shift
+tests=$(cd "$(dirname "$0")" && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "batch: $1" >&2
+    exit 1
+}
+
+# 单独运行： REPL 在输入结束后仍会等待， 所以补上 (exit)
+mkdir "$dir/single"
+for program in "$tests"/*.scm "$tests"/*.in; do
+    name=$(basename "$program")
+    name=${name%.*}
+    { cat "$program"; echo; echo "(exit)"; } | "$code" "$@" | sed 's/scm> //g' > "$dir/single/$name.out" \
+        || fail "$name does not run on its own"
+done
+
+for jobs in 1 4; do
+    mkdir "$dir/out$jobs"
+    "$code" "$@" --batch "$tests" --jobs $jobs --batch-out "$dir/out$jobs" || fail "--jobs $jobs failed"
+    for expected in "$dir"/single/*.out; do
+        name=$(basename "$expected")
+        cmp -s "$expected" "$dir/out$jobs/$name" || fail "$name differs with --jobs $jobs"
+    done
+done
+
+# 不指定 --batch-out 时按清单的顺序输出到标准输出
+ls "$tests"/*.in "$tests"/*.scm | sort -r > "$dir/list.txt"
+"$code" "$@" --batch "$dir/list.txt" --jobs 4 > "$dir/stdout" || fail "the manifest failed"
+while read -r program; do
+    name=$(basename "$program")
+    echo "==> $program <=="
+    cat "$dir/single/${name%.*}.out"
+done < "$dir/list.txt" > "$dir/expected"
+cmp -s "$dir/expected" "$dir/stdout" || fail "standard output differs: $(diff "$dir/expected" "$dir/stdout" | head -n 5)"
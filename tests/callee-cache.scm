@@ -0,0 +1,22 @@
+; 调用点缓存的全局过程被重新定义或 set! 后， 调用随之改变； 尾调用复用帧时，
+; 被闭包捕获的帧保持原样
+(define (callee x) (* x 2))
+(define (caller x) (callee x))
+(display (caller 5))
+(define (callee x) (+ x 100))
+(display (caller 5))
+(set! callee (lambda (x) (- x)))
+(display (caller 5))
+(set! callee car)
+(display (caller (list 7 8)))
+(define (loop n acc) (if (= n 0) acc (loop (- n 1) (+ acc 1))))
+(display (loop 1000000 0))
+(define (collect n acc) (if (= n 0) acc (collect (- n 1) (cons (lambda () n) acc))))
+(define thunks (collect 5 '()))
+(display (map (lambda (t) (t)) thunks))
+(define (mutual-a n) (if (= n 0) 'a (mutual-b (- n 1))))
+(define (mutual-b n) (if (= n 0) 'b (mutual-a (- n 1))))
+(display (mutual-a 1000001))
+(define (shrink a b c) (if (= a 0) (list a b c) (grow (- a 1))))
+(define (grow a) (shrink a (* a 2) (* a 3)))
+(display (grow 100000))
@@ -0,0 +1,83 @@
+#!/bin/sh
+# 损坏的映像： 由 ctest 运行， 参数为解释器的路径
+# 截断映像或改动其中任意一个字节后， 解释器要么照常运行， 要么在标准错误输出上
+# 报告 image: 开头的错误并以状态 1 退出， 不能崩溃
+
+code=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# 不含任何过程调用， 改动字节后得到的程序也不会无限递归
+cat > "$dir/prelude.scm" <<'EOF'
+(define r 1/98765)
+(define big 123456789012345678901234567890)
+(define l (list 1 "two" 'three (vector 4 5)))
+(define h (make-hash-table))
+(hash-set! h 'k l)
+(define p (delay (cons r big)))
+(define (adder n) (lambda (x) (+ x n)))
+(define (pick x y) (let ((s (- x y))) (if (> s 0) (car l) (cdr l))))
+EOF
+cat > "$dir/main.scm" <<'EOF'
+(display r)
+(display big)
+(display (hash-ref h 'k))
+(display (force p))
+(display (adder 2))
+(display (pick 1 2))
+EOF
+
+fail() {
+    echo "corrupt-image: $1" >&2
+    exit 1
+}
+
+"$code" --save-image "$dir/ok.img" "$dir/prelude.scm" || fail "cannot save the image"
+"$code" --image "$dir/ok.img" "$dir/main.scm" > /dev/null || fail "the intact image does not load"
+size=$(wc -c < "$dir/ok.img")
+
+# 载入失败时必须报告 image: 错误， 而不是被信号终止或抛出未捕获的异常
+check() {
+    timeout 10 "$code" --image "$dir/bad.img" "$dir/main.scm" > /dev/null 2> "$dir/err"
+    status=$?
+    if [ $status -eq 0 ]; then
+        return
+    fi
+    if [ $status -ne 1 ] || ! grep -q 'RuntimeError\|^image: ' "$dir/err"; then
+        fail "$1: exit status $status: $(head -c 200 "$dir/err")"
+    fi
+}
+
+# 截断在每一个位置
+i=0
+while [ $i -lt "$size" ]; do
+    head -c $i "$dir/ok.img" > "$dir/bad.img"
+    "$code" --image "$dir/bad.img" "$dir/main.scm" > /dev/null 2> "$dir/err"
+    status=$?
+    if [ $status -ne 1 ] || ! grep -q '^image: ' "$dir/err"; then
+        fail "truncated to $i bytes: exit status $status: $(head -c 200 "$dir/err")"
+    fi
+    i=$((i + 1))
+done
+
+# 分母为零的有理数
+offset=$(grep -boa 98765 "$dir/ok.img" | head -n 1 | cut -d: -f1)
+[ -n "$offset" ] || fail "denominator not found in the image"
+cp "$dir/ok.img" "$dir/bad.img"
+printf '00000' | dd of="$dir/bad.img" bs=1 seek="$offset" conv=notrunc 2> /dev/null
+"$code" --image "$dir/bad.img" "$dir/main.scm" > /dev/null 2> "$dir/err"
+status=$?
+if [ $status -ne 1 ] || ! grep -q '^image: ' "$dir/err"; then
+    fail "zero denominator: exit status $status: $(head -c 200 "$dir/err")"
+fi
+
+# 每个字节依次改为 0x00、 0x01 与 0xff
+for byte in '\000' '\001' '\377'; do
+    i=0
+    while [ $i -lt "$size" ]; do
+        cp "$dir/ok.img" "$dir/bad.img"
+        printf "$byte" | dd of="$dir/bad.img" bs=1 seek=$i conv=notrunc 2> /dev/null
+        check "byte $i set to $byte"
+        i=$((i + 1))
+    done
+done
@@ -0,0 +1,10 @@
+; 释放很长的表与很深的嵌套表时不能耗尽 C++ 栈
+(define (mk n acc) (if (= n 0) acc (mk (- n 1) (cons n acc))))
+(define (nest n acc) (if (= n 0) acc (nest (- n 1) (cons acc '()))))
+(define l (mk 1000000 '()))
+(display (car l))
+(define l 0)
+(define d (nest 1000000 '()))
+(define d 0)
+(define v (mk 1000000 '()))
+(display "done")
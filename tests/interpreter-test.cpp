@@ -0,0 +1,95 @@
+/**
+ * @file interpreter-test.cpp
+ * @brief Checks of the embedding interface in interpreter.hpp
+ *
+ * Built as the interpreter-test target and run by ctest. Every check runs
+ * on the tree-walker and on the VM; each failure is printed, and any
+ * failure makes the exit status 1.
+ */
+
+#include "interpreter.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace {
+
+int failures = 0;
+const char *mode = "";
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::cerr << "interpreter-test (" << mode << "): " << what << '\n';
+        ++failures;
+    }
+}
+
+// the printed form of a value, as the REPL would echo it
+std::string shown(const Value &v) {
+    std::ostringstream os;
+    v.show(os);
+    return os.str();
+}
+
+void evalResults(bool use_vm) {
+    Interpreter interp(use_vm);
+    EvalResult r = interp.eval("(define (sq x) (* x x)) (display (sq 7)) (sq 8)");
+    check(r.ok && r.error.empty(), "eval reports success");
+    check(shown(r.value) == "64", "eval returns the value of the last form");
+    check(interp.takeOutput() == "49\n", "display writes to the instance's buffer");
+    check(interp.takeOutput().empty(), "takeOutput empties the buffer");
+    check(shown(interp.eval("(sq 9)").value) == "81", "definitions carry over to later evals");
+
+    std::string text = "(+ 1 2)(+ 3 4)";
+    check(shown(interp.eval(std::string_view(text).substr(0, 7)).value) == "3",
+          "eval reads no further than the end of its view");
+    check(interp.eval("").ok, "an empty source evaluates");
+}
+
+void evalErrors(bool use_vm) {
+    Interpreter interp(use_vm);
+    EvalResult r = interp.eval("(define a 1) (car a) (define b 2)");
+    check(!r.ok && !r.error.empty(), "an error is reported in the result");
+    check(shown(interp.eval("a").value) == "1", "definitions made before an error stay");
+    check(!interp.eval("b").ok, "forms after an error do not run");
+    check(!interp.eval("(car").ok, "an unterminated form is reported, not thrown");
+    check(shown(interp.eval("(+ a 1)").value) == "2", "the instance keeps working after an error");
+
+    r = interp.eval("(define c 1) (exit) (define c 2)");
+    check(r.ok && r.value->v_type == V_TERMINATE, "(exit) ends eval with a Terminate value");
+    check(shown(interp.eval("c").value) == "1", "forms after (exit) do not run");
+}
+
+void independentInstances(bool use_vm) {
+    Interpreter a(use_vm), b(use_vm);
+    a.eval("(define x 1) (define (car p) 0) (display x)");
+    b.eval("(define x 2) (display x)");
+    check(shown(a.eval("x").value) == "1" && shown(b.eval("x").value) == "2",
+          "each instance has its own toplevel");
+    check(shown(b.eval("(car (cons 5 6))").value) == "5", "redefining a builtin stays in its instance");
+    check(a.takeOutput() == "1\n" && b.takeOutput() == "2\n", "each instance has its own output");
+    {
+        Interpreter inner(use_vm);
+        inner.eval("(define x 3)");
+    }
+    check(shown(a.eval("x").value) == "1", "destroying an instance leaves the others alone");
+
+    std::ostringstream sink;
+    Interpreter external(use_vm, nullptr, &sink);
+    external.eval("(display 5)");
+    check(sink.str() == "5\n", "output goes to the stream passed in");
+    check(external.takeOutput().empty(), "takeOutput is empty with an external stream");
+}
+
+} // namespace
+
+int main() {
+    for (bool use_vm : {false, true}) {
+        mode = use_vm ? "vm" : "tree";
+        evalResults(use_vm);
+        evalErrors(use_vm);
+        independentInstances(use_vm);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+; 记忆化过程的参数按内容比较： 向量改动之后重新计算， 含哈希表的调用不进缓存
+(define-memo (head v) (vector-ref v 0))
+(define vec (vector 1 2 3))
+(display (head vec))
+(vector-set! vec 0 2)
+(display (head vec))
+(display (head (vector 2 2 3)))
+(display (head (vector 2 2)))
+(define-memo (lookup h) (hash-ref h 'k))
+(define h (make-hash-table))
+(hash-set! h 'k 1)
+(display (lookup h))
+(hash-set! h 'k 2)
+(display (lookup h))
+(display (memo-stats head))
+(display (memo-stats lookup))
@@ -0,0 +1,44 @@
+#!/bin/sh
+# --profile-out： 由 ctest 运行， 第一个参数为解释器的路径， 其余参数（如 --vm）原样传给它
+# 折叠调用栈每行为 "路径 纳秒数"； 尾调用的被调过程画在它所替换的帧之下，
+# 直接递归与尾调用成环的过程折叠为一个帧
+
+code=$1
+shift
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "profile-out: $1" >&2
+    exit 1
+}
+
+cat > "$dir/main.scm" <<'SCM'
+(define (sq x) (* x x))
+(define (go n) (sq n))
+(define (work n acc) (if (= n 0) acc (work (- n 1) (+ acc (go n)))))
+(define (ping n) (if (= n 0) 0 (pong (- n 1))))
+(define (pong n) (if (= n 0) 0 (ping (- n 1))))
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+(display (work 1000 0))
+(display (ping 1001))
+(display (fact 20))
+SCM
+
+"$code" "$@" --profile-out "$dir/prof.folded" "$dir/main.scm" > "$dir/stdout" 2> "$dir/flat" \
+    || fail "the profiled run failed"
+printf '333833500\n0\n2432902008176640000\n' | cmp -s - "$dir/stdout" || fail "profiling changed the output"
+grep -q 'calls *self ms *total ms' "$dir/flat" || fail "no flat profile on standard error"
+
+grep -v -q -E '^[^ ;]+(;[^ ;]+)* [0-9]+$' "$dir/prof.folded" \
+    && fail "malformed line: $(grep -v -E '^[^ ;]+(;[^ ;]+)* [0-9]+$' "$dir/prof.folded" | head -n 1)"
+cat > "$dir/expected" <<'PATHS'
+fact
+ping
+ping;pong
+work
+work;go
+work;go;sq
+PATHS
+sed 's/ [0-9]*$//' "$dir/prof.folded" | sort > "$dir/paths"
+cmp -s "$dir/expected" "$dir/paths" || fail "stacks differ: $(diff "$dir/expected" "$dir/paths" | head -n 5)"
@@ -0,0 +1,29 @@
+# 回归测试： 由 ctest 以 cmake -P 运行
+# 需要 -DCODE=<解释器> -DPROGRAM=<测试程序 .scm 或 REPL 输入 .in>， 可选 -DMODE=--vm，
+# 以及 -DARGS=<其余命令行参数>（如 --whole-file）
+# .scm 以脚本方式运行， .in 经管道送给 REPL； 要求正常退出， 且输出与同名的
+# .out 文件完全一致
+
+get_filename_component(dir ${PROGRAM} DIRECTORY)
+get_filename_component(name ${PROGRAM} NAME_WE)
+if(PROGRAM MATCHES "\\.in$")
+    execute_process(COMMAND cat ${PROGRAM}
+        COMMAND ${CODE} ${MODE} ${ARGS}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE result
+        TIMEOUT 120)
+else()
+    execute_process(COMMAND ${CODE} ${MODE} ${ARGS} ${PROGRAM}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE result
+        TIMEOUT 120)
+endif()
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${name}: exited with ${result}\n${errors}")
+endif()
+file(READ ${dir}/${name}.out expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "${name}: output differs\n--- expected\n${expected}--- got\n${output}")
+endif()
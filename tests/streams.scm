@@ -0,0 +1,26 @@
+; 承诺只求值一次并缓存结果， 重入的 force 保留第一次的结果； 逐个走过的流不会留住已走过的单元
+(define count 0)
+(define p (delay (begin (set! count (+ count 1)) count)))
+(display (promise? p))
+(display (promise? 1))
+(display (force p))
+(display (force p))
+(display count)
+(display (force 5))
+(define outer #t)
+(define reentered (delay (if outer (begin (set! outer #f) (force reentered) 'outer) 'inner)))
+(display (force reentered))
+(display (force reentered))
+(define (ints n) (cons-stream n (ints (+ n 1))))
+(define (stream-ref s k) (if (= k 0) (stream-car s) (stream-ref (stream-cdr s) (- k 1))))
+(define nat (ints 0))
+(display (stream-ref nat 10))
+(define (lookup key alist) (if (eq? (car (car alist)) key) (cdr (car alist)) (lookup key (cdr alist))))
+(define (heap) (lookup 'heap-bytes (gc-stats)))
+(define before (heap))
+(display (stream-ref (ints 0) 1000000))
+(display (< (heap) (+ before 4000000)))
+(define (stream-map f s) (cons-stream (f (stream-car s)) (stream-map f (stream-cdr s))))
+(define squares (stream-map (lambda (x) (* x x)) nat))
+(display (stream-ref squares 12))
+(display (stream-car (stream-cdr nat)))
@@ -0,0 +1,11 @@
+; 尾位置上的 apply 是真正的尾调用， 递归多深都不会耗尽栈
+(define (cnt n) (if (= n 0) 0 (apply cnt (list (- n 1)))))
+(display (cnt 1000000))
+(define (sum-to n acc) (if (= n 0) acc (apply sum-to (- n 1) (list (+ acc n)))))
+(display (sum-to 1000000 0))
+(define (even2? n) (if (= n 0) #t (apply odd2? (list (- n 1)))))
+(define (odd2? n) (if (= n 0) #f (apply even2? (list (- n 1)))))
+(display (even2? 1000001))
+(define (via-builtin n) (if (= n 0) (apply + (list 1 2 3)) (apply via-builtin (list (- n 1)))))
+(display (via-builtin 100000))
+(display (+ 1 (apply cnt (list 5))))
@@ -0,0 +1,12 @@
+; 整个文件的顶层定义先登记， 再解析所有形式： 调用稍后才定义的过程照常进行，
+; 稍后被重新定义的内建过程不会在调用处内联为内建版本
+(define (first-of p) (car p))
+(display (first-of (list 1 2)))
+(define (use-later n) (later n))
+(define (car p) 'mine)
+(define (later n) (* n 10))
+(display (use-later 4))
+(display (first-of (list 1 2)))
+(define (is-even? n) (if (= n 0) #t (is-odd? (- n 1))))
+(define (is-odd? n) (if (= n 0) #f (is-even? (- n 1))))
+(display (is-even? 10))